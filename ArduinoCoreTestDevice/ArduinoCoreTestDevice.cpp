@@ -12,13 +12,17 @@
 //
 //
 
-#define JSONRPC_DEBUG_CLIENTSERVER 1
-
 #include "ArduinoCoreTestDevice.h"
 #include <ArduinoJson.hpp>
 #include <Common.h>
 #include <ModuleInterface.h>
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
 #include <cstdio>
+#include <iomanip>
 #include <iostream>
 #include <rdl/JsonDelegate.h>
 #include <rdl/JsonDispatch.h>
@@ -47,17 +51,22 @@ const char* g_FirmwareName       = "MM-Ardulingua";
 const int g_MinFirmwareVersion   = 1;
 const int g_MaxFirmwareVersion   = 2;
 const char* g_KeywordTest        = "Test";
+const char* g_KeywordBenchmark   = "Benchmark";
 const char* g_TestResultsUnknown = "Not Run";
 const char* g_TestResultsRun     = "Run";
 const char* g_TestResultsFailed  = "Failed";
 const char* g_TestResultsPassed  = "Passed";
 
+// minimum time between two change notifications of one property
+const int g_NotifyIntervalMs = 50;
+// longest wait for queued write-behind writes to reach the device
+const int g_WriteFlushMs = 10000;
+// one firmware telemetry read serves every Firmware* property for this long
+const int g_StatsMaxAgeMs = 200;
+
 const char* g_On  = "On";
 const char* g_Off = "Off";
 
-// static lock
-MMThreadLock CArduinoCoreTestDeviceHub::lock_;
-
 ///////////////////////////////////////////////////////////////////////////////
 // Exported MMDevice API
 ///////////////////////////////////////////////////////////////////////////////
@@ -83,17 +92,46 @@ MODULE_API void DeleteDevice(MM::Device* pDevice) { delete pDevice; }
 // ~~~~~~~~~~~~~~~~~~~~~~~~~~
 //
 CArduinoCoreTestDeviceHub::CArduinoCoreTestDeviceHub()
-    : initialized_(false), serial_(this), client_(serial_, serial_) {
+    : initialized_(false), serial_(this), reader_(serial_), link_(reader_),
+      ids_(link_), monitor_(ids_), client_(monitor_, monitor_),
+      maxBaud_(ctl::BAUD_RATES[ctl::BAUD_COUNT - 1]), baud_(ctl::BAUD_DEFAULT),
+      baudOpen_(ctl::BAUD_DEFAULT), writeBehind_(false), nested_(0), player_(false),
+      playPeriodUs_(0),
+      writes_([this](const std::string& name, const std::string& value) {
+          return WritePropertyNow(name, value);
+      }),
+      poller_([this](const std::vector<std::string>& targets, std::vector<std::string>& values) {
+          return FetchValues(targets, values);
+      }) {
     portAvailable_ = false;
+    portLock_      = nullptr;
+    traceLogged_   = 0;
     serial_.setTimeout(5000);
+    link_.setTimeout(5000);
 
     InitializeDefaultErrorMessages();
     rdlmm::InitCommonErrors(this, g_FirmwareName, g_MinFirmwareVersion);
+    SetErrorText(ERR_SEQUENCE_UPLOAD, "Chunked sequence upload rejected by the firmware");
+    SetErrorText(ERR_SEQUENCE_PLAYBACK, "Sequence playback rejected by the firmware");
 
     logger_ = LoggerT(this, true);
     client_.logger(&logger_);
+    // always-on trace instead of a synchronous debug print per call
+    monitor_.trace(&trace_);
+    reader_.subscribe([this](const uint8_t* frame, size_t size) {
+        OnDeviceNotification(frame, size);
+    });
 
     port_.create(this, g_infoPort);
+
+    CPropertyAction* pAct =
+        new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnMaxBaudRate);
+    CreateProperty(g_baudProp, std::to_string(maxBaud_).c_str(), MM::String, false, pAct,
+                   true);
+    AddAllowedValue(g_baudProp, g_Off);
+    for (uint32_t rate : ctl::BAUD_RATES) {
+        if (rate > ctl::BAUD_DEFAULT) AddAllowedValue(g_baudProp, std::to_string(rate).c_str());
+    }
 }
 
 CArduinoCoreTestDeviceHub::~CArduinoCoreTestDeviceHub() { Shutdown(); }
@@ -102,7 +140,186 @@ void CArduinoCoreTestDeviceHub::GetName(char* name) const {
     CDeviceUtils::CopyLimitedString(name, g_DeviceNameArduinoCoreTestDeviceHub);
 }
 
-bool CArduinoCoreTestDeviceHub::Busy() { return false; }
+bool CArduinoCoreTestDeviceHub::Busy() { return writes_.busy(); }
+
+// Outside calls to write-behind properties only queue the value. Any other
+// outside write first waits for the queue, so writes keep their order.
+// Calls made from within property handlers are always synchronous.
+int CArduinoCoreTestDeviceHub::SetProperty(const char* name, const char* value) {
+    int ret;
+    if (nested_ == 0) {
+        ret = writes_.error();
+        if (ret != DEVICE_OK) return ret;
+        if (writeBehind_ && writes_.handles(name) && writes_.post(name, value)) {
+            return DEVICE_OK;
+        }
+        ret = FlushWrites();
+        if (ret != DEVICE_OK) return ret;
+    }
+    MMThreadGuard myLock(GetLock());
+    std::string stored;
+    nested_++;
+    ret = SetRemote(name, value, stored);
+    nested_--;
+    if (ret != DEVICE_OK) return CallFailed(ret, std::string("set ") + name);
+    poller_.update(name, stored);
+    StorePushed(name, stored);
+    return ret;
+}
+
+// Reads of a property with a queued write return the queued value, reads
+// of a pushed property the last pushed value, reads of a polled property
+// the polled value while it is fresh enough
+int CArduinoCoreTestDeviceHub::GetProperty(const char* name, char* value) const {
+    HubT* self = const_cast<HubT*>(this);
+    if (nested_ == 0) {
+        int ret = self->writes_.error();
+        if (ret != DEVICE_OK) return ret;
+    }
+    std::string known;
+    if (writes_.pending(name, known) || self->PushedValue(name, known) || self->poller_.cached(name, known)) {
+        CDeviceUtils::CopyLimitedString(value, known.c_str());
+        return DEVICE_OK;
+    }
+    MMThreadGuard myLock(self->GetLock());
+    self->nested_++;
+    int ret = self->GetRemote(name, value);
+    self->nested_--;
+    if (ret != DEVICE_OK) return self->CallFailed(ret, std::string("get ") + name);
+    self->StorePushed(name, value);
+    return ret;
+}
+
+// Called on the write-behind thread
+int CArduinoCoreTestDeviceHub::WritePropertyNow(const std::string& name,
+                                                const std::string& value) {
+    int ret;
+    std::string stored;
+    {
+        MMThreadGuard myLock(GetLock());
+        ret = SetRemote(name.c_str(), value.c_str(), stored);
+    }
+    if (ret != DEVICE_OK) {
+        LogMessage("write-behind " + name + "=" + value + " failed: " + ToString(ret), false);
+    } else {
+        poller_.update(name, stored);
+    }
+    return ret;
+}
+
+// private and expects caller to guard the port.
+// Fixed-point properties skip their decimal property handler, so this checks
+// the property's limits itself. stored: the value the device now holds, the
+// nearest fixed-point step to value, which MMCore is told about.
+int CArduinoCoreTestDeviceHub::SetRemote(const char* name, const char* value,
+                                         std::string& stored) {
+    stored  = value;
+    auto it = fixed_.find(name);
+    if (it == fixed_.end() || !it->second.on) return HubBase<HubT>::SetProperty(name, value);
+
+    char* end;
+    double v = std::strtod(value, &end);
+    double low, high;
+    int32_t raw;
+    if (end == value || !it->second.fixed.raw(v, raw)) return DEVICE_INVALID_PROPERTY_VALUE;
+    bool limited = false;
+    if (HasPropertyLimits(name, limited) == DEVICE_OK && limited &&
+        GetPropertyLowerLimit(name, low) == DEVICE_OK &&
+        GetPropertyUpperLimit(name, high) == DEVICE_OK && (v < low || v > high)) {
+        return DEVICE_INVALID_PROPERTY_VALUE;
+    }
+    int reply = 0;
+    int error = client_.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_FIXED_SET, reply,
+                                                                   it->second.target, raw);
+    if (error) return error;
+    if (reply < 0) return DEVICE_INVALID_PROPERTY_VALUE;
+    stored = FixedText(it->second.fixed, raw);
+    if (stored != value) OnPropertyChanged(name, stored.c_str());
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port
+int CArduinoCoreTestDeviceHub::GetRemote(const char* name, char* value) {
+    auto it = fixed_.find(name);
+    if (it == fixed_.end() || !it->second.on) return HubBase<HubT>::GetProperty(name, value);
+
+    int raw   = ctl::FIXED_INVALID;
+    int error = client_.call_get<rdl::RetT<int>, std::string>(ctl::RPC_FIXED_GET, raw,
+                                                              it->second.target);
+    if (error) return error;
+    if (raw == ctl::FIXED_INVALID) return DEVICE_INVALID_PROPERTY_VALUE;
+    CDeviceUtils::CopyLimitedString(value, FixedText(it->second.fixed, raw).c_str());
+    return DEVICE_OK;
+}
+
+// As many decimals as the scale resolves
+std::string CArduinoCoreTestDeviceHub::FixedText(const ctl::fixed_point& fixed, int32_t raw) {
+    int decimals = std::max(0, static_cast<int>(std::ceil(-std::log10(std::fabs(fixed.scale)))));
+    std::ostringstream text;
+    text << std::fixed << std::setprecision(decimals) << fixed.value(raw);
+    return text.str();
+}
+
+// private and expects caller to guard the port.
+// Firmware without fixed-point channels leaves the property decimal. The
+// property is limited to what the fixed-point format can carry, in either
+// format, so whatever it holds reads back in both.
+int CArduinoCoreTestDeviceHub::AddFixedPoint(const std::string& propName,
+                                             const std::string& target,
+                                             const ctl::fixed_point& fixed) {
+    int raw   = ctl::FIXED_INVALID;
+    int error = client_.call_get<rdl::RetT<int>, std::string>(ctl::RPC_FIXED_GET, raw, target);
+    if (error || raw == ctl::FIXED_INVALID) {
+        LogMessage("no fixed-point wire format for " + propName, true);
+        return DEVICE_OK;
+    }
+    FixedProp prop;
+    prop.target      = target;
+    prop.fixed       = fixed;
+    prop.on          = false;
+    fixed_[propName] = prop;
+    fixedNames_.push_back(propName);
+    SetPropertyLimits(propName.c_str(), fixed.lowest(), fixed.highest());
+
+    CPropertyActionEx* pActEx = new CPropertyActionEx(
+        this, &CArduinoCoreTestDeviceHub::OnWireFormat, static_cast<long>(fixedNames_.size() - 1));
+    std::string name = g_wireFormatPrefix + propName;
+    int ret          = CreateProperty(name.c_str(), g_wireDecimal, MM::String, false, pActEx);
+    if (ret != DEVICE_OK) return ret;
+    AddAllowedValue(name.c_str(), g_wireDecimal);
+    AddAllowedValue(name.c_str(), g_wireFixed);
+    return DEVICE_OK;
+}
+
+// Must not hold the port lock: the write-behind thread needs it
+int CArduinoCoreTestDeviceHub::FlushWrites() {
+    if (!writes_.flush(std::chrono::milliseconds(g_WriteFlushMs))) return DEVICE_SERIAL_TIMEOUT;
+    return writes_.error();
+}
+
+// private and expects caller to guard the port.
+// A failed call may leave the rest of its reply behind, e.g. one that came
+// after the client gave up: drop it, so the next call does not take it for
+// its own reply. @return error
+int CArduinoCoreTestDeviceHub::CallFailed(int error, const std::string& what) {
+    reader_.purge();
+    return LogRpcError(error, what);
+}
+
+// Logs a failed call with the frames that led up to it. Frames already
+// logged with an earlier error are not repeated. @return error
+int CArduinoCoreTestDeviceHub::LogRpcError(int error, const std::string& what) const {
+    std::ostringstream msg;
+    msg << what << " failed (" << error << ")";
+    LogMessage(msg.str(), false);
+    // once per new traffic, whichever thread gets there first
+    uint64_t recorded = trace_.recorded();
+    uint64_t logged   = traceLogged_.load();
+    if (recorded != logged && traceLogged_.compare_exchange_strong(logged, recorded)) {
+        LogMessage("Last transactions:\n" + getLastLog(), false);
+    }
+    return error;
+}
 
 // private and expects caller to:
 // 1. guard the port
@@ -113,19 +330,13 @@ int CArduinoCoreTestDeviceHub::GetControllerVersion(int& version) {
         std::string fname;
         int fver  = 0;
         int error = client_.call_get<rdl::RetT<std::string>>("?fname", fname);
-        if (error) {
-            LogMessage("json-rpc failed: ", error);
-            return error;
-        }
+        if (error) return LogRpcError(error, "?fname");
         bool found = fname == "MM-Ardulingua";
         if (!found) {
             return ERR_FIRMWARE_NOT_FOUND;
         }
         error = client_.call_get<rdl::RetT<int>, std::string>("?fver", fver, fname);
-        if (error) {
-            LogMessage("json-rpc failed: ", error);
-            return error;
-        }
+        if (error) return LogRpcError(error, "?fver");
         version = fver;
         return DEVICE_OK;
     } catch (...) {
@@ -134,6 +345,382 @@ int CArduinoCoreTestDeviceHub::GetControllerVersion(int& version) {
     return ERR_FIRMWARE_NOT_FOUND;
 }
 
+class CArduinoCoreTestDeviceHub::BaudLink : public BaudNegotiator::Link {
+ public:
+    BaudLink(CArduinoCoreTestDeviceHub& hub) : hub_(hub) {}
+
+    int capabilities(int& mask) override {
+        return hub_.client_.call_get<rdl::RetT<int>>(ctl::RPC_BAUD, mask);
+    }
+
+    int request(int index) override {
+        int reply = ctl::BAUD_ERROR_RATE;
+        int error = hub_.client_.call_get<rdl::RetT<int>, int>(ctl::RPC_BAUD_TRY, reply, index);
+        return error ? error : reply;
+    }
+
+    int confirm() override {
+        int reply = ctl::BAUD_ERROR_STATE;
+        int error = hub_.client_.call_get<rdl::RetT<int>>(ctl::RPC_BAUD_CONFIRM, reply);
+        if (error) return error;
+        return reply > 0 ? DEVICE_OK : reply;
+    }
+
+    int reopen(uint32_t rate) override { return hub_.ReopenPort(rate); }
+
+    // the reader is stopped during negotiation, so this is the bare port
+    ctl::StreamT& raw() override { return hub_.reader_; }
+
+ protected:
+    CArduinoCoreTestDeviceHub& hub_;
+};
+
+// private and expects caller to guard the port and the reader to be stopped.
+// Serial ports only take a new rate while closed.
+int CArduinoCoreTestDeviceHub::ReopenPort(uint32_t rate) {
+    MM::Device* pS = GetCoreCallback()->GetDevice(this, port().c_str());
+    if (!pS) return DEVICE_ERR;
+    pS->Shutdown();
+    int ret = GetCoreCallback()->SetDeviceProperty(port().c_str(), MM::g_Keyword_BaudRate,
+                                                   std::to_string(rate).c_str());
+    if (DEVICE_OK != ret) return ret;
+    ret = pS->Initialize();
+    if (DEVICE_OK != ret) return ret;
+    baud_ = rate;
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port and the reader to be stopped.
+// Any failure leaves the link at the connect rate.
+int CArduinoCoreTestDeviceHub::NegotiateBaudRate() {
+    char rate[MM::MaxStrLength];
+    int ret = GetCoreCallback()->GetDeviceProperty(port().c_str(), MM::g_Keyword_BaudRate, rate);
+    if (DEVICE_OK != ret) return ret;
+    baud_ = baudOpen_ = static_cast<uint32_t>(std::strtoul(rate, nullptr, 10));
+    if (maxBaud_ <= static_cast<long>(baud_)) return DEVICE_OK;
+
+    std::ostringstream log;
+    BaudLink link(*this);
+    BaudNegotiator negotiator(link, &log);
+    baud_ = negotiator.negotiate(baud_, static_cast<uint32_t>(maxBaud_));
+    LogMessage(log.str(), true);
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port and the reader to be stopped
+int CArduinoCoreTestDeviceHub::RestoreBaudRate() {
+    if (baud_ == baudOpen_ || ctl::baud_index(baudOpen_) < 0) return DEVICE_OK;
+    BaudLink link(*this);
+    BaudNegotiator negotiator(link);
+    baud_ = negotiator.change(baud_, baudOpen_);
+    return baud_ == baudOpen_ ? DEVICE_OK : DEVICE_ERR;
+}
+
+// private and expects caller to guard the port.
+// From here on requests carry "#<id>" instead of the method name. Firmware
+// without method ids keeps getting names.
+int CArduinoCoreTestDeviceHub::NegotiateMethodIds() {
+    std::string table;
+    ids_.clear();
+    int error = client_.call_get<rdl::RetT<std::string>>(ctl::RPC_METHOD_IDS, table);
+    if (error) {
+        LogMessage("method id negotiation failed, using method names", true);
+        return DEVICE_OK;
+    }
+    std::ostringstream msg;
+    msg << ids_.table(table) << " method ids";
+    LogMessage(msg.str(), true);
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port.
+// Firmware without sequence stores leaves the property on its JSON path.
+int CArduinoCoreTestDeviceHub::AddBulkSequence(const std::string& propName,
+                                               const std::string& target,
+                                               bool integer) {
+    int capacity = 0;
+    int error    = client_.call_get<rdl::RetT<int>, std::string>(ctl::RPC_SEQ_CAPACITY, capacity, target);
+    if (error || capacity <= 0) {
+        LogMessage("no bulk sequence store for " + propName, true);
+        return DEVICE_OK;
+    }
+    // firmware without a player for it leaves start and stop to the property
+    int track = ctl::PLAY_ERROR_TRACK;
+    error     = client_.call_get<rdl::RetT<int>, std::string>(ctl::RPC_PLAY_TRACK, track, target);
+    BulkSequence seq;
+    seq.target        = target;
+    seq.integer       = integer;
+    seq.capacity      = capacity;
+    seq.jsonMaxLength = 0;
+    seq.uploaded      = false;
+    seq.track         = error ? ctl::PLAY_ERROR_TRACK : track;
+    HubBase<HubT>::GetPropertySequenceMaxLength(propName.c_str(), seq.jsonMaxLength);
+    bulk_[propName] = seq;
+    return DEVICE_OK;
+}
+
+// Packs one sequence value little-endian, as int32 or float64.
+// False if the whole string is not a number of that type.
+bool CArduinoCoreTestDeviceHub::PackSequenceValue(const std::string& value, bool integer, uint8_t* raw) {
+    const char* text = value.c_str();
+    char* end        = nullptr;
+    errno            = 0;
+    if (integer) {
+        long v = std::strtol(text, &end, 10);
+        if (end == text || *end != '\0' || errno == ERANGE || v < INT32_MIN || v > INT32_MAX) return false;
+        ctl::pack_le<int32_t>(raw, static_cast<int32_t>(v));
+    } else {
+        double v = std::strtod(text, &end);
+        if (end == text || *end != '\0' || errno == ERANGE) return false;
+        ctl::pack_le<double>(raw, v);
+    }
+    return true;
+}
+
+// private and expects caller to guard the port.
+// Packs the values little-endian, then sends base64 chunks of
+// ctl::SEQ_CHUNK_BYTES. Each chunk reply acknowledges the next offset.
+int CArduinoCoreTestDeviceHub::UploadSequence(const BulkSequence& seq) {
+    const size_t elsize   = seq.integer ? sizeof(int32_t) : sizeof(double);
+    const size_t perchunk = ctl::SEQ_CHUNK_BYTES / elsize;
+    const int count       = static_cast<int>(seq.values.size());
+    int reply             = 0;
+
+    int error = client_.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SEQ_BEGIN, reply, seq.target, count);
+    if (error) return error;
+    if (reply != count) return reply == ctl::SEQ_ERROR_SIZE ? DEVICE_SEQUENCE_TOO_LARGE : ERR_SEQUENCE_UPLOAD;
+
+    uint16_t crc = ctl::CRC16_INIT;
+    uint8_t raw[ctl::SEQ_CHUNK_BYTES];
+    char b64[4 * ctl::SEQ_CHUNK_BYTES / 3 + 1];
+    for (int offset = 0; offset < count;) {
+        size_t n = std::min(perchunk, static_cast<size_t>(count - offset));
+        for (size_t i = 0; i < n; i++) {
+            if (!PackSequenceValue(seq.values[offset + i], seq.integer, raw + i * elsize)) {
+                return DEVICE_INVALID_PROPERTY_VALUE;
+            }
+        }
+        crc       = ctl::crc16(raw, n * elsize, crc);
+        size_t nc = ctl::base64_encode(b64, sizeof(b64), raw, n * elsize);
+        error     = client_.call_get<rdl::RetT<int>, std::string, int, std::string>(
+            ctl::RPC_SEQ_CHUNK, reply, seq.target, offset, std::string(b64, nc));
+        if (error) return error;
+        if (reply == ctl::SEQ_ERROR_FULL) return DEVICE_SEQUENCE_TOO_LARGE;
+        if (reply == ctl::SEQ_ERROR_RANGE) return DEVICE_INVALID_PROPERTY_VALUE;
+        if (reply != offset + static_cast<int>(n)) return ERR_SEQUENCE_UPLOAD;
+        offset = reply;
+    }
+
+    error = client_.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SEQ_END, reply, seq.target, crc);
+    if (error) return error;
+    if (reply == ctl::SEQ_ERROR_FULL) return DEVICE_SEQUENCE_TOO_LARGE;
+    return reply == count ? DEVICE_OK : ERR_SEQUENCE_UPLOAD;
+}
+
+int CArduinoCoreTestDeviceHub::GetPropertySequenceMaxLength(const char* propertyName,
+                                                            long& nrEvents) const {
+    auto it = bulk_.find(propertyName);
+    if (it == bulk_.end()) {
+        return HubBase<HubT>::GetPropertySequenceMaxLength(propertyName, nrEvents);
+    }
+    nrEvents = std::max(it->second.capacity, it->second.jsonMaxLength);
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::ClearPropertySequence(const char* propertyName) {
+    auto it = bulk_.find(propertyName);
+    if (it != bulk_.end()) {
+        it->second.values.clear();
+        it->second.uploaded = false; // the store keeps it, but it is no longer this sequence
+    }
+    return HubBase<HubT>::ClearPropertySequence(propertyName);
+}
+
+int CArduinoCoreTestDeviceHub::AddToPropertySequence(const char* propertyName,
+                                                     const char* value) {
+    auto it = bulk_.find(propertyName);
+    if (it == bulk_.end()) {
+        return HubBase<HubT>::AddToPropertySequence(propertyName, value);
+    }
+    BulkSequence& seq = it->second;
+    if (static_cast<long>(seq.values.size()) >= seq.capacity) {
+        return DEVICE_SEQUENCE_TOO_LARGE;
+    }
+    uint8_t raw[sizeof(double)];
+    if (!PackSequenceValue(value, seq.integer, raw)) return DEVICE_INVALID_PROPERTY_VALUE;
+    seq.values.push_back(value);
+    // keep the property's own sequence while it still fits
+    if (static_cast<long>(seq.values.size()) <= seq.jsonMaxLength) {
+        return HubBase<HubT>::AddToPropertySequence(propertyName, value);
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::SendPropertySequence(const char* propertyName) {
+    auto it = bulk_.find(propertyName);
+    if (it == bulk_.end()) {
+        return HubBase<HubT>::SendPropertySequence(propertyName);
+    }
+    if (static_cast<long>(it->second.values.size()) <= it->second.jsonMaxLength) {
+        it->second.uploaded = false; // short enough for the property's own sequence
+        return HubBase<HubT>::SendPropertySequence(propertyName);
+    }
+    MMThreadGuard myLock(GetLock());
+    it->second.uploaded = false;
+    int ret = UploadSequence(it->second);
+    if (ret != DEVICE_OK) return ret;
+    it->second.uploaded = true;
+    return DEVICE_OK;
+}
+
+// Properties started together share the firmware's timer, each on its own track
+int CArduinoCoreTestDeviceHub::StartPropertySequence(const char* propertyName) {
+    auto it = bulk_.find(propertyName);
+    if (!player_ || it == bulk_.end() || !it->second.uploaded || it->second.track < 0) {
+        return HubBase<HubT>::StartPropertySequence(propertyName);
+    }
+    MMThreadGuard myLock(GetLock());
+    int reply = 0;
+    int error = client_.call_get<rdl::RetT<int>, int, int, int>(
+        ctl::RPC_PLAY_START, reply, static_cast<int>(playPeriodUs_), ctl::PLAY_LOOP, 1 << it->second.track);
+    if (error) return error;
+    return reply == 0 ? DEVICE_OK : ERR_SEQUENCE_PLAYBACK;
+}
+
+int CArduinoCoreTestDeviceHub::StopPropertySequence(const char* propertyName) {
+    auto it = bulk_.find(propertyName);
+    if (!player_ || it == bulk_.end() || !it->second.uploaded || it->second.track < 0) {
+        return HubBase<HubT>::StopPropertySequence(propertyName);
+    }
+    MMThreadGuard myLock(GetLock());
+    int steps = 0;
+    return client_.call_get<rdl::RetT<int>, int>(ctl::RPC_PLAY_STOP, steps, 1 << it->second.track);
+}
+
+// private and expects caller to guard the port.
+// Asks the firmware to push changes of target instead of us polling it.
+// Firmware without notifications leaves the property polled.
+int CArduinoCoreTestDeviceHub::SubscribeChanges(const std::string& target,
+                                                const std::string& propName) {
+    int reply = 0;
+    int error = client_.call_get<rdl::RetT<int>, std::string, int>(
+        ctl::RPC_SUBSCRIBE, reply, target, g_NotifyIntervalMs);
+    if (error || reply < 0) {
+        LogMessage("no change notifications for " + propName, true);
+        return DEVICE_OK;
+    }
+    std::lock_guard<std::mutex> guard(notifyLock_);
+    notifyProps_[target] = propName;
+    pushed_[propName]    = "";
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port
+void CArduinoCoreTestDeviceHub::UnsubscribeChanges() {
+    std::map<std::string, std::string> props;
+    {
+        std::lock_guard<std::mutex> guard(notifyLock_);
+        props.swap(notifyProps_);
+        pushed_.clear();
+    }
+    for (auto& prop : props) {
+        int reply = 0;
+        client_.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SUBSCRIBE, reply, prop.first, -1);
+    }
+}
+
+// True if the firmware pushes changes of the property
+bool CArduinoCoreTestDeviceHub::Pushed(const std::string& propName) {
+    std::lock_guard<std::mutex> guard(notifyLock_);
+    return pushed_.count(propName) > 0;
+}
+
+// The last value of a pushed property, once known
+bool CArduinoCoreTestDeviceHub::PushedValue(const std::string& propName, std::string& value) {
+    std::lock_guard<std::mutex> guard(notifyLock_);
+    auto it = pushed_.find(propName);
+    if (it == pushed_.end() || it->second.empty()) return false;
+    value = it->second;
+    return true;
+}
+
+// Keeps the value of a pushed property, other properties are ignored
+void CArduinoCoreTestDeviceHub::StorePushed(const std::string& propName, const std::string& value) {
+    std::lock_guard<std::mutex> guard(notifyLock_);
+    auto it = pushed_.find(propName);
+    if (it != pushed_.end()) it->second = value;
+}
+
+// Called on the link reader's dispatcher thread
+void CArduinoCoreTestDeviceHub::OnDeviceNotification(const uint8_t* frame, size_t size) {
+    const char* name;
+    const char* value;
+    size_t nameSize, valueSize;
+    if (!ctl::parse_notification(frame, size, name, nameSize, value, valueSize)) return;
+
+    std::string propName;
+    {
+        std::lock_guard<std::mutex> guard(notifyLock_);
+        auto it = notifyProps_.find(std::string(name, nameSize));
+        if (it == notifyProps_.end()) return;
+        propName = it->second;
+    }
+    std::string text(value, valueSize);
+    StorePushed(propName, text);
+    poller_.update(propName, text);
+    OnPropertyChanged(propName.c_str(), text.c_str());
+}
+
+int CArduinoCoreTestDeviceHub::SetChannels(const std::string& group,
+                                           const std::vector<double>& values) {
+    std::vector<uint8_t> packed(values.size() * sizeof(double));
+    for (size_t i = 0; i < values.size(); i++) {
+        ctl::pack_le<double>(packed.data() + i * sizeof(double), values[i]);
+    }
+    std::string data(ctl::base64_encoded_size(packed.size()), '\0');
+    data.resize(ctl::base64_encode(&data[0], data.size(), packed.data(), packed.size()));
+
+    int reply = 0;
+    int error;
+    {
+        MMThreadGuard myLock(GetLock());
+        error = client_.call_get<rdl::RetT<int>, std::string, std::string>(ctl::RPC_CHANNELS_SET,
+                                                                           reply, group, data);
+    }
+    if (error) return error;
+    if (reply != static_cast<int>(values.size())) return DEVICE_INVALID_PROPERTY_VALUE;
+
+    if (group == g_barGroup) {
+        const char* props[] = {g_barAProp, g_barBProp};
+        for (size_t i = 0; i < values.size() && i < 2; i++) {
+            std::string text = ToString(values[i]);
+            poller_.update(props[i], text);
+            StorePushed(props[i], text);
+            OnPropertyChanged(props[i], text.c_str());
+        }
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::GetChannels(const std::string& group, std::vector<double>& values) {
+    std::string data;
+    int error;
+    {
+        MMThreadGuard myLock(GetLock());
+        error = client_.call_get<rdl::RetT<std::string>, std::string>(ctl::RPC_CHANNELS_GET, data, group);
+    }
+    if (error) return error;
+    std::vector<uint8_t> packed(data.size());
+    int n = ctl::base64_decode(packed.data(), packed.size(), data.c_str(), data.size());
+    if (n <= 0 || n % sizeof(double) != 0) return DEVICE_INVALID_PROPERTY_VALUE;
+
+    values.resize(n / sizeof(double));
+    for (size_t i = 0; i < values.size(); i++) {
+        values[i] = ctl::unpack_le<double>(packed.data() + i * sizeof(double));
+    }
+    return DEVICE_OK;
+}
+
 bool CArduinoCoreTestDeviceHub::SupportsDeviceDetection(void) {
     return true;
 }
@@ -163,7 +750,8 @@ MM::DeviceDetectionStatus CArduinoCoreTestDeviceHub::DetectDevice(void) {
             GetCoreCallback()->SetDeviceProperty(port().c_str(),
                                                  MM::g_Keyword_Handshaking, g_Off);
             GetCoreCallback()->SetDeviceProperty(port().c_str(),
-                                                 MM::g_Keyword_BaudRate, "57600");
+                                                 MM::g_Keyword_BaudRate,
+                                                 std::to_string(ctl::BAUD_DEFAULT).c_str());
             GetCoreCallback()->SetDeviceProperty(port().c_str(),
                                                  MM::g_Keyword_StopBits, "1");
             // ArduinoCoreTestDevice timed out in GetControllerVersion even if
@@ -178,7 +766,7 @@ MM::DeviceDetectionStatus CArduinoCoreTestDeviceHub::DetectDevice(void) {
             // ArduinoCoreTestDevice is waiting for firmwareupgrades.  Simply sleep 2
             // seconds.
             CDeviceUtils::SleepMs(2000);
-            MMThreadGuard myLock(lock_);
+            MMThreadGuard myLock(GetLock());
             PurgeComPort(port().c_str());
             int v   = 0;
             int ret = GetControllerVersion(v);
@@ -208,12 +796,7 @@ int CArduinoCoreTestDeviceHub::Initialize() {
         ASSERT_OK(CreateProperty(MM::g_Keyword_Name, g_deviceNameHub, MM::String, true));
 
     } catch (DeviceResultException deviceError) {
-        LogMessage(deviceError.format(this));
-        //std::string lastTrans = getLastLog();
-        //if (!lastTrans.empty()) {
-        //    LogMessage(std::string("Last Transaction: ") + lastTrans);
-        //}
-        return deviceError.error;
+        return LogRpcError(deviceError.error, deviceError.format(this));
     }
     //int ret =
     //    CreateProperty(MM::g_Keyword_Name, g_DeviceNameArduinoCoreTestDeviceHub,
@@ -225,7 +808,9 @@ int CArduinoCoreTestDeviceHub::Initialize() {
     // second.
     CDeviceUtils::SleepMs(2000);
 
-    MMThreadGuard myLock(lock_);
+    // the port is fixed from here on: look its lock up once
+    portLock_ = &PortLock::get(port());
+    MMThreadGuard myLock(GetLock());
 
     // Check that we have a controller:
     PurgeComPort(port().c_str());
@@ -235,13 +820,44 @@ int CArduinoCoreTestDeviceHub::Initialize() {
     if (version_ < g_MinFirmwareVersion || version_ > g_MaxFirmwareVersion)
         return ERR_VERSION_MISMATCH;
 
-    ret = foo_.create(this, &client_, g_infoFoo);
+    // reopens the port, so before the reader thread is reading it
+    ret = NegotiateBaudRate();
     if (DEVICE_OK != ret) return ret;
 
-    ret = barA_.create(this, &client_, g_infoBarA, 0);
+    // From here on a background thread drains the port
+    PurgeComPort(port().c_str());
+    reader_.start();
+
+    ret = NegotiateMethodIds();
     if (DEVICE_OK != ret) return ret;
 
-    ret = barB_.create(this, &client_, g_infoBarB, 1);
+    // first, so properties the firmware pushes are created non-volatile
+    ret = SubscribeChanges("foo", g_fooProp);
+    if (DEVICE_OK != ret) return ret;
+    ret = SubscribeChanges("bar0", g_barAProp);
+    if (DEVICE_OK != ret) return ret;
+    ret = SubscribeChanges("bar1", g_barBProp);
+    if (DEVICE_OK != ret) return ret;
+
+    ret = foo_.create(this, &client_, Pushed(g_fooProp) ? g_infoFooPushed : g_infoFoo);
+    if (DEVICE_OK != ret) return ret;
+
+    ret = barA_.create(this, &client_, Pushed(g_barAProp) ? g_infoBarAPushed : g_infoBarA, 0);
+    if (DEVICE_OK != ret) return ret;
+
+    ret = barB_.create(this, &client_, Pushed(g_barBProp) ? g_infoBarBPushed : g_infoBarB, 1);
+    if (DEVICE_OK != ret) return ret;
+
+    ret = AddBulkSequence(foo_.name(), "foo", true);
+    if (DEVICE_OK != ret) return ret;
+    ret = AddBulkSequence(barA_.name(), "bar0", false);
+    if (DEVICE_OK != ret) return ret;
+    ret = AddBulkSequence(barB_.name(), "bar1", false);
+    if (DEVICE_OK != ret) return ret;
+
+    ret = AddFixedPoint(barA_.name(), "bar0", g_fixedBar);
+    if (DEVICE_OK != ret) return ret;
+    ret = AddFixedPoint(barB_.name(), "bar1", g_fixedBar);
     if (DEVICE_OK != ret) return ret;
 
     CPropertyAction* pAct =
@@ -255,12 +871,41 @@ int CArduinoCoreTestDeviceHub::Initialize() {
     CreateProperty(g_KeywordTest, g_TestResultsUnknown, MM::String, false, pAct,
                    true);
 
+    std::vector<double> bars;
+    if (GetChannels(g_barGroup, bars) == DEVICE_OK) {
+        pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnBarAll);
+        CreateProperty(g_barAllProp, "", MM::String, false, pAct);
+    }
+
+    pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnBenchmark);
+    CreateProperty(g_KeywordBenchmark, g_TestResultsUnknown, MM::String, false, pAct);
+
+    ret = CreateRpcStatsProperties();
+    if (ret != DEVICE_OK) return ret;
+
+    pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnTrace);
+    CreateProperty(g_traceProp, "", MM::String, true, pAct);
+
+    ret = CreateWriteBehindProperties();
+    if (ret != DEVICE_OK) return ret;
+
+    ret = CreatePollerProperties();
+    if (ret != DEVICE_OK) return ret;
+
+    ret = CreatePlaybackProperties();
+    if (ret != DEVICE_OK) return ret;
+
+    ret = CreateTelemetryProperties();
+    if (ret != DEVICE_OK) return ret;
+
     ret = UpdateStatus();
     if (ret != DEVICE_OK) return ret;
 
     // turn off verbose serial debug messages
     // GetCoreCallback()->SetDeviceProperty(port_.c_str(), "Verbose", "0");
 
+    writes_.start();
+    poller_.start();
     initialized_ = true;
     return DEVICE_OK;
 }
@@ -288,7 +933,22 @@ int CArduinoCoreTestDeviceHub::DetectInstalledDevices() {
 }
 
 int CArduinoCoreTestDeviceHub::Shutdown() {
+    // sends whatever is still queued, before we take the port
+    writes_.stop();
+    poller_.stop();
+    {
+        MMThreadGuard myLock(GetLock());
+        if (initialized_) {
+            UnsubscribeChanges();
+            ids_.clear();
+        }
+        // also after a failed Initialize; and before the rate changes back
+        reader_.stop();
+        // the next session connects at the rate this one opened with
+        if (initialized_) RestoreBaudRate();
+    }
     initialized_ = false;
+    portLock_    = nullptr;
     return DEVICE_OK;
 }
 
@@ -311,6 +971,441 @@ int CArduinoCoreTestDeviceHub::OnVersion(MM::PropertyBase* pProp,
     return DEVICE_OK;
 }
 
+int CArduinoCoreTestDeviceHub::OnMaxBaudRate(MM::PropertyBase* pProp,
+                                             MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        // after initialization, report the rate actually in use
+        if (initialized_) {
+            pProp->Set(std::to_string(baud_).c_str());
+        } else {
+            pProp->Set(maxBaud_ ? std::to_string(maxBaud_).c_str() : g_Off);
+        }
+    } else if (pAct == MM::AfterSet) {
+        if (initialized_) {
+            return DEVICE_CAN_NOT_SET_PROPERTY;
+        }
+        std::string rate;
+        pProp->Get(rate);
+        maxBaud_ = (rate == g_Off) ? 0 : std::atol(rate.c_str());
+    }
+    return DEVICE_OK;
+}
+
+// All bar channels as comma separated values
+int CArduinoCoreTestDeviceHub::OnBarAll(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        std::vector<double> values;
+        int ret = GetChannels(g_barGroup, values);
+        if (ret != DEVICE_OK) return ret;
+        std::ostringstream text;
+        text.precision(17);
+        for (size_t i = 0; i < values.size(); i++) text << (i ? "," : "") << values[i];
+        pProp->Set(text.str().c_str());
+    } else if (pAct == MM::AfterSet) {
+        std::string text;
+        pProp->Get(text);
+        std::vector<double> values;
+        std::istringstream in(text);
+        std::string item;
+        while (std::getline(in, item, ',')) values.push_back(std::atof(item.c_str()));
+        return SetChannels(g_barGroup, values);
+    }
+    return DEVICE_OK;
+}
+
+// WriteBehind switch, and a coalescing window and an elided write counter
+// for each remote property
+int CArduinoCoreTestDeviceHub::CreateWriteBehindProperties() {
+    writes_.add(foo_.name());
+    writes_.add(barA_.name());
+    writes_.add(barB_.name());
+
+    CPropertyAction* pAct =
+        new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnWriteBehind);
+    int ret = CreateProperty(g_writeBehindProp, writeBehind_ ? g_On : g_Off, MM::String, false, pAct);
+    if (ret != DEVICE_OK) return ret;
+    AddAllowedValue(g_writeBehindProp, g_Off);
+    AddAllowedValue(g_writeBehindProp, g_On);
+
+    std::vector<std::string> props = writes_.names();
+    for (size_t i = 0; i < props.size(); i++) {
+        CPropertyActionEx* pActEx = new CPropertyActionEx(
+            this, &CArduinoCoreTestDeviceHub::OnWriteWindow, static_cast<long>(i));
+        std::string name = g_writeWindowPrefix + props[i];
+        ret              = CreateProperty(name.c_str(), "0", MM::Integer, false, pActEx);
+        if (ret != DEVICE_OK) return ret;
+        SetPropertyLimits(name.c_str(), 0, 1000);
+
+        pActEx = new CPropertyActionEx(this, &CArduinoCoreTestDeviceHub::OnWritesElided,
+                                       static_cast<long>(i));
+        name = g_writeElidedPrefix + props[i];
+        ret  = CreateProperty(name.c_str(), "0", MM::Integer, true, pActEx);
+        if (ret != DEVICE_OK) return ret;
+    }
+    return DEVICE_OK;
+}
+
+// Called on the poller thread. One RPC for all polled properties.
+int CArduinoCoreTestDeviceHub::FetchValues(const std::vector<std::string>& targets,
+                                           std::vector<std::string>& values) {
+    std::string names, text;
+    for (size_t i = 0; i < targets.size(); i++) {
+        names += (i ? std::string(1, ctl::VALUES_SEPARATOR) : std::string()) + targets[i];
+    }
+    int error;
+    {
+        MMThreadGuard myLock(GetLock());
+        error = client_.call_get<rdl::RetT<std::string>, std::string>(ctl::RPC_VALUES, text, names);
+    }
+    if (error) return error;
+
+    values.clear();
+    std::istringstream in(text);
+    std::string item;
+    while (std::getline(in, item, ctl::VALUES_SEPARATOR)) {
+        if (item.empty() || item[0] == ctl::VALUES_UNKNOWN) return DEVICE_INVALID_PROPERTY_VALUE;
+        values.push_back(item);
+    }
+    return values.size() == targets.size() ? DEVICE_OK : DEVICE_INVALID_PROPERTY_VALUE;
+}
+
+// Poll rate, and a maximum age and the staleness served for each remote property
+int CArduinoCoreTestDeviceHub::CreatePollerProperties() {
+    poller_.add(foo_.name(), "foo");
+    poller_.add(barA_.name(), "bar0");
+    poller_.add(barB_.name(), "bar1");
+
+    CPropertyAction* pAct =
+        new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnPollInterval);
+    int ret = CreateProperty(g_pollIntervalProp, "0", MM::Integer, false, pAct);
+    if (ret != DEVICE_OK) return ret;
+    SetPropertyLimits(g_pollIntervalProp, 0, 10000);
+
+    std::vector<std::string> props = poller_.names();
+    for (size_t i = 0; i < props.size(); i++) {
+        CPropertyActionEx* pActEx = new CPropertyActionEx(
+            this, &CArduinoCoreTestDeviceHub::OnPollMaxAge, static_cast<long>(i));
+        std::string name = g_pollMaxAgePrefix + props[i];
+        ret              = CreateProperty(name.c_str(), "0", MM::Integer, false, pActEx);
+        if (ret != DEVICE_OK) return ret;
+        SetPropertyLimits(name.c_str(), 0, 10000);
+
+        pActEx = new CPropertyActionEx(this, &CArduinoCoreTestDeviceHub::OnPollStaleness,
+                                       static_cast<long>(i));
+        name = g_pollStalenessPrefix + props[i];
+        ret  = CreateProperty(name.c_str(), "0", MM::Float, true, pActEx);
+        if (ret != DEVICE_OK) return ret;
+    }
+    return DEVICE_OK;
+}
+
+// 0: no polling, every read goes to the device
+int CArduinoCoreTestDeviceHub::OnPollInterval(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(static_cast<long>(poller_.interval().count()));
+    } else if (pAct == MM::AfterSet) {
+        long ms;
+        pProp->Get(ms);
+        poller_.interval(std::chrono::milliseconds(ms));
+    }
+    return DEVICE_OK;
+}
+
+// 0: the property is not polled
+int CArduinoCoreTestDeviceHub::OnPollMaxAge(MM::PropertyBase* pProp, MM::ActionType pAct,
+                                            long prop) {
+    std::string name = poller_.names()[prop];
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(static_cast<long>(poller_.maxAge(name).count()));
+    } else if (pAct == MM::AfterSet) {
+        long ms;
+        pProp->Get(ms);
+        poller_.maxAge(name, std::chrono::milliseconds(ms));
+    }
+    return DEVICE_OK;
+}
+
+// Age in ms of the oldest polled value served since the maximum age was set
+int CArduinoCoreTestDeviceHub::OnPollStaleness(MM::PropertyBase* pProp, MM::ActionType pAct,
+                                               long prop) {
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(poller_.staleness(poller_.names()[prop]).count() / 1000.0);
+    }
+    return DEVICE_OK;
+}
+
+// Decimal or FixedPoint encoding of one property's values on the wire.
+// Both set and read the same firmware property, so a switch only changes
+// the RPCs that carry the value.
+int CArduinoCoreTestDeviceHub::OnWireFormat(MM::PropertyBase* pProp, MM::ActionType pAct,
+                                            long prop) {
+    FixedProp& fixed = fixed_[fixedNames_[prop]];
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(fixed.on ? g_wireFixed : g_wireDecimal);
+    } else if (pAct == MM::AfterSet) {
+        std::string val;
+        pProp->Get(val);
+        MMThreadGuard myLock(GetLock());
+        fixed.on = (val == g_wireFixed);
+    }
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port.
+// Firmware without a sequence player leaves sequences to the properties.
+int CArduinoCoreTestDeviceHub::CreatePlaybackProperties() {
+    std::string status;
+    int error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_PLAY_STATUS, status, 0);
+    if (error || status.empty()) {
+        LogMessage("no sequence player in the firmware", true);
+        return DEVICE_OK;
+    }
+    player_ = true;
+
+    CPropertyAction* pAct =
+        new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnSequenceInterval);
+    int ret = CreateProperty(g_seqIntervalProp, "0", MM::Integer, false, pAct);
+    if (ret != DEVICE_OK) return ret;
+    SetPropertyLimits(g_seqIntervalProp, 0, 1000000);
+
+    pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnSequenceStatus);
+    return CreateProperty(g_seqStatusProp, status.c_str(), MM::String, true, pAct);
+}
+
+// Timer period of uploaded sequences, 0: one step per trigger edge.
+// Takes effect at the next StartPropertySequence.
+int CArduinoCoreTestDeviceHub::OnSequenceInterval(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(playPeriodUs_);
+    } else if (pAct == MM::AfterSet) {
+        long us;
+        pProp->Get(us);
+        if (us != 0 && us < ctl::PLAY_MIN_PERIOD_US) return DEVICE_INVALID_PROPERTY_VALUE;
+        playPeriodUs_ = us;
+    }
+    return DEVICE_OK;
+}
+
+// "running steps underruns missed p99_jitter_us max_jitter_us" from the firmware
+int CArduinoCoreTestDeviceHub::OnSequenceStatus(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        MMThreadGuard myLock(GetLock());
+        std::string status;
+        int error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_PLAY_STATUS, status, 0);
+        if (error) return error;
+        pProp->Set(status.c_str());
+    }
+    return DEVICE_OK;
+}
+
+// private and expects caller to guard the port.
+// Firmware without telemetry gets no Firmware* properties.
+int CArduinoCoreTestDeviceHub::CreateTelemetryProperties() {
+    std::string stats;
+    int error = FetchFirmwareStats(stats);
+    if (error || stats.empty()) {
+        LogMessage("no telemetry in the firmware", true);
+        return DEVICE_OK;
+    }
+
+    CPropertyAction* pAct =
+        new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnFirmwareStats);
+    int ret = CreateProperty(g_fwStatsProp, stats.c_str(), MM::String, true, pAct);
+    if (ret != DEVICE_OK) return ret;
+
+    for (size_t i = 0; i < sizeof(g_fwStatFields) / sizeof(g_fwStatFields[0]); i++) {
+        CPropertyActionEx* pActEx = new CPropertyActionEx(
+            this, &CArduinoCoreTestDeviceHub::OnFirmwareStat, static_cast<long>(i));
+        ret = CreateProperty(g_fwStatFields[i].prop, "0", MM::Integer, true, pActEx);
+        if (ret != DEVICE_OK) return ret;
+    }
+
+    pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnFirmwareMethodStats);
+    ret = CreateProperty(g_fwMethodStatsProp, "", MM::String, true, pAct);
+    if (ret != DEVICE_OK) return ret;
+
+    // firmware without the task scheduler gets no FirmwareTasks
+    std::string tasks;
+    error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_TASKS, tasks, 0);
+    if (error || tasks.empty()) return DEVICE_OK;
+    pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnFirmwareTasks);
+    return CreateProperty(g_fwTasksProp, tasks.c_str(), MM::String, true, pAct);
+}
+
+// private and expects caller to guard the port.
+// Reads RPC_STATS at most once per g_StatsMaxAgeMs, so refreshing every
+// Firmware* property costs one round trip.
+int CArduinoCoreTestDeviceHub::FetchFirmwareStats(std::string& stats) {
+    using namespace std::chrono;
+    auto now = steady_clock::now();
+    if (!fwStats_.empty() && now - fwStatsAt_ < milliseconds(g_StatsMaxAgeMs)) {
+        stats = fwStats_;
+        return DEVICE_OK;
+    }
+    int error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_STATS, stats, 0);
+    if (error) return error;
+    fwStats_   = stats;
+    fwStatsAt_ = now;
+    return DEVICE_OK;
+}
+
+// The RPC_STATS reply as is, see Telemetry.h
+int CArduinoCoreTestDeviceHub::OnFirmwareStats(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        MMThreadGuard myLock(GetLock());
+        std::string stats;
+        int error = FetchFirmwareStats(stats);
+        if (error) return error;
+        pProp->Set(stats.c_str());
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::OnFirmwareStat(MM::PropertyBase* pProp, MM::ActionType pAct,
+                                              long field) {
+    if (pAct == MM::BeforeGet) {
+        std::string stats;
+        {
+            MMThreadGuard myLock(GetLock());
+            int error = FetchFirmwareStats(stats);
+            if (error) return error;
+        }
+        json::StaticJsonDocument<ctl::STATS_TEXT_SIZE * 2> doc;
+        if (DESERIALIZER(doc, stats)) return DEVICE_SERIAL_INVALID_RESPONSE;
+        const FirmwareStatField& f = g_fwStatFields[field];
+        json::JsonVariant value = f.element < 0 ? doc[f.key] : doc[f.key][f.element];
+        pProp->Set(value.as<long>());
+    }
+    return DEVICE_OK;
+}
+
+// "name count mean_us max_us;..." per firmware method since it started
+int CArduinoCoreTestDeviceHub::OnFirmwareMethodStats(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        MMThreadGuard myLock(GetLock());
+        std::string stats;
+        int error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_METHOD_STATS, stats, 0);
+        if (error) return error;
+        pProp->Set(stats.c_str());
+    }
+    return DEVICE_OK;
+}
+
+// "name runs mean_us max_us late_us overruns skipped;..." per firmware loop() task
+int CArduinoCoreTestDeviceHub::OnFirmwareTasks(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        MMThreadGuard myLock(GetLock());
+        std::string tasks;
+        int error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_TASKS, tasks, 0);
+        if (error) return error;
+        pProp->Set(tasks.c_str());
+    }
+    return DEVICE_OK;
+}
+
+// Off -> On: later outside writes to the remote properties are queued.
+// On -> Off: SetProperty has already flushed the queue.
+int CArduinoCoreTestDeviceHub::OnWriteBehind(MM::PropertyBase* pProp, MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(writeBehind_ ? g_On : g_Off);
+    } else if (pAct == MM::AfterSet) {
+        std::string val;
+        pProp->Get(val);
+        writeBehind_ = (val == g_On);
+    }
+    return DEVICE_OK;
+}
+
+// Only applies while WriteBehind is On
+int CArduinoCoreTestDeviceHub::OnWriteWindow(MM::PropertyBase* pProp, MM::ActionType pAct,
+                                             long prop) {
+    std::string name = writes_.names()[prop];
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(static_cast<long>(writes_.window(name).count()));
+    } else if (pAct == MM::AfterSet) {
+        long ms;
+        pProp->Get(ms);
+        if (!writes_.window(name, std::chrono::milliseconds(ms))) return DEVICE_INVALID_PROPERTY;
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::OnWritesElided(MM::PropertyBase* pProp, MM::ActionType pAct,
+                                              long prop) {
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(static_cast<long>(writes_.elided(writes_.names()[prop])));
+    }
+    return DEVICE_OK;
+}
+
+// Latency properties for every method called so far (the version handshake
+// and property creation exercise most of them). Methods first called later
+// still show up in the RpcStats dump.
+int CArduinoCoreTestDeviceHub::CreateRpcStatsProperties() {
+    CPropertyAction* pAct =
+        new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnRpcStats);
+    int ret = CreateProperty(g_rpcStatsProp, "{}", MM::String, true, pAct);
+    if (ret != DEVICE_OK) return ret;
+
+    pAct = new CPropertyAction(this, &CArduinoCoreTestDeviceHub::OnRpcStatsReset);
+    ret  = CreateProperty(g_rpcResetProp, "Idle", MM::String, false, pAct);
+    if (ret != DEVICE_OK) return ret;
+    AddAllowedValue(g_rpcResetProp, "Idle");
+    AddAllowedValue(g_rpcResetProp, "Reset");
+
+    std::vector<std::string> methods = monitor_.methods();
+    for (size_t i = 0; i < methods.size(); i++) {
+        CPropertyActionEx* pActEx = new CPropertyActionEx(
+            this, &CArduinoCoreTestDeviceHub::OnRpcMethodStats, static_cast<long>(i));
+        std::string name = g_rpcLatencyPrefix + methods[i];
+        ret              = CreateProperty(name.c_str(), "", MM::String, true, pActEx);
+        if (ret != DEVICE_OK) return ret;
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::OnRpcStats(MM::PropertyBase* pProp,
+                                          MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        std::ostringstream dump;
+        monitor_.dump(dump);
+        pProp->Set(dump.str().c_str());
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::OnRpcStatsReset(MM::PropertyBase* pProp,
+                                               MM::ActionType pAct) {
+    if (pAct == MM::AfterSet) {
+        std::string val;
+        pProp->Get(val);
+        if (val == "Reset") monitor_.reset();
+        pProp->Set("Idle");
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::OnRpcMethodStats(MM::PropertyBase* pProp,
+                                                MM::ActionType pAct, long method) {
+    if (pAct == MM::BeforeGet) {
+        RpcMonitor::MethodStats stats;
+        if (monitor_.stats(static_cast<size_t>(method), stats)) {
+            std::ostringstream summary;
+            RpcMonitor::summary(summary, stats);
+            pProp->Set(summary.str().c_str());
+        }
+    }
+    return DEVICE_OK;
+}
+
+int CArduinoCoreTestDeviceHub::OnTrace(MM::PropertyBase* pProp,
+                                       MM::ActionType pAct) {
+    if (pAct == MM::BeforeGet) {
+        pProp->Set(trace_.dump().c_str());
+    }
+    return DEVICE_OK;
+}
+
 int CArduinoCoreTestDeviceHub::OnTest(MM::PropertyBase* pProp,
                                       MM::ActionType pAct) {
     using namespace std;
@@ -372,8 +1467,20 @@ int CArduinoCoreTestDeviceHub::OnTest(MM::PropertyBase* pProp,
             StartPropertySequence(barA_.name().c_str());
             StopPropertySequence(barA_.name().c_str());
 
+            // long sequence through the chunked upload
+            ClearPropertySequence(foo_.name().c_str());
+            for (long seq = 0; seq < 1000; seq++) {
+                AddToPropertySequence(foo_.name().c_str(), ToString(seq % 100).c_str());
+            }
+            ret = SendPropertySequence(foo_.name().c_str());
+            if (ret != DEVICE_OK) {
+                char text[MM::MaxStrLength];
+                GetErrorText(ret, text);
+                cout << "Bulk sequence upload error " << ret << ": " << text << endl;
+            }
+
             cout << "=== TESTING DONE ===" << endl;
-            testPassed = true;
+            testPassed = (ret == DEVICE_OK);
         }
 
         pProp->Set(testPassed ? g_TestResultsPassed : g_TestResultsFailed);
@@ -386,3 +1493,171 @@ int CArduinoCoreTestDeviceHub::OnTest(MM::PropertyBase* pProp,
     }
     return DEVICE_OK;
 }
+
+int CArduinoCoreTestDeviceHub::OnBenchmark(MM::PropertyBase* pProp,
+                                           MM::ActionType pAct) {
+    using namespace std;
+    if (pAct == MM::AfterSet) {
+        string val;
+        pProp->Get(val);
+        if (val != g_TestResultsRun) return DEVICE_OK;
+
+        ostringstream results;
+        cout << "=== BENCHMARK ===" << endl;
+        BenchmarkSequenceUpload(results);
+        BenchmarkRpcMonitor(results);
+        BenchmarkChannels(results);
+        BenchmarkFixedPoint(results);
+        cout << results.str() << "=== BENCHMARK DONE ===" << endl;
+        LogMessage(results.str(), false);
+        pProp->Set(g_TestResultsPassed);
+    }
+    return DEVICE_OK;
+}
+
+// Chunked upload time of a 1000 element integer sequence
+void CArduinoCoreTestDeviceHub::BenchmarkSequenceUpload(std::ostream& out) {
+    using namespace std::chrono;
+    auto it = bulk_.find(foo_.name());
+    if (it == bulk_.end()) {
+        out << "Sequence upload: no bulk store in firmware" << std::endl;
+        return;
+    }
+    BulkSequence seq = it->second;
+    seq.values.clear();
+    for (long i = 0; i < 1000 && i < seq.capacity; i++) {
+        seq.values.push_back(ToString(i));
+    }
+
+    MMThreadGuard myLock(GetLock());
+    link_.reset_stats();
+    auto start = steady_clock::now();
+    int ret    = UploadSequence(seq);
+    double ms  = duration<double, std::milli>(steady_clock::now() - start).count();
+    double per = 1000.0 / seq.values.size();
+    out << "Sequence upload (" << seq.values.size() << " elements): "
+        << (ret == DEVICE_OK ? "" : "FAILED, ")
+        << ms * per << " ms/1000 elements, "
+        << (link_.wire_tx_bytes() + link_.wire_rx_bytes()) * per << " wire bytes/1000 elements"
+        << std::endl;
+
+    // "steps used_bytes buffer_bytes reads decoded typical", firmware with a compressed store
+    std::string memory;
+    if (ret == DEVICE_OK &&
+        !client_.call_get<rdl::RetT<std::string>, std::string>(ctl::RPC_SEQ_MEMORY, memory, seq.target) &&
+        !memory.empty()) {
+        out << "Sequence store (steps used_bytes buffer_bytes reads decoded typical): " << memory << std::endl;
+    }
+}
+
+// Cost of recording one call in the latency histograms and the trace
+void CArduinoCoreTestDeviceHub::BenchmarkRpcMonitor(std::ostream& out) {
+    using namespace std::chrono;
+    const uint32_t nrecords = 1000000;
+    RpcMonitor probe(link_);
+    size_t method = probe.method("bench");
+    auto start    = steady_clock::now();
+    for (uint32_t i = 0; i < nrecords; i++) {
+        probe.record(method, i);
+    }
+    double ns = duration<double, std::nano>(steady_clock::now() - start).count();
+    out << "RPC latency recording: " << ns / nrecords << " ns/call" << std::endl;
+
+    LinkTrace trace;
+    const uint8_t frame[] = "{\"m\":\"?foo\",\"p\":[],\"i\":1}";
+    start = steady_clock::now();
+    for (uint32_t i = 0; i < nrecords; i++) {
+        trace.record(LinkTrace::SENT, frame, sizeof(frame) - 1);
+    }
+    ns = duration<double, std::nano>(steady_clock::now() - start).count();
+    out << "Transaction trace: " << ns / nrecords << " ns/frame" << std::endl;
+}
+
+// Four channel update: one RPC per channel against one all-channel RPC.
+// The hub only maps two channels, so the per-channel case alternates them.
+void CArduinoCoreTestDeviceHub::BenchmarkChannels(std::ostream& out) {
+    using namespace std::chrono;
+    const int nupdates = 100;
+    std::vector<double> values(4);
+    if (GetChannels(g_barGroup, values) != DEVICE_OK || values.size() != 4) {
+        out << "Channel group update: not supported by firmware" << std::endl;
+        return;
+    }
+
+    link_.reset_stats();
+    auto start = steady_clock::now();
+    for (int i = 0; i < nupdates; i++) {
+        for (int ch = 0; ch < 4; ch++) {
+            auto& prop = (ch % 2) ? barB_ : barA_;
+            SetProperty(prop.name().c_str(), ToString(i + 0.25 * ch).c_str());
+        }
+    }
+    double single = duration<double, std::micro>(steady_clock::now() - start).count() / nupdates;
+    double singleBytes = (link_.wire_tx_bytes() + link_.wire_rx_bytes()) / double(nupdates);
+
+    link_.reset_stats();
+    int ret = DEVICE_OK;
+    start   = steady_clock::now();
+    for (int i = 0; i < nupdates && ret == DEVICE_OK; i++) {
+        for (int ch = 0; ch < 4; ch++) values[ch] = i + 0.25 * ch;
+        ret = SetChannels(g_barGroup, values);
+    }
+    double group = duration<double, std::micro>(steady_clock::now() - start).count() / nupdates;
+    double groupBytes = (link_.wire_tx_bytes() + link_.wire_rx_bytes()) / double(nupdates);
+
+    out << "4-channel update: "
+        << single << " us, " << singleBytes << " wire bytes as 4 RPCs; "
+        << (ret == DEVICE_OK ? "" : "FAILED, ") << group << " us, " << groupBytes
+        << " wire bytes as 1 RPC" << std::endl;
+}
+
+// Device-side dispatch time and wire bytes of barA set/get pairs, decimal
+// against fixed-point. Both set and read the firmware's bar0 property.
+void CArduinoCoreTestDeviceHub::BenchmarkFixedPoint(std::ostream& out) {
+    const int ncalls = 100;
+    auto it          = fixed_.find(barA_.name());
+    std::string stats;
+    int error;
+    {
+        MMThreadGuard myLock(GetLock());
+        error = client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_DISPATCH_TIME, stats, 1);
+    }
+    if (it == fixed_.end() || error) {
+        out << "Fixed-point barA: not supported by firmware" << std::endl;
+        return;
+    }
+    std::string format = g_wireFormatPrefix + barA_.name();
+    bool restore       = it->second.on;
+
+    out << "barA wire format (" << 2 * ncalls << " calls each):" << std::endl;
+    for (bool fixed : {false, true}) {
+        SetProperty(format.c_str(), fixed ? g_wireFixed : g_wireDecimal);
+        {
+            MMThreadGuard myLock(GetLock());
+            client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_DISPATCH_TIME, stats, 1);
+        }
+        link_.reset_stats();
+        int failures = 0;
+        for (int i = 0; i < ncalls; i++) {
+            char value[MM::MaxStrLength];
+            std::string set = ToString(10.0 * (i / (ncalls - 1.0)) + 0.123456);
+            if (SetProperty(barA_.name().c_str(), set.c_str()) != DEVICE_OK ||
+                GetProperty(barA_.name().c_str(), value) != DEVICE_OK ||
+                std::fabs(std::atof(value) - std::atof(set.c_str())) > it->second.fixed.scale) {
+                failures++;
+            }
+        }
+        double bytes = (link_.wire_tx_bytes() + link_.wire_rx_bytes()) / (2.0 * ncalls);
+        // count p50 p99 max; the passes include the reset call above
+        {
+            MMThreadGuard myLock(GetLock());
+            client_.call_get<rdl::RetT<std::string>, int>(ctl::RPC_DISPATCH_TIME, stats, 1);
+        }
+        unsigned long count = 0, p50 = 0, p99 = 0, max = 0;
+        std::istringstream(stats) >> count >> p50 >> p99 >> max;
+        out << "  " << (fixed ? g_wireFixed : g_wireDecimal) << ": device dispatch p50 " << p50
+            << " us, p99 " << p99 << " us, max " << max << " us over " << count << " passes, "
+            << bytes << " wire bytes/call" << (failures ? ", VALUE MISMATCH" : "") << std::endl;
+    }
+    SetProperty(format.c_str(), restore ? g_wireFixed : g_wireDecimal);
+}
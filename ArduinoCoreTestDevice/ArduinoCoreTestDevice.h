@@ -18,7 +18,24 @@
 
 #define NOMINMAX
 //#include <map>
+#include "BaudNegotiator.h"
 #include "DeviceBase.h"
+#include "LinkReader.h"
+#include "MethodIdStream.h"
+#include "PortLock.h"
+#include "PropertyPoller.h"
+#include "RpcMonitor.h"
+#include "TraceRing.h"
+#include "WriteBehind.h"
+#include <DispatchTime.h>
+#include <LinkChannels.h>
+#include <LinkCount.h>
+#include <LinkFixed.h>
+#include <LinkNotify.h>
+#include <SequencePlayer.h>
+#include <SequenceUpload.h>
+#include <TaskScheduler.h>
+#include <Telemetry.h>
 #include <Stream.h> // for arduino::Stream
 #include <rdl/JsonDelegate.h>
 #include <rdl/JsonDispatch.h>
@@ -28,7 +45,13 @@
 #include <rdlmm/LocalProp.h>
 #include <rdlmm/RemoteProp.h>
 #include <rdlmm/Stream_HubSerial.h>
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <ostream>
 #include <string>
+#include <vector>
 
 using namespace rdlmm;
 
@@ -38,12 +61,68 @@ const char* g_versionProp   = "Version";
 const char* g_intProp    = "intProp";
 const char* g_longProp   = "longProp";
 const char* g_stringProp = "stringProp";
+const char* g_baudProp = "MaxBaudRate";
+const char* g_rpcStatsProp = "RpcStats";
+const char* g_rpcResetProp = "RpcStatsReset";
+const char* g_rpcLatencyPrefix = "RpcLatency ";
+const char* g_traceProp = "LastTransactions";
+const char* g_barGroup = "bar";         ///< firmware channel group behind barA and barB
+const char* g_barAllProp = "barAll";
+const char* g_writeBehindProp = "WriteBehind";
+const char* g_writeWindowPrefix = "WriteWindowMs ";
+const char* g_writeElidedPrefix = "WritesElided ";
+const char* g_pollIntervalProp = "PollIntervalMs";
+const char* g_pollMaxAgePrefix = "PollMaxAgeMs ";
+const char* g_pollStalenessPrefix = "PollStalenessMs ";
+const char* g_wireFormatPrefix = "WireFormat ";
+const char* g_wireDecimal = "Decimal";
+const char* g_wireFixed = "FixedPoint";
+const char* g_seqIntervalProp = "SequenceIntervalUs";
+const char* g_seqStatusProp = "SequenceStatus";
+const char* g_fwStatsProp = "FirmwareStats";
+const char* g_fwMethodStatsProp = "FirmwareMethodStats";
+const char* g_fwTasksProp = "FirmwareTasks";
+
+/** Numeric property from the firmware's RPC_STATS reply */
+struct FirmwareStatField {
+    const char* prop;
+    const char* key;
+    int element; ///< of the key's [n,p50,p99,max] array, -1: the key is a number
+};
+
+const FirmwareStatField g_fwStatFields[] = {
+    {"FirmwareLoopP50Us", "loop", 1},
+    {"FirmwareLoopP99Us", "loop", 2},
+    {"FirmwareLoopMaxUs", "loop", 3},
+    {"FirmwareDispatchP50Us", "pass", 1},
+    {"FirmwareDispatchP99Us", "pass", 2},
+    {"FirmwareDispatchMaxUs", "pass", 3},
+    {"FirmwareHeapFree", "heap", -1},
+    {"FirmwareStackFree", "stack", -1},
+    {"FirmwareRxPeak", "rx", -1},
+    {"FirmwareFrameErrors", "ferr", -1},
+    {"FirmwareTelemetryPpm", "ovh", -1},
+};
+
+const int ERR_SEQUENCE_UPLOAD = 20001;
+const int ERR_SEQUENCE_PLAYBACK = 20002;
 //const char* g_doubleProp = "doubleProp";
 
 const auto g_infoPort     = PropInfo<std::string>::build(MM::g_Keyword_Port, "Undefined").preInit();
-const auto g_infoFoo      = PropInfo<long>::build("foo").withBrief("foo").sequencable().volatileValue();
-const auto g_infoBarA      = PropInfo<double>::build("barA").withBrief("bar").sequencable().volatileValue();
-const auto g_infoBarB      = PropInfo<double>::build("barB").withBrief("bar").sequencable().volatileValue();
+const char* const g_fooProp  = "foo";
+const char* const g_barAProp = "barA";
+const char* const g_barBProp = "barB";
+const auto g_infoFoo      = PropInfo<long>::build(g_fooProp).withBrief("foo").sequencable().volatileValue();
+const auto g_infoBarA      = PropInfo<double>::build(g_barAProp).withBrief("bar").sequencable().volatileValue();
+const auto g_infoBarB      = PropInfo<double>::build(g_barBProp).withBrief("bar").sequencable().volatileValue();
+// the same once the firmware pushes their changes: MMCore need not poll them
+const auto g_infoFooPushed  = PropInfo<long>::build(g_fooProp).withBrief("foo").sequencable();
+const auto g_infoBarAPushed = PropInfo<double>::build(g_barAProp).withBrief("bar").sequencable();
+const auto g_infoBarBPushed = PropInfo<double>::build(g_barBProp).withBrief("bar").sequencable();
+// barA and barB as scaled integers on the wire: value = raw * scale + offset.
+// The four decimals a float property keeps, over +-214748, as the firmware
+// codes them.
+const ctl::fixed_point g_fixedBar = ctl::BAR_FIXED;
 const auto g_infoVersion  = PropInfo<long>::build(g_versionProp, 0);
 const auto g_infoIntProp  = PropInfo<int>::build(g_intProp, 100);
 const auto g_infoLongProp = PropInfo<long>::build(g_longProp, 100000);
@@ -64,6 +143,7 @@ class CArduinoCoreTestDeviceHub : public HubBase<CArduinoCoreTestDeviceHub> {
 
     using LoggerT       = rdlmm::DeviceLog_Print<HubT>;
     using SerialStreamT = rdlmm::Stream_HubSerial<HubT>;
+    using LinkT         = ctl::counting_stream;
     using ClientT       = rdl::json_client<JSONRCP_BUFFER_SIZE>;
 
  public:
@@ -73,8 +153,24 @@ class CArduinoCoreTestDeviceHub : public HubBase<CArduinoCoreTestDeviceHub> {
     int Initialize();
     int Shutdown();
     void GetName(char* pszName) const;
+    /** True while write-behind property writes are still unacknowledged */
     bool Busy();
 
+    // write-behind properties are queued here instead of set synchronously
+    using HubBase<HubT>::SetProperty;
+    using HubBase<HubT>::GetProperty;
+    int SetProperty(const char* name, const char* value);
+    int GetProperty(const char* name, char* value) const;
+
+    // sequences longer than the property's JSON limit go through the chunked upload
+    int GetPropertySequenceMaxLength(const char* propertyName, long& nrEvents) const;
+    int ClearPropertySequence(const char* propertyName);
+    int AddToPropertySequence(const char* propertyName, const char* value);
+    int SendPropertySequence(const char* propertyName);
+    // uploaded sequences play from the firmware's timer or trigger interrupt
+    int StartPropertySequence(const char* propertyName);
+    int StopPropertySequence(const char* propertyName);
+
     bool SupportsDeviceDetection(void);
     MM::DeviceDetectionStatus DetectDevice(void);
     int DetectInstalledDevices();
@@ -83,6 +179,34 @@ class CArduinoCoreTestDeviceHub : public HubBase<CArduinoCoreTestDeviceHub> {
     //int OnPort(MM::PropertyBase* pPropt, MM::ActionType eAct);
     int OnVersion(MM::PropertyBase* pPropt, MM::ActionType eAct);
     int OnTest(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnBenchmark(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnMaxBaudRate(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnRpcStats(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnRpcStatsReset(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnRpcMethodStats(MM::PropertyBase* pPropt, MM::ActionType eAct, long method);
+    int OnTrace(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnBarAll(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnWriteBehind(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnWriteWindow(MM::PropertyBase* pPropt, MM::ActionType eAct, long prop);
+    int OnWritesElided(MM::PropertyBase* pPropt, MM::ActionType eAct, long prop);
+    int OnPollInterval(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnPollMaxAge(MM::PropertyBase* pPropt, MM::ActionType eAct, long prop);
+    int OnPollStaleness(MM::PropertyBase* pPropt, MM::ActionType eAct, long prop);
+    int OnWireFormat(MM::PropertyBase* pPropt, MM::ActionType eAct, long prop);
+    int OnSequenceInterval(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnSequenceStatus(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnFirmwareStats(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnFirmwareStat(MM::PropertyBase* pPropt, MM::ActionType eAct, long field);
+    int OnFirmwareMethodStats(MM::PropertyBase* pPropt, MM::ActionType eAct);
+    int OnFirmwareTasks(MM::PropertyBase* pPropt, MM::ActionType eAct);
+
+    /**
+     * Set every channel of a firmware channel group in one frame.
+     * The channels change together on the device.
+     */
+    int SetChannels(const std::string& group, const std::vector<double>& values);
+    /** Read every channel of a firmware channel group in one frame */
+    int GetChannels(const std::string& group, std::vector<double>& values);
 
     // custom interface for child devices
     bool IsPortAvailable() { return portAvailable_; }
@@ -95,7 +219,11 @@ class CArduinoCoreTestDeviceHub : public HubBase<CArduinoCoreTestDeviceHub> {
     //{
     //   return ReadFromComPort(port_.c_str(), answer, maxLen, bytesRead);
     //}
-    static MMThreadLock& GetLock() { return lock_; }
+    /**
+     * Guards the serial link. Shared only with hubs on the same port.
+     * Resolved once in Initialize; before that, e.g. in DetectDevice, from the registry.
+     */
+    MMThreadLock& GetLock() { return portLock_ ? *portLock_ : PortLock::get(port()); }
 
     bool port(const std::string& portname) {
         int ret = port_.SetProperty(portname);
@@ -109,15 +237,93 @@ class CArduinoCoreTestDeviceHub : public HubBase<CArduinoCoreTestDeviceHub> {
     }
 
  private:
+    /** Firmware sequence store shadowing a remote sequencable property */
+    struct BulkSequence {
+        std::string target;              ///< firmware upload target name
+        bool integer;                    ///< packed as int32, otherwise float64
+        long capacity;                   ///< steps any sequence fits in the firmware store
+        long jsonMaxLength;              ///< limit of the property's own JSON sequence
+        std::vector<std::string> values; ///< values added since the last clear
+        bool uploaded;                   ///< the last send went to the store
+        int track;                       ///< firmware player track, <0 if none
+    };
+
+    /** Remote property that can travel as a scaled integer */
+    struct FixedProp {
+        std::string target;       ///< firmware channel name
+        ctl::fixed_point fixed;
+        bool on;                  ///< fixed-point on the wire, otherwise decimal
+    };
+
+    /** Negotiation hooks onto the client and the port */
+    class BaudLink;
+
     int GetControllerVersion(int&);
+    int NegotiateBaudRate();
+    int RestoreBaudRate();
+    int ReopenPort(uint32_t rate);
+    int AddBulkSequence(const std::string& propName, const std::string& target, bool integer);
+    int UploadSequence(const BulkSequence& seq);
+    static bool PackSequenceValue(const std::string& value, bool integer, uint8_t* raw);
+    void BenchmarkSequenceUpload(std::ostream& out);
+    void BenchmarkRpcMonitor(std::ostream& out);
+    void BenchmarkChannels(std::ostream& out);
+    std::string getLastLog() const { return trace_.dump(8); }
+    int LogRpcError(int error, const std::string& what) const;
+    int CallFailed(int error, const std::string& what);
+    int CreateRpcStatsProperties();
+    int SubscribeChanges(const std::string& target, const std::string& propName);
+    void UnsubscribeChanges();
+    bool Pushed(const std::string& propName);
+    bool PushedValue(const std::string& propName, std::string& value);
+    void StorePushed(const std::string& propName, const std::string& value);
+    void OnDeviceNotification(const uint8_t* frame, size_t size);
+    int NegotiateMethodIds();
+    int WritePropertyNow(const std::string& name, const std::string& value);
+    int FlushWrites();
+    int CreateWriteBehindProperties();
+    int FetchValues(const std::vector<std::string>& targets, std::vector<std::string>& values);
+    int CreatePollerProperties();
+    int AddFixedPoint(const std::string& propName, const std::string& target,
+                      const ctl::fixed_point& fixed);
+    int SetRemote(const char* name, const char* value, std::string& stored);
+    int GetRemote(const char* name, char* value);
+    static std::string FixedText(const ctl::fixed_point& fixed, int32_t raw);
+    void BenchmarkFixedPoint(std::ostream& out);
+    int CreatePlaybackProperties();
+    int CreateTelemetryProperties();
+    int FetchFirmwareStats(std::string& stats);
     //std::string port_;
     bool initialized_;
     bool portAvailable_;
+    MMThreadLock* portLock_; ///< this port's lock while initialized
     int version_;
-    static MMThreadLock lock_;
     //StreamAdapter serial_;
     SerialStreamT serial_;
+    LinkReader reader_;
+    LinkT link_;
+    MethodIdStream ids_;
+    RpcMonitor monitor_;
     ClientT client_;
+    LinkTrace trace_;
+    mutable std::atomic<uint64_t> traceLogged_; ///< trace_.recorded() at the last error log
+    long maxBaud_;      ///< 0: keep the connect rate
+    uint32_t baud_;     ///< current port rate
+    uint32_t baudOpen_; ///< port rate at Initialize
+    std::map<std::string, BulkSequence> bulk_;
+    std::mutex notifyLock_;
+    std::map<std::string, std::string> notifyProps_; ///< firmware name -> property
+    std::map<std::string, std::string> pushed_;      ///< notified property -> last value, "" unknown
+    bool writeBehind_;
+    int nested_; ///< property calls in progress; MMCore serializes them per device
+    WriteBehind writes_;
+    PropertyPoller poller_;
+    std::map<std::string, FixedProp> fixed_;
+    std::vector<std::string> fixedNames_; ///< fixed_ keys in WireFormat property order
+    bool player_;       ///< firmware plays uploaded sequences itself
+    long playPeriodUs_; ///< 0: one step per trigger edge
+    std::string fwStats_; ///< last RPC_STATS reply
+    std::chrono::steady_clock::time_point fwStatsAt_;
 
     LoggerT logger_;
 };
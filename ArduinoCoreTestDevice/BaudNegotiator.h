@@ -0,0 +1,149 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          BaudNegotiator.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Hub side of the serial link speed upgrade
+// LICENSE:       LGPL
+//
+
+#ifndef _BaudNegotiator_H_
+#define _BaudNegotiator_H_
+
+#include <LinkBaud.h>
+#include <algorithm>
+#include <chrono>
+#include <ostream>
+#include <thread>
+
+/**
+ * @brief Steps the hub and the firmware to the fastest rate that carries a
+ * CRC-checked test burst both ways.
+ *
+ * The negotiator only knows the protocol (see ctl::RPC_BAUD_TRY). The RPCs,
+ * reopening the port and raw access to it are supplied by a Link, so the
+ * same code runs against the hub serial port and against a pty in the
+ * host tests.
+ *
+ * Any failure leaves both ends at the starting rate: the hub reopens at it
+ * and waits until the firmware has timed out and fallen back as well.
+ */
+class BaudNegotiator {
+ public:
+    /** What the negotiator needs from the hub. All calls return DEVICE_OK (0) on success. */
+    class Link {
+     public:
+        virtual ~Link() {}
+        virtual int capabilities(int& mask)  = 0; ///< ctl::RPC_BAUD
+        virtual int request(int index)       = 0; ///< ctl::RPC_BAUD_TRY
+        virtual int confirm()                = 0; ///< ctl::RPC_BAUD_CONFIRM
+        virtual int reopen(uint32_t rate)    = 0; ///< switch the local port
+        virtual ctl::StreamT& raw()          = 0; ///< unframed port access for the burst
+    };
+
+    using Clock = std::chrono::steady_clock;
+
+    BaudNegotiator(Link& link, std::ostream* log = nullptr) : link_(link), log_(log) {}
+
+    /** Time allowed for the echo; the firmware waits ctl::BAUD_TRIAL_MS for the burst */
+    void trialTime(std::chrono::milliseconds trial) { trial_ = trial; }
+
+    size_t attempts() const { return attempts_; }
+
+    /**
+     * Try every rate both ends support above current, fastest first.
+     * @return the rate in use afterwards
+     */
+    uint32_t negotiate(uint32_t current, uint32_t maxRate) {
+        attempts_ = 0;
+        int mask  = 0;
+        if (link_.capabilities(mask) != 0) {
+            if (log_) *log_ << "firmware cannot change baud rate\n";
+            return current;
+        }
+        for (int i = ctl::BAUD_COUNT - 1; i >= 0; i--) {
+            uint32_t rate = ctl::BAUD_RATES[i];
+            if (rate <= current) break;
+            if (rate > maxRate || !(mask & (1 << i))) continue;
+            attempts_++;
+            uint32_t now = attempt(i, current);
+            if (now != current) return now;
+        }
+        return current;
+    }
+
+    /**
+     * Step to one given rate, e.g. back to the connect rate at shutdown.
+     * @return the rate in use afterwards
+     */
+    uint32_t change(uint32_t current, uint32_t rate) {
+        int index = ctl::baud_index(rate);
+        if (index < 0 || rate == current) return current;
+        attempts_ = 1;
+        return attempt(index, current);
+    }
+
+ protected:
+    // @return the rate both ends are at afterwards
+    uint32_t attempt(int index, uint32_t current) {
+        uint32_t rate = ctl::BAUD_RATES[index];
+        if (link_.request(index) != 0) return current;
+        bool echoed = link_.reopen(rate) == 0 && burst(static_cast<uint8_t>(attempts_));
+        if (echoed && link_.confirm() == 0) {
+            if (log_) *log_ << "baud rate " << rate << " ok\n";
+            return rate;
+        }
+        if (log_) *log_ << "baud rate " << rate << (echoed ? " not confirmed" : " failed burst") << "\n";
+
+        // let the firmware time out of the trial and the confirm wait
+        link_.reopen(current);
+        std::this_thread::sleep_for(2 * trial_ + std::chrono::milliseconds(50));
+        drain();
+        int mask = 0;
+        if (link_.capabilities(mask) == 0) return current;
+        // the confirm went through but its reply got lost
+        if (echoed && link_.reopen(rate) == 0 && link_.capabilities(mask) == 0) return rate;
+        link_.reopen(current);
+        return current;
+    }
+
+    bool burst(uint8_t seed) {
+        uint8_t sent[ctl::BAUD_BURST_BYTES + 3];
+        uint8_t echo[2 * sizeof(sent)];
+        size_t n = ctl::make_burst(sent, seed);
+        ctl::StreamT& port = link_.raw();
+        drain();
+        ctl::slip_write(port, sent, n);
+        port.flush();
+
+        size_t len    = 0;
+        auto deadline = Clock::now() + trial_;
+        while (Clock::now() < deadline) {
+            int c = port.available() > 0 ? port.read() : -1;
+            if (c < 0) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            if (c != ctl::SLIP_END) {
+                if (len < sizeof(echo)) echo[len++] = static_cast<uint8_t>(c);
+                continue;
+            }
+            size_t m = ctl::slip_decode(echo, len);
+            len      = 0;
+            if (m == n && ctl::check_burst(echo, m) && std::equal(sent, sent + n, echo)) return true;
+        }
+        return false;
+    }
+
+    void drain() {
+        ctl::StreamT& port = link_.raw();
+        while (port.available() > 0 && port.read() >= 0) {}
+    }
+
+    Link& link_;
+    std::ostream* log_;
+    std::chrono::milliseconds trial_{ctl::BAUD_TRIAL_MS};
+    size_t attempts_ = 0;
+};
+
+#endif //_BaudNegotiator_H_
@@ -0,0 +1,258 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          LinkReader.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background reader that demultiplexes the hub serial link
+// LICENSE:       LGPL
+//
+
+#ifndef _LinkReader_H_
+#define _LinkReader_H_
+
+#include <SlipFrame.h>
+#include <SpscQueue.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Stream adapter with a dedicated thread draining the serial link.
+ *
+ * The thread continuously reads the wire, splits SLIP frames and routes them:
+ * replies go through a lock-free SPSC byte queue to whoever calls read()
+ * (the json_client on the MMCore thread), notifications go through a second
+ * SPSC queue to a dispatcher thread that calls the subscribers. Writes go
+ * straight to the wire.
+ *
+ * Before start() and after stop(), reads fall through to the wire so the
+ * hub can still talk to the device synchronously, e.g. during detection.
+ *
+ * The wire can only be polled, and a short sleep_for() is a whole scheduler
+ * tick on Windows (1-15 ms). So the reader does not sleep right after a
+ * write: it wakes and polls the wire until the reply frame is in, or for
+ * replySpin(), a few hundred microseconds, which covers a reply from a
+ * board on USB. A slower reply, or none, is picked up by the idle polls:
+ * the reader waits on its event for the next write, purge() or stop(), or
+ * idlePoll() for replies and notifications, whichever comes first.
+ *
+ * A call that fails, e.g. times out, can leave part of its reply queued or
+ * in the reader's frame; purge() drops both, so the next call does not
+ * read it as its own.
+ *
+ * Subscribers are called on the dispatcher thread. They may block (e.g. call
+ * back into MMCore) without holding up replies.
+ */
+class LinkReader : public ctl::StreamT {
+ public:
+    using Subscriber = std::function<void(const uint8_t* frame, size_t size)>;
+
+    static const size_t QUEUE_SIZE   = 4096;
+    static const size_t NOTIFY_QUEUE = 64;
+    static const size_t NOTIFY_BYTES = 120;
+
+    LinkReader(ctl::StreamT& wire) : wire_(wire), running_(false) {}
+    ~LinkReader() { stop(); }
+
+    /** Register before start() */
+    void subscribe(Subscriber subscriber) { subscribers_.push_back(subscriber); }
+
+    void start() {
+        if (running_) return;
+        running_    = true;
+        thread_     = std::thread(&LinkReader::run, this);
+        dispatcher_ = std::thread(&LinkReader::dispatch, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(wakeLock_);
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+        if (dispatcher_.joinable()) dispatcher_.join();
+        replies_.clear();
+        notices_.clear();
+    }
+
+    bool running() const { return running_; }
+
+    /**
+     * Drop any queued reply bytes and the frame the reader has started.
+     * Call after purging the port, or after a failed call. Waits for the reader
+     * to let go of its frame.
+     */
+    void purge() {
+        if (running_) {
+            std::unique_lock<std::mutex> guard(wakeLock_);
+            purge_ = true;
+            wake_.notify_all();
+            wake_.wait_for(guard, std::chrono::milliseconds(100), [this]() { return !purge_ || !running_; });
+        }
+        replies_.clear();
+    }
+
+    /** Longest the reader waits on an idle wire with no reply due, for notifications */
+    void idlePoll(std::chrono::microseconds poll) { idlePoll_ = poll; }
+    /** How long after a write the reader polls for the reply without sleeping */
+    void replySpin(std::chrono::microseconds spin) { replySpin_ = spin; }
+
+    size_t replyFrames() const { return replyFrames_; }
+    size_t notifications() const { return notifications_; }
+    size_t droppedFrames() const { return dropped_; }
+
+    // Print interface
+
+    size_t write(uint8_t c) override {
+        size_t n = wire_.write(c);
+        replyDue();
+        return n;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        size_t n = wire_.write(buffer, size);
+        replyDue();
+        return n;
+    }
+    void flush() override { wire_.flush(); }
+
+    // Stream interface
+
+    int available() override {
+        return running_ ? static_cast<int>(replies_.size()) : wire_.available();
+    }
+
+    int read() override {
+        if (!running_) return wire_.read();
+        uint8_t c;
+        return replies_.pop(c) ? c : -1;
+    }
+
+    int peek() override {
+        if (!running_) return wire_.peek();
+        uint8_t c;
+        return replies_.front(c) ? c : -1;
+    }
+
+ protected:
+    void run() {
+        std::vector<uint8_t> frame;
+        frame.reserve(QUEUE_SIZE);
+        while (running_) {
+            if (purge_) {
+                frame.clear();
+                {
+                    std::lock_guard<std::mutex> guard(wakeLock_);
+                    purge_ = false;
+                }
+                wake_.notify_all();
+            }
+            if (wire_.available() <= 0) {
+                idle();
+                continue;
+            }
+            int c = wire_.read();
+            if (c < 0) continue;
+            frame.push_back(static_cast<uint8_t>(c));
+            if (c == ctl::SLIP_END) {
+                route(frame);
+                frame.clear();
+            } else if (frame.size() >= QUEUE_SIZE) {
+                // runaway frame without terminator
+                dropped_++;
+                frame.clear();
+            }
+        }
+    }
+
+    /** A request went out: poll for its reply from now on */
+    void replyDue() {
+        lastWrite_ = std::chrono::steady_clock::now().time_since_epoch().count();
+        if (awaiting_) return;
+        {
+            std::lock_guard<std::mutex> guard(wakeLock_);
+            awaiting_ = true;
+        }
+        wake_.notify_all();
+    }
+
+    /** Nothing on the wire: poll on for replySpin_ after a write, else wait for an event */
+    void idle() {
+        using namespace std::chrono;
+        if (awaiting_) {
+            steady_clock::duration since(steady_clock::now().time_since_epoch().count() - lastWrite_);
+            if (since < replySpin_) {
+                std::this_thread::yield();
+                return;
+            }
+            awaiting_ = false; // a slow reply, or none: the idle polls take over
+        }
+        std::unique_lock<std::mutex> guard(wakeLock_);
+        wake_.wait_for(guard, idlePoll_, [this]() { return awaiting_ || purge_ || !running_; });
+    }
+
+    void route(std::vector<uint8_t>& frame) {
+        if (frame.size() > 1 && frame[0] == ctl::NOTIFY_MARKER) {
+            Notice notice;
+            notice.size = ctl::slip_decode(frame.data(), frame.size() - 1);
+            if (notice.size <= NOTIFY_BYTES) {
+                std::copy(frame.data(), frame.data() + notice.size, notice.data);
+                if (notices_.push(notice)) {
+                    notifications_++;
+                    return;
+                }
+            }
+            dropped_++;
+            return;
+        }
+        if (replies_.push_all(frame.data(), frame.size())) {
+            if (frame.size() > 1) {
+                replyFrames_++;
+                awaiting_ = false;
+            }
+        } else {
+            dropped_++;
+        }
+    }
+
+    void dispatch() {
+        Notice notice;
+        while (running_) {
+            if (!notices_.pop(notice)) {
+                std::this_thread::sleep_for(std::chrono::milliseconds(1));
+                continue;
+            }
+            for (auto& subscriber : subscribers_) subscriber(notice.data, notice.size);
+        }
+    }
+
+    struct Notice {
+        size_t size;
+        uint8_t data[NOTIFY_BYTES];
+    };
+
+    ctl::StreamT& wire_;
+    std::thread thread_;
+    std::thread dispatcher_;
+    std::atomic<bool> running_;
+    std::mutex wakeLock_;
+    std::condition_variable wake_;
+    std::atomic<bool> awaiting_{false}; ///< a reply is due
+    std::atomic<bool> purge_{false};
+    std::atomic<std::chrono::steady_clock::rep> lastWrite_{0};
+    std::chrono::microseconds idlePoll_{1000};
+    std::chrono::microseconds replySpin_{300};
+    ctl::spsc_queue<uint8_t, QUEUE_SIZE> replies_;
+    ctl::spsc_queue<Notice, NOTIFY_QUEUE> notices_;
+    std::vector<Subscriber> subscribers_;
+    std::atomic<size_t> replyFrames_{0};
+    std::atomic<size_t> notifications_{0};
+    std::atomic<size_t> dropped_{0};
+};
+
+#endif //_LinkReader_H_
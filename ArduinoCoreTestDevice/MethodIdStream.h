@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          MethodIdStream.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Replaces json_client method names by negotiated method ids
+// LICENSE:       LGPL
+//
+
+#ifndef _MethodIdStream_H_
+#define _MethodIdStream_H_
+
+#include "MethodScan.h"
+#include <MethodIds.h>
+#include <SlipFrame.h>
+#include <string>
+#include <unordered_map>
+
+/**
+ * @brief Stream adapter that swaps request method names for "#<id>".
+ *
+ * Sits under the json_client (and the RpcMonitor, which keeps seeing names).
+ * Like the monitor it finds the method's value with a MethodScan, so only
+ * the top level "method" (or "m") member is ever replaced. The name is held
+ * back while it streams through and written out as its id once the closing
+ * quote arrives; names without an id, and everything else, pass straight
+ * through. Reads are untouched.
+ *
+ * With no table (the default) the adapter is a pass-through.
+ */
+class MethodIdStream : public ctl::StreamT {
+ public:
+    static const size_t MAX_NAME = 64;
+
+    MethodIdStream(ctl::StreamT& link) : link_(link) {}
+
+    /**
+     * Load a table in the ctl::RPC_METHOD_IDS reply format.
+     * @return number of methods with an id
+     */
+    size_t table(const std::string& names) {
+        ids_.clear();
+        size_t id = 0, begin = 0;
+        while (begin <= names.size()) {
+            size_t end = names.find(ctl::METHOD_ID_SEPARATOR, begin);
+            if (end == std::string::npos) end = names.size();
+            if (end > begin) {
+                ids_[names.substr(begin, end - begin)] = ctl::METHOD_ID_PREFIX + std::to_string(id);
+            }
+            id++;
+            begin = end + 1;
+        }
+        return ids_.size();
+    }
+
+    /** Back to sending method names */
+    void clear() { ids_.clear(); }
+
+    size_t size() const { return ids_.size(); }
+
+    /** Bytes saved on the wire by sending ids */
+    size_t savedBytes() const { return saved_; }
+
+    // Print interface
+
+    size_t write(uint8_t c) override {
+        if (ids_.empty()) return link_.write(c);
+        switch (state_) {
+            case SEEK:
+                if (method_scan_.feed(c)) {
+                    state_ = NAME;
+                    name_.clear();
+                }
+                break;
+            case NAME:
+                if (c == '"') {
+                    flushName();
+                    state_ = DONE;
+                } else if (c == ctl::SLIP_END || name_.size() >= MAX_NAME) {
+                    link_.write(reinterpret_cast<const uint8_t*>(name_.data()), name_.size());
+                    state_ = DONE;
+                } else {
+                    name_.push_back(static_cast<char>(c));
+                    return 1;
+                }
+                break;
+            case DONE:
+                break;
+        }
+        if (c == ctl::SLIP_END) {
+            state_ = SEEK;
+            method_scan_.reset();
+        }
+        return link_.write(c);
+    }
+
+    using ctl::StreamT::write;
+
+    void flush() override { link_.flush(); }
+
+    // Stream interface
+
+    int available() override { return link_.available(); }
+    int read() override { return link_.read(); }
+    int peek() override { return link_.peek(); }
+
+ protected:
+    void flushName() {
+        auto it = ids_.find(name_);
+        const std::string& out = (it == ids_.end()) ? name_ : it->second;
+        if (out.size() < name_.size()) saved_ += name_.size() - out.size();
+        link_.write(reinterpret_cast<const uint8_t*>(out.data()), out.size());
+    }
+
+    enum ScanState { SEEK, NAME, DONE };
+
+    ctl::StreamT& link_;
+    std::unordered_map<std::string, std::string> ids_;
+    ScanState state_ = SEEK;
+    MethodScan method_scan_;
+    std::string name_;
+    size_t saved_ = 0;
+};
+
+#endif //_MethodIdStream_H_
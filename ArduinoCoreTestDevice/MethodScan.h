@@ -0,0 +1,96 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          MethodScan.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Finds the method of a JSON-RPC request as it streams out
+// LICENSE:       LGPL
+//
+
+#ifndef _MethodScan_H_
+#define _MethodScan_H_
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * @brief Byte at a time tokenizer that spots the method member of a request.
+ *
+ * Fed every byte of a request frame, feed() returns true on the opening
+ * quote of the value of the method key: "method" as in JSON-RPC, or "m" as
+ * in compact json_client frames. Only members of the top level object
+ * count, and only a key followed by ':' is a key, so a string valued
+ * parameter or id is never taken for the method. reset() at every frame.
+ */
+class MethodScan {
+ public:
+    /** @return true if c opened the method's string value */
+    bool feed(uint8_t c) {
+        if (inString_) {
+            if (escape_) {
+                escape_ = false;
+            } else if (c == '\\') {
+                escape_ = true;
+            } else if (c == '"') {
+                inString_ = false;
+                closed_   = true;
+                return false;
+            }
+            if (len_ < sizeof(key_)) key_[len_] = static_cast<char>(c);
+            len_++;
+            return false;
+        }
+        switch (c) {
+            case '"': {
+                bool value = valueNext_;
+                inString_  = true;
+                closed_    = false;
+                valueNext_ = false;
+                len_       = 0;
+                return value;
+            }
+            case ':':
+                valueNext_ = closed_ && depth_ == 1 && isMethodKey();
+                closed_    = false;
+                return false;
+            case ' ':
+            case '\t':
+            case '\r':
+            case '\n':
+                return false;
+            case '{':
+            case '[':
+                depth_++;
+                break;
+            case '}':
+            case ']':
+                if (depth_ > 0) depth_--;
+                break;
+        }
+        closed_    = false;
+        valueNext_ = false;
+        return false;
+    }
+
+    void reset() {
+        depth_    = 0;
+        len_      = 0;
+        inString_ = escape_ = closed_ = valueNext_ = false;
+    }
+
+ protected:
+    bool isMethodKey() const {
+        return (len_ == 1 && key_[0] == 'm') || (len_ == 6 && memcmp(key_, "method", 6) == 0);
+    }
+
+    char key_[6];
+    size_t len_     = 0; ///< length of the last string, past sizeof(key_) not stored
+    int depth_      = 0;
+    bool inString_  = false;
+    bool escape_    = false;
+    bool closed_    = false; ///< a string just ended, a ':' makes it a key
+    bool valueNext_ = false; ///< the next string is the method
+};
+
+#endif //_MethodScan_H_
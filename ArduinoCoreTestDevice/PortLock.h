@@ -0,0 +1,39 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          PortLock.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   One lock per serial link, shared by every hub on that port
+// LICENSE:       LGPL
+//
+
+#ifndef _PortLock_H_
+#define _PortLock_H_
+
+#include "DeviceThreads.h"
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Registry of per-port locks.
+ *
+ * Hubs talking over different serial links never contend. Hubs (or a hub and
+ * its detection pass) that share a link get the same lock. Locks live until
+ * the module is unloaded so references stay valid.
+ */
+class PortLock {
+ public:
+    static MMThreadLock& get(const std::string& port) {
+        static std::mutex registryLock;
+        static std::map<std::string, std::unique_ptr<MMThreadLock>> locks;
+
+        std::lock_guard<std::mutex> guard(registryLock);
+        std::unique_ptr<MMThreadLock>& lock = locks[port];
+        if (!lock) lock.reset(new MMThreadLock());
+        return *lock;
+    }
+};
+
+#endif //_PortLock_H_
@@ -0,0 +1,205 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          PropertyPoller.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Background refresh of volatile remote property values
+// LICENSE:       LGPL
+//
+
+#ifndef _PropertyPoller_H_
+#define _PropertyPoller_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Thread that reads selected properties in one batch at a fixed rate.
+ *
+ * Each property has a maximum age. Properties with a maximum age of zero are
+ * not polled. cached() serves a value only while it is younger than its
+ * maximum age; older values leave the caller to read the device itself.
+ * The oldest value served so far is kept per property as its staleness.
+ *
+ * A value is stamped with the time its batch was requested, so the age
+ * includes the round trip. update() stores values learned elsewhere, e.g.
+ * from a write or a change notification.
+ */
+class PropertyPoller {
+ public:
+    /**
+     * Reads the targets in one round trip into values, in the same order.
+     * Returns 0 on success or a device error code.
+     */
+    using Fetcher = std::function<int(const std::vector<std::string>& targets,
+                                      std::vector<std::string>& values)>;
+    using Clock   = std::chrono::steady_clock;
+
+    PropertyPoller(Fetcher fetcher)
+        : fetcher_(fetcher), running_(false), interval_(0), batches_(0), failed_(0) {}
+    ~PropertyPoller() { stop(); }
+
+    /** Register before start(). target is the name the fetcher asks for. */
+    void add(const std::string& name, const std::string& target) { props_[name].target = target; }
+
+    bool handles(const std::string& name) const { return props_.count(name) != 0; }
+
+    /** Registered property names */
+    std::vector<std::string> names() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::vector<std::string> result;
+        for (auto& prop : props_) result.push_back(prop.first);
+        return result;
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (running_) return;
+        running_ = true;
+        thread_  = std::thread(&PropertyPoller::run, this);
+    }
+
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    /** Time between two batches, 0 stops polling */
+    void interval(std::chrono::milliseconds interval) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            interval_ = interval;
+        }
+        wake_.notify_all();
+    }
+
+    std::chrono::milliseconds interval() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        return interval_;
+    }
+
+    /** Oldest value cached() may serve for name, 0 stops polling name */
+    void maxAge(const std::string& name, std::chrono::milliseconds age) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            Slot& slot     = props_[name];
+            slot.maxAge    = age;
+            slot.staleness = std::chrono::microseconds(0);
+            if (age.count() == 0) slot.valid = false;
+        }
+        wake_.notify_all();
+    }
+
+    std::chrono::milliseconds maxAge(const std::string& name) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        return it == props_.end() ? std::chrono::milliseconds(0) : it->second.maxAge;
+    }
+
+    /** Oldest value served for name since its maximum age was set */
+    std::chrono::microseconds staleness(const std::string& name) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        return it == props_.end() ? std::chrono::microseconds(0) : it->second.staleness;
+    }
+
+    /** The cached value of name if it is fresh enough */
+    bool cached(const std::string& name, std::string& value) {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        if (it == props_.end() || !it->second.valid || interval_.count() == 0) return false;
+        Slot& slot = it->second;
+        auto age   = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - slot.stamp);
+        if (age > slot.maxAge) return false;
+        if (age > slot.staleness) slot.staleness = age;
+        value = slot.value;
+        return true;
+    }
+
+    /** A value of name known to be current */
+    void update(const std::string& name, const std::string& value) {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        if (it == props_.end() || it->second.maxAge.count() == 0) return;
+        it->second.value = value;
+        it->second.stamp = Clock::now();
+        it->second.valid = true;
+    }
+
+    size_t batches() const { return batches_; }
+    /** Batches the fetcher failed. Their values are not updated. */
+    size_t failed() const { return failed_; }
+
+ protected:
+    struct Slot {
+        Slot() : maxAge(0), staleness(0), valid(false) {}
+        std::string target;
+        std::chrono::milliseconds maxAge;
+        std::chrono::microseconds staleness;
+        std::string value;
+        Clock::time_point stamp;
+        bool valid;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock_);
+        while (running_) {
+            std::vector<std::string> names, targets, values;
+            for (auto& prop : props_) {
+                if (prop.second.maxAge.count() == 0) continue;
+                names.push_back(prop.first);
+                targets.push_back(prop.second.target);
+            }
+            if (interval_.count() == 0 || targets.empty()) {
+                wake_.wait(guard);
+                continue;
+            }
+            auto interval = interval_;
+            auto next     = Clock::now() + interval;
+
+            guard.unlock();
+            Clock::time_point stamp = Clock::now();
+            int ret = fetcher_(targets, values);
+            guard.lock();
+
+            batches_++;
+            if (ret != 0 || values.size() != targets.size()) {
+                failed_++;
+            } else {
+                for (size_t i = 0; i < names.size(); i++) {
+                    Slot& slot = props_[names[i]];
+                    // a write or notification during the fetch is newer
+                    if (slot.maxAge.count() == 0 || (slot.valid && slot.stamp > stamp)) continue;
+                    slot.value = values[i];
+                    slot.stamp = stamp;
+                    slot.valid = true;
+                }
+            }
+            wake_.wait_until(guard, next, [&]() { return !running_ || interval_ != interval; });
+        }
+    }
+
+    Fetcher fetcher_;
+    mutable std::mutex lock_;
+    std::condition_variable wake_;
+    std::thread thread_;
+    bool running_;
+    std::chrono::milliseconds interval_;
+    std::map<std::string, Slot> props_;
+    std::atomic<size_t> batches_;
+    std::atomic<size_t> failed_;
+};
+
+#endif //_PropertyPoller_H_
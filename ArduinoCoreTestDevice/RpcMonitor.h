@@ -0,0 +1,222 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          RpcMonitor.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Per-method RPC latency histograms for the hub json_client
+// LICENSE:       LGPL
+//
+
+#ifndef _RpcMonitor_H_
+#define _RpcMonitor_H_
+
+#include "MethodScan.h"
+#include "TraceRing.h"
+#include <Histogram.h>
+#include <SlipFrame.h>
+#include <chrono>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Stream adapter that times every json_client call by method name.
+ *
+ * Sits directly under the json_client, where frames are SLIP framed JSON
+ * text. A request is timed from its final SLIP_END to the SLIP_END of the
+ * next reply. A request that is followed by another request without a reply
+ * in between (timeout, dropped frame) counts as an error for its method.
+ *
+ * The method name is the string value of the request's method key, found
+ * by a MethodScan while the request streams through, so there is no parse
+ * on the hot path. A request without one is counted under "?".
+ *
+ * Optionally copies the start of every frame into a LinkTrace.
+ */
+class RpcMonitor : public ctl::StreamT {
+ public:
+    struct MethodStats {
+        std::string name;
+        ctl::log_histogram latencyNs;
+        uint32_t errors = 0;
+    };
+
+    RpcMonitor(ctl::StreamT& link) : link_(link) {}
+
+    /** Record every request and reply frame here. nullptr to stop. */
+    void trace(LinkTrace* trace) { trace_ = trace; }
+
+    /** Method names seen so far, in order of first call */
+    std::vector<std::string> methods() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::vector<std::string> names;
+        for (auto& m : stats_) names.push_back(m.name);
+        return names;
+    }
+
+    /** Copy of one method's statistics. False if unknown. */
+    bool stats(size_t index, MethodStats& out) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (index >= stats_.size()) return false;
+        out = stats_[index];
+        return true;
+    }
+
+    void reset() {
+        std::lock_guard<std::mutex> guard(lock_);
+        for (auto& m : stats_) {
+            m.latencyNs.reset();
+            m.errors = 0;
+        }
+    }
+
+    /** One line summary, e.g. for a read-only property */
+    static void summary(std::ostream& out, const MethodStats& m) {
+        out << "n=" << m.latencyNs.count() << " err=" << m.errors
+            << " mean=" << m.latencyNs.mean() / 1000.0 << "us"
+            << " p50=" << m.latencyNs.percentile(0.5) / 1000.0 << "us"
+            << " p99=" << m.latencyNs.percentile(0.99) / 1000.0 << "us"
+            << " max=" << m.latencyNs.max() / 1000.0 << "us";
+    }
+
+    /** All methods as a JSON object keyed by method name. Histogram buckets in ns. */
+    void dump(std::ostream& out) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        out << "{";
+        for (size_t i = 0; i < stats_.size(); i++) {
+            const MethodStats& m = stats_[i];
+            out << (i ? "," : "") << "\"" << m.name << "\":{"
+                << "\"n\":" << m.latencyNs.count() << ",\"errors\":" << m.errors
+                << ",\"mean_ns\":" << static_cast<uint64_t>(m.latencyNs.mean())
+                << ",\"p50_ns\":" << m.latencyNs.percentile(0.5)
+                << ",\"p99_ns\":" << m.latencyNs.percentile(0.99)
+                << ",\"max_ns\":" << m.latencyNs.max() << ",\"hist\":[";
+            bool first = true;
+            for (unsigned b = 0; b < ctl::log_histogram::BUCKETS; b++) {
+                if (m.latencyNs.at(b) == 0) continue;
+                out << (first ? "" : ",") << "[" << ctl::log_histogram::lower_bound(b)
+                    << "," << m.latencyNs.at(b) << "]";
+                first = false;
+            }
+            out << "]}";
+        }
+        out << "}";
+    }
+
+    /** Index of a method, added if new */
+    size_t method(const std::string& name) {
+        std::lock_guard<std::mutex> guard(lock_);
+        return indexOf(name);
+    }
+
+    /** Record one completed call. Public so the overhead can be benchmarked. */
+    void record(size_t method, uint32_t ns) {
+        std::lock_guard<std::mutex> guard(lock_);
+        stats_[method].latencyNs.record(ns);
+    }
+
+    // Print interface
+
+    size_t write(uint8_t c) override {
+        scan(c);
+        if (c == ctl::SLIP_END && txLen_ > 0) {
+            if (trace_) trace_->record(LinkTrace::SENT, txFrame_, txLen_);
+            requestSent();
+        }
+        if (c != ctl::SLIP_END && txLen_ < LinkTrace::FRAME_BYTES) txFrame_[txLen_] = c;
+        txLen_ = (c == ctl::SLIP_END) ? 0 : txLen_ + 1;
+        return link_.write(c);
+    }
+
+    using ctl::StreamT::write;
+
+    void flush() override { link_.flush(); }
+
+    // Stream interface
+
+    int available() override { return link_.available(); }
+    int peek() override { return link_.peek(); }
+
+    int read() override {
+        int c = link_.read();
+        if (c < 0) return c;
+        if (c == ctl::SLIP_END) {
+            if (rxLen_ > 0 && trace_) trace_->record(LinkTrace::RECEIVED, rxFrame_, rxLen_);
+            if (rxLen_ > 0 && pending_) replyReceived();
+            rxLen_ = 0;
+        } else {
+            if (rxLen_ < LinkTrace::FRAME_BYTES) rxFrame_[rxLen_] = static_cast<uint8_t>(c);
+            rxLen_++;
+        }
+        return c;
+    }
+
+ protected:
+    using Clock = std::chrono::steady_clock;
+
+    // picks the method's value out of the request
+    void scan(uint8_t c) {
+        if (txLen_ == 0) {
+            state_ = SEEK;
+            method_scan_.reset();
+            name_.clear();
+        }
+        switch (state_) {
+            case SEEK:
+                if (method_scan_.feed(c)) state_ = NAME;
+                break;
+            case NAME:
+                if (c == '"') state_ = DONE;
+                else name_.push_back(static_cast<char>(c));
+                break;
+            case DONE:
+                break;
+        }
+    }
+
+    void requestSent() {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (pending_) stats_[method_].errors++;
+        method_ = indexOf(name_.empty() ? std::string("?") : name_);
+        pending_ = true;
+        sent_    = Clock::now();
+    }
+
+    void replyReceived() {
+        auto ns  = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - sent_).count();
+        pending_ = false;
+        record(method_, ns > 0xFFFFFFFFLL ? 0xFFFFFFFFu : static_cast<uint32_t>(ns));
+    }
+
+    // expects caller to hold lock_
+    size_t indexOf(const std::string& name) {
+        for (size_t i = 0; i < stats_.size(); i++) {
+            if (stats_[i].name == name) return i;
+        }
+        stats_.push_back(MethodStats());
+        stats_.back().name = name;
+        return stats_.size() - 1;
+    }
+
+    enum ScanState { SEEK, NAME, DONE };
+
+    ctl::StreamT& link_;
+    LinkTrace* trace_ = nullptr;
+    uint8_t txFrame_[LinkTrace::FRAME_BYTES];
+    uint8_t rxFrame_[LinkTrace::FRAME_BYTES];
+    mutable std::mutex lock_;
+    std::vector<MethodStats> stats_;
+
+    ScanState state_ = SEEK;
+    MethodScan method_scan_;
+    std::string name_;
+    size_t txLen_ = 0;
+    size_t rxLen_ = 0;
+
+    bool pending_  = false;
+    size_t method_ = 0;
+    Clock::time_point sent_;
+};
+
+#endif //_RpcMonitor_H_
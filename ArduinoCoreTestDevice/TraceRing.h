@@ -0,0 +1,125 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          TraceRing.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Always-on ring of the last request/response frames
+// LICENSE:       LGPL
+//
+
+#ifndef _TraceRing_H_
+#define _TraceRing_H_
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+
+/**
+ * @brief Fixed-size, lock-free trace of the most recent link frames.
+ *
+ * Any thread may record. Each record claims a slot with a single atomic
+ * increment and publishes it with a per-slot sequence number, so recording
+ * never blocks and never allocates. Frames longer than FRAME bytes are
+ * truncated. dump() skips slots that are being rewritten while it reads.
+ *
+ * @tparam N      number of frames kept
+ * @tparam FRAME  bytes kept per frame
+ */
+template <size_t N = 64, size_t FRAME = 120>
+class TraceRing {
+ public:
+    enum Direction : uint8_t { SENT = '>', RECEIVED = '<' };
+
+    static const size_t FRAME_BYTES = FRAME;
+
+    TraceRing() : start_(Clock::now()) {
+        for (auto& e : entries_) e.seq.store(0, std::memory_order_relaxed);
+    }
+
+    void record(Direction dir, const uint8_t* frame, size_t size) {
+        uint64_t ticket = next_.fetch_add(1, std::memory_order_relaxed);
+        Entry& e        = entries_[ticket % N];
+        e.seq.store(2 * ticket + 1, std::memory_order_release); // odd: being written
+        std::atomic_thread_fence(std::memory_order_release);
+        e.ns   = std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start_).count();
+        e.dir  = dir;
+        e.size = static_cast<uint32_t>(size);
+        std::memcpy(e.data, frame, size < FRAME ? size : FRAME);
+        e.seq.store(2 * ticket + 2, std::memory_order_release); // even: complete
+    }
+
+    void clear() {
+        next_.store(0, std::memory_order_relaxed);
+        for (auto& e : entries_) e.seq.store(0, std::memory_order_release);
+    }
+
+    /** Total frames recorded since the last clear */
+    uint64_t recorded() const { return next_.load(std::memory_order_relaxed); }
+
+    /**
+     * The last frames, oldest first, one per line:
+     * `+<ms since start> <direction> <frame text>`.
+     * Non-printable bytes are shown as \\xHH.
+     */
+    std::string dump(size_t last = N) const {
+        std::string out;
+        uint64_t end   = next_.load(std::memory_order_acquire);
+        uint64_t count = last < N ? last : N;
+        uint64_t begin = end > count ? end - count : 0;
+        for (uint64_t ticket = begin; ticket < end; ticket++) {
+            const Entry& e = entries_[ticket % N];
+            Entry copy;
+            uint64_t seq = e.seq.load(std::memory_order_acquire);
+            if (seq != 2 * ticket + 2) continue;
+            copy.ns   = e.ns;
+            copy.dir  = e.dir;
+            copy.size = e.size;
+            std::memcpy(copy.data, e.data, FRAME);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (e.seq.load(std::memory_order_relaxed) != seq) continue; // overwritten meanwhile
+            append(out, copy);
+        }
+        return out;
+    }
+
+ protected:
+    using Clock = std::chrono::steady_clock;
+
+    struct Entry {
+        std::atomic<uint64_t> seq;
+        int64_t ns;
+        uint8_t dir;
+        uint32_t size;
+        uint8_t data[FRAME];
+    };
+
+    static void append(std::string& out, const Entry& e) {
+        char text[32];
+        std::snprintf(text, sizeof(text), "+%.3fms %c ", e.ns / 1e6, e.dir);
+        out += text;
+        size_t n = e.size < FRAME ? e.size : FRAME;
+        for (size_t i = 0; i < n; i++) {
+            uint8_t c = e.data[i];
+            if (c >= 0x20 && c < 0x7F && c != '\\') {
+                out += static_cast<char>(c);
+            } else {
+                std::snprintf(text, sizeof(text), "\\x%02X", c);
+                out += text;
+            }
+        }
+        if (e.size > FRAME) out += "...";
+        out += "\n";
+    }
+
+    Clock::time_point start_;
+    std::atomic<uint64_t> next_{0};
+    Entry entries_[N];
+};
+
+/** The trace kept by every hub */
+using LinkTrace = TraceRing<64, 120>;
+
+#endif //_TraceRing_H_
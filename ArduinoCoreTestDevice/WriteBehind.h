@@ -0,0 +1,239 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          WriteBehind.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Asynchronous property writes for the hub
+// LICENSE:       LGPL
+//
+
+#ifndef _WriteBehind_H_
+#define _WriteBehind_H_
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Queue of property writes sent by a background thread.
+ *
+ * post() returns right away. The thread hands each write to the writer,
+ * which does the actual (blocking) device call. A write to a property that
+ * is still queued replaces the queued value in place, so only the latest
+ * value goes out and writes to different properties keep their order.
+ *
+ * A property can have a coalescing window: its first queued write waits
+ * that long before it goes out, so a burst of writes costs one device call.
+ * Writes queued behind it wait too, to keep the order. flush() and stop()
+ * cut windows short.
+ *
+ * busy() stays true until every posted write has been acknowledged by the
+ * writer. A failed write is kept and handed to the next error() call.
+ * Only registered properties go through the queue: post() and window()
+ * refuse any other name.
+ */
+class WriteBehind {
+ public:
+    /** Performs one write, returns 0 on success or a device error code */
+    using Writer = std::function<int(const std::string& name, const std::string& value)>;
+
+    WriteBehind(Writer writer)
+        : writer_(writer), running_(false), hurry_(false), inFlight_(false), error_(0),
+          posted_(0), sent_(0), coalesced_(0) {}
+    ~WriteBehind() { stop(); }
+
+    /** Register before start() */
+    void add(const std::string& name) { props_[name]; }
+
+    bool handles(const std::string& name) const { return props_.count(name) != 0; }
+
+    /** Registered property names */
+    std::vector<std::string> names() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        std::vector<std::string> result;
+        for (auto& prop : props_) result.push_back(prop.first);
+        return result;
+    }
+
+    /** How long a write to name waits for a newer value before it is sent. False if not registered. */
+    bool window(const std::string& name, std::chrono::milliseconds window) {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        if (it == props_.end()) return false;
+        it->second.window = window;
+        return true;
+    }
+
+    std::chrono::milliseconds window(const std::string& name) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        return it == props_.end() ? std::chrono::milliseconds(0) : it->second.window;
+    }
+
+    void start() {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (running_) return;
+        running_ = true;
+        thread_  = std::thread(&WriteBehind::run, this);
+    }
+
+    /** Sends whatever is still queued, then stops the thread */
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (!running_) return;
+            running_ = false;
+        }
+        wake_.notify_all();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    /** Queue a write to a registered property. False if not running or not registered. */
+    bool post(const std::string& name, const std::string& value) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            auto it = props_.find(name);
+            if (!running_ || it == props_.end()) return false;
+            Slot& slot = it->second;
+            slot.value = value;
+            posted_++;
+            if (slot.queued) {
+                slot.elided++;
+                coalesced_++;
+                return true;
+            }
+            slot.queued = true;
+            slot.since  = Clock::now();
+            order_.push_back(name);
+        }
+        wake_.notify_all();
+        return true;
+    }
+
+    /** Latest value posted to name that the device has not acknowledged yet */
+    bool pending(const std::string& name, std::string& value) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        if (it != props_.end() && it->second.queued) {
+            value = it->second.value;
+            return true;
+        }
+        if (inFlight_ && current_ == name) {
+            value = currentValue_;
+            return true;
+        }
+        return false;
+    }
+
+    bool busy() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        return inFlight_ || !order_.empty();
+    }
+
+    /** Send without waiting out windows until busy() is false. False on timeout. */
+    bool flush(std::chrono::milliseconds timeout) {
+        std::unique_lock<std::mutex> guard(lock_);
+        if (!inFlight_ && order_.empty()) return true;
+        hurry_ = true;
+        wake_.notify_all();
+        return idle_.wait_for(guard, timeout, [this]() { return !inFlight_ && order_.empty(); });
+    }
+
+    /** First error since the last call, 0 if none */
+    int error() { return error_.exchange(0); }
+
+    /** Name of the property whose write failed last */
+    std::string failed() const {
+        std::lock_guard<std::mutex> guard(lock_);
+        return failed_;
+    }
+
+    size_t posted() const { return posted_; }
+    size_t sent() const { return sent_; }
+    /** Writes replaced by a later value before they were sent */
+    size_t coalesced() const { return coalesced_; }
+
+    /** Writes to name replaced by a later value before they were sent */
+    size_t elided(const std::string& name) const {
+        std::lock_guard<std::mutex> guard(lock_);
+        auto it = props_.find(name);
+        return it == props_.end() ? 0 : it->second.elided;
+    }
+
+ protected:
+    using Clock = std::chrono::steady_clock;
+
+    struct Slot {
+        Slot() : queued(false), window(0), elided(0) {}
+        bool queued;
+        std::string value;
+        Clock::time_point since; ///< when the queued write was first posted
+        std::chrono::milliseconds window;
+        size_t elided;
+    };
+
+    void run() {
+        std::unique_lock<std::mutex> guard(lock_);
+        while (running_ || !order_.empty()) {
+            if (order_.empty()) {
+                wake_.wait(guard, [this]() { return !running_ || !order_.empty(); });
+                continue;
+            }
+            const Slot& next = props_[order_.front()];
+            Clock::time_point due = next.since + next.window;
+            if (running_ && !hurry_ && Clock::now() < due) {
+                wake_.wait_until(guard, due);
+                continue;
+            }
+            current_ = order_.front();
+            order_.pop_front();
+            Slot& slot    = props_[current_];
+            slot.queued   = false;
+            currentValue_ = slot.value;
+            inFlight_     = true;
+
+            guard.unlock();
+            int ret = writer_(current_, currentValue_);
+            guard.lock();
+
+            sent_++;
+            if (ret != 0) {
+                int none = 0;
+                error_.compare_exchange_strong(none, ret);
+                failed_ = current_;
+            }
+            inFlight_ = false;
+            if (order_.empty()) {
+                hurry_ = false;
+                idle_.notify_all();
+            }
+        }
+    }
+
+    Writer writer_;
+    mutable std::mutex lock_;
+    std::condition_variable wake_;
+    std::condition_variable idle_;
+    std::thread thread_;
+    bool running_;
+    bool hurry_; ///< flush pending: ignore windows
+    std::map<std::string, Slot> props_;
+    std::deque<std::string> order_;
+    std::string current_;
+    std::string currentValue_;
+    bool inFlight_;
+    std::string failed_;
+    std::atomic<int> error_;
+    std::atomic<size_t> posted_;
+    std::atomic<size_t> sent_;
+    std::atomic<size_t> coalesced_;
+};
+
+#endif //_WriteBehind_H_
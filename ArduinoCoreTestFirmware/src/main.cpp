@@ -6,29 +6,93 @@
 #define JSONRPC_DEBUG_SERVER_DISPATCH 1
 
 #include <Ardulingua.h>
+#include <DispatchTime.h>
+#include <FlatDispatch.h>
+#include <LinkBaud.h>
+#include <LinkChannels.h>
+#include <LinkFixed.h>
+#include <LinkIdle.h>
+#include <LinkNotify.h>
+#include <LinkRx.h>
+#include <MethodIds.h>
+#include <PackedSequence.h>
+#include <SequencePlayer.h>
+#include <SequenceUpload.h>
+#include <ServerPorts.h>
+#include <TaskScheduler.h>
+#include <Telemetry.h>
 // #include <rdl/Logger.h>
 // #include <rdl/JsonDispatch.h>
 // #include <rdl/ServerProperty.h>
 #include <map>
-#include <unordered_map>
+
+// Sleep between events (WFI on Cortex-M). 0: loop() spins.
+#ifndef FIRMWARE_IDLE_SLEEP
+    #define FIRMWARE_IDLE_SLEEP 1
+#endif
+
+// Input pin for externally triggered sequence playback
+#ifndef PLAY_TRIGGER_PIN
+    #define PLAY_TRIGGER_PIN 2
+#endif
+
+// Move Serial input into serial_rx from serialEvent(), which the core calls
+// from yield() after every loop() pass and in delay() whenever Serial has
+// input: whole requests are counted as they arrive, with no timer waking
+// the core. Serial is USB on a Teensy, with no RX interrupt of its own to
+// hook, and the USB stack holds off the host when its buffers are full.
+// 0: loop() drains it first thing instead, for cores without serialEvent().
+#ifndef FIRMWARE_RX_EVENT
+    #if defined(TEENSYDUINO) && !defined(CTL_HOST_TIMER)
+        #define FIRMWARE_RX_EVENT 1
+    #else
+        #define FIRMWARE_RX_EVENT 0
+    #endif
+#endif
+
+#if !defined(CTL_HOST_TIMER)
+    // TimerThree has the same interface, for boards where Timer1's pins are taken
+    #include <TimerOne.h>
+#endif
 
 using namespace rdl;
 
-using StringT = String; // should work equally well for std::string and aruindo String
 using StreamT = decltype(Serial);
-using MapT = std::unordered_map<StringT, json_stub, sys::string_hash>;
+// Static perfect-hash table, no heap. Also dispatches "#<id>" methods by
+// index once the hub has asked for the ids. About 45 methods today, the
+// rest is room for more; setup() stops if any do not fit.
+using MapT = ctl::indexed_map<ctl::flat_dispatch<json_stub, 64>>;
+
+// Second JSON-RPC port, e.g. for a monitoring host, where the USB type has
+// one. The log moves to the third USB serial if there is one, else off.
+#if defined(USB_DUAL_SERIAL) || defined(USB_TRIPLE_SERIAL) || defined(CTL_HOST_MONITOR)
+    #define FIRMWARE_MONITOR_PORT SerialUSB1
+#endif
 
-#if defined(USB_DUAL_SERIAL) || defined(USB_TRIPLE_SERIAL)
-    auto logger = SerialUSB1;
-    void logger_begin() { SerialUSB1.begin(9600); while (!SerialUSB1) /*noop*/; }
+#if defined(USB_TRIPLE_SERIAL)
+    auto& logger = SerialUSB2;
+    void logger_begin() { SerialUSB2.begin(9600); while (!SerialUSB2) /*noop*/; }
 #else
     auto logger = Null_Print;
     void logger_begin() {}
 #endif
 
-StringT g_firmware_name("MM-Ardulingua");
+const char* const g_firmware_name = "MM-Ardulingua";
 const int g_firmware_version = 1;
 
+// RPC arguments arrive as const char* into the server's document and text
+// replies go out of this one buffer, which the server serializes before it
+// takes the next request: no String, so no heap, while serving. No reply
+// can be longer than the server's buffer anyway.
+constexpr size_t SERVER_BUFFER_SIZE = 512;
+char reply_text[SERVER_BUFFER_SIZE];
+
+/** reply_text if fill() wrote it, else an empty reply */
+template <class FillF>
+const char* reply(FillF fill) {
+    return fill(reply_text, sizeof(reply_text)) ? reply_text : "";
+}
+
 /** 
  * Firmware double check. 
  * Caller has to pass the correct firmware name to get a positive firmware version number.
@@ -36,17 +100,54 @@ const int g_firmware_version = 1;
  * 
  * Drivers can also call "?fname" to get the name first, then call get_firmware_version.
  */
-int get_firmware_version(StringT name) {
-    return (g_firmware_name == name) ? g_firmware_version : -1;
+int get_firmware_version(const char* name) {
+    return (name && strcmp(g_firmware_name, name) == 0) ? g_firmware_version : -1;
 }
 
+// Serial input, frame by frame. The server and the baud switch both
+// read from here; writes go straight to Serial.
+using RxT = ctl::framed_rx<StreamT, 1024>;
+RxT serial_rx(Serial);
+
+#if FIRMWARE_RX_EVENT
+    void serialEvent() { serial_rx.drain(); }
+#endif
+
+// The physical links, JSON text straight to the servers
+#ifdef FIRMWARE_MONITOR_PORT
+    ctl::StreamT* const links[] = {&serial_rx, &FIRMWARE_MONITOR_PORT};
+#else
+    ctl::StreamT* const links[] = {&serial_rx};
+#endif
+
+// Requests are served one per port in turn, port 0 is Serial
+ctl::round_robin<sizeof(links) / sizeof(links[0])> ports;
+
+int server_port() { return ports.current(); }
+
+// Serial rate. Starts at the rate the hub connects at, the hub can step it up.
+// Only from Serial: the other ports can not change it.
+ctl::baud_switch<RxT> link_rate(serial_rx, ctl::BAUD_DEFAULT);
+
+int baud_capabilities() { return ports.current() > 0 ? 0 : link_rate.capabilities(); }
+int baud_request(int index) { return ports.current() > 0 ? ctl::BAUD_ERROR_RATE : link_rate.request(index); }
+int baud_confirm() { return link_rate.confirm(); }
+
 // Start the dispatch map with some simple properties.
 // Other properties will be added in setup() below
 MapT dispatch_map {
-    {"?fname", json_delegate<RetT<StringT>>::create([](){return g_firmware_name;}).stub()},
-    {"?fver", json_delegate<RetT<int>,StringT>::create<get_firmware_version>().stub()},
+    {"?fname", json_delegate<RetT<const char*>>::create([](){return g_firmware_name;}).stub()},
+    {"?fver", json_delegate<RetT<int>,const char*>::create<get_firmware_version>().stub()},
 };
 
+/**
+ * Method id negotiation. Latches the (complete) dispatch map and returns
+ * its method names in id order.
+ */
+const char* method_ids() {
+    dispatch_map.index();
+    return reply([](char* text, size_t size) { return dispatch_map.table(text, size); });
+}
 
 rdl::simple_prop_base<int,32> foo("foo", 1, true);
 
@@ -59,25 +160,291 @@ decltype(bar0)::RootT* all_bars[] = {&bar0, &bar1, &bar2, &bar3};
 
 rdl::channel_prop_base<double, 4> bars("bar", all_bars, 4);
 
+// All four bar channels as one vector, so the hub can change them together
+decltype(bar0)* const bar_channels[] = {&bar0, &bar1, &bar2, &bar3};
+ctl::channel_group<decltype(bar0), 4> bar_group("bar", bar_channels);
+
+static_assert(sizeof(reply_text) >= decltype(bar_group)::TEXT_SIZE, "channel vector reply");
+
+const char* channels_get(const char* group) {
+    if (!group || strcmp(group, bar_group.name()) != 0) return "";
+    return reply([](char* text, size_t size) { return bar_group.get(text, size) != 0; });
+}
+
+int channels_set(const char* group, const char* data) {
+    if (!group || strcmp(group, bar_group.name()) != 0) return ctl::CHANNELS_ERROR_GROUP;
+    return bar_group.set(data);
+}
+
+// The bar channels as raw scaled integers, applied to the bar properties
+const char* const bar_names[] = {"bar0", "bar1", "bar2", "bar3"};
+ctl::fixed_channels<decltype(bar0), 4> bar_fixed(bar_names, bar_channels, ctl::BAR_FIXED);
+
+int fixed_get(const char* name) { return name ? bar_fixed.get(name) : ctl::FIXED_INVALID; }
+int fixed_set(const char* name, int raw) { return name ? bar_fixed.set(name, raw) : ctl::FIXED_ERROR_NAME; }
+
+// Loop and dispatch timing from the cycle counter where there is one
+#if defined(ARM_DWT_CYCCNT)
+    uint32_t telemetry_ticks() { return ARM_DWT_CYCCNT; }
+    const uint32_t telemetry_ticks_per_us = F_CPU / 1000000;
+#else
+    uint32_t telemetry_ticks() { return micros(); }
+    const uint32_t telemetry_ticks_per_us = 1;
+#endif
+
+ctl::firmware_telemetry<48> telemetry(telemetry_ticks, telemetry_ticks_per_us);
+
+// Time spent in the server per pass with input waiting
+const char* dispatch_stats(int reset) {
+    return reply([=](char* text, size_t size) { return telemetry.passes().text(text, size, reset != 0) != 0; });
+}
+
+const char* firmware_stats(int reset) {
+    telemetry.frame_errors(serial_rx.damaged());
+    return reply([=](char* text, size_t size) { return telemetry.text(text, size, reset != 0) != 0; });
+}
+
+const char* method_stats(int reset) {
+    telemetry.method_text(reply_text, sizeof(reply_text), reset != 0,
+                          [](size_t i) { return dispatch_map.begin()[i].first.c_str(); });
+    return reply_text;
+}
+
+
+// Bulk sequence storage, filled by chunked binary uploads from the hub.
+// Names match the server properties above. A/B buffered: the next sequence
+// uploads while the current one plays. Delta and run-length coded, in the
+// RAM raw stores of 1024 ints and 256 doubles took. Bar values are coded in
+// the 1e-4 steps of the bar channels (ctl::BAR_FIXED). Any sequence fits
+// 819 foo and 409 bar steps, what the hub advertises; sequences holding
+// each value 16 steps fit 9x (foo) and 18x (bar) the raw steps, ramps
+// more, and longer sequences that do not compress fail the upload.
+ctl::packed_sequence_store<int, 1024 * sizeof(int)> foo_seq("foo");
+ctl::packed_sequence_store<double, 256 * sizeof(double)> bar0_seq("bar0", ctl::BAR_FIXED);
+ctl::packed_sequence_store<double, 256 * sizeof(double)> bar1_seq("bar1", ctl::BAR_FIXED);
+ctl::packed_sequence_store<double, 256 * sizeof(double)> bar2_seq("bar2", ctl::BAR_FIXED);
+ctl::packed_sequence_store<double, 256 * sizeof(double)> bar3_seq("bar3", ctl::BAR_FIXED);
+
+ctl::upload_target* const upload_targets[] = {&foo_seq, &bar0_seq, &bar1_seq, &bar2_seq, &bar3_seq};
+
+// Hardware-timed playback of the sequence stores, stepped from an interrupt
+ctl::store_track<decltype(foo_seq), decltype(foo)> foo_track(foo_seq, foo);
+ctl::store_track<decltype(bar0_seq), decltype(bar0)> bar0_track(bar0_seq, bar0);
+ctl::store_track<decltype(bar1_seq), decltype(bar1)> bar1_track(bar1_seq, bar1);
+ctl::store_track<decltype(bar2_seq), decltype(bar2)> bar2_track(bar2_seq, bar2);
+ctl::store_track<decltype(bar3_seq), decltype(bar3)> bar3_track(bar3_seq, bar3);
+
+ctl::play_track* const play_tracks[] = {&foo_track, &bar0_track, &bar1_track, &bar2_track, &bar3_track};
+
+void play_tick();
+
+#if defined(CTL_HOST_TIMER)
+    // Provided by a host build, which polls it between loop() passes
+    extern ctl::sim_timer play_timer;
+    ctl::play_source* const play_trigger = nullptr;
+#else
+    ctl::timer_source<TimerOne> play_timer(Timer1, play_tick);
+    ctl::trigger_source play_trigger_pin(PLAY_TRIGGER_PIN, play_tick);
+    ctl::play_source* const play_trigger = &play_trigger_pin;
+#endif
+
+ctl::sequence_player<5> player(play_tracks, &play_timer, play_trigger);
+
+// The playback interrupt: a timer period or a trigger edge. It only stages
+// the step, the "play" task below sets the properties from loop().
+void play_tick() { player.tick(micros()); }
+
+int play_track_of(const char* target) { return player.track(target); }
+int play_start(int period_us, int flags, int tracks) {
+    return player.start(period_us, flags, static_cast<uint32_t>(tracks), micros());
+}
+int play_stop(int tracks) { return static_cast<int>(player.stop(static_cast<uint32_t>(tracks))); }
+
+const char* play_status(int reset) {
+    return reply([=](char* text, size_t size) { return player.text(text, size, reset != 0) != 0; });
+}
+
+int seq_capacity(const char* target) {
+    ctl::upload_target* t = ctl::find_target(upload_targets, target);
+    return t ? static_cast<int>(t->capacity()) : ctl::SEQ_ERROR_TARGET;
+}
+
+int seq_upload_begin(const char* target, int count) {
+    ctl::upload_target* t = ctl::find_target(upload_targets, target);
+    return t ? t->begin(count) : ctl::SEQ_ERROR_TARGET;
+}
+
+int seq_upload_chunk(const char* target, int offset, const char* data) {
+    ctl::upload_target* t = ctl::find_target(upload_targets, target);
+    return t && data ? t->chunk(offset, data) : ctl::SEQ_ERROR_TARGET;
+}
+
+const char* seq_memory(const char* target) {
+    ctl::upload_target* t = ctl::find_target(upload_targets, target);
+    if (!t) return "";
+    return reply([=](char* text, size_t size) { return t->memory_text(text, size) != 0; });
+}
+
+int seq_upload_end(const char* target, int crc) {
+    ctl::upload_target* t = ctl::find_target(upload_targets, target);
+    if (!t) return ctl::SEQ_ERROR_TARGET;
+    int count = t->end(crc);
+    // while playing, the player swaps it in at the end of the current sequence
+    if (count >= 0 && !player.running()) t->swap();
+    return count;
+}
+
+// Change notifications pushed to each port for the properties it subscribed
+ctl::prop_watch<decltype(foo)> foo_watch("foo", foo);
+ctl::prop_watch<decltype(bar0)> bar0_watch("bar0", bar0);
+ctl::prop_watch<decltype(bar1)> bar1_watch("bar1", bar1);
+ctl::prop_watch<decltype(bar2)> bar2_watch("bar2", bar2);
+ctl::prop_watch<decltype(bar3)> bar3_watch("bar3", bar3);
+
+ctl::value_watch* const watches[] = {&foo_watch, &bar0_watch, &bar1_watch, &bar2_watch, &bar3_watch};
+ctl::change_notifier<5, sizeof(links) / sizeof(links[0])> notifier(watches);
+
+int subscribe_changes(const char* name, int interval_ms) {
+    return notifier.subscribe(name, interval_ms, static_cast<size_t>(ports.current()));
+}
 
-// The server
-using ServerT = json_server<MapT, 512>;
-ServerT server(Serial, Serial, dispatch_map);
+// Batched read for the hub's poller, one round trip for all watched values
+const char* read_values(const char* names) {
+    if (!names) return "";
+    return reply([=](char* text, size_t size) { return notifier.values(names, text, size) != 0; });
+}
+
+// The servers, one per port with its own parse buffer, all on dispatch_map
+using ServerT = json_server<MapT, SERVER_BUFFER_SIZE>;
+ServerT server(serial_rx, serial_rx, dispatch_map);
+#ifdef FIRMWARE_MONITOR_PORT
+    ServerT monitor_server(FIRMWARE_MONITOR_PORT, FIRMWARE_MONITOR_PORT, dispatch_map);
+    ServerT* const servers[] = {&server, &monitor_server};
+#else
+    ServerT* const servers[] = {&server};
+#endif
+
+/** Waiting requests of one port, timed for telemetry */
+void serve_port(size_t port) {
+    dispatch_map.clear_found();
+    telemetry.pass_start(links[port]->available());
+    servers[port]->check_messages();
+    MapT::iterator method = dispatch_map.found();
+    telemetry.pass_end(method != dispatch_map.end() ? static_cast<int>(method - dispatch_map.begin()) : -1);
+}
+
+// The loop() services, most urgent first
+uint32_t scheduler_clock() { return micros(); }
+ctl::task_scheduler<4> scheduler(scheduler_clock);
+
+/** Serial once a whole frame is in, the other ports on any input */
+bool port_ready(size_t port) {
+    return port == 0 ? serial_rx.frames() > 0 : links[port]->available() > 0;
+}
+
+bool requests_waiting() {
+    for (size_t port = 0; port < ports.size(); port++) {
+        if (port_ready(port)) return true;
+    }
+    return false;
+}
+
+/**
+ * Work for the next loop() pass without waiting: Serial input not drained
+ * yet, a whole request, or a task signalled, e.g. a playback step staged.
+ */
+bool work_waiting() {
+    return Serial.available() > 0 || requests_waiting() || scheduler.pending();
+}
+
+// requests are handled as soon as they arrive, one port after the other
+void serve_requests() { ports.poll(port_ready, serve_port); }
+
+// notifications go out on the port that subscribed, next to its replies.
+// Their rate limits are in ms, so the 1 ms tick is soon enough.
+void send_notifications() { notifier.poll(millis(), links); }
+
+// staged playback steps, most urgent: they are late by as much as they wait
+void apply_steps() { player.apply(); }
+
+int play_task  = ctl::TASK_ERROR_FULL;
+int serve_task = ctl::TASK_ERROR_FULL;
+
+// From player, in the playback interrupt
+void step_staged() { scheduler.signal(play_task); }
+
+// From serial_rx, as it drains Serial: the request's wait counts from here
+void frame_arrived() { scheduler.signal(serve_task); }
+
+const char* scheduler_stats(int reset) {
+    return reply([=](char* text, size_t size) { return scheduler.text(text, size, reset != 0) != 0; });
+}
+
+void setup_tasks() {
+    play_task  = scheduler.event("play", apply_steps, nullptr, ctl::PLAY_MIN_PERIOD_US);
+    serve_task = scheduler.event("serve", serve_requests, requests_waiting, ctl::TASK_TICK_US);
+    scheduler.periodic("notify", send_notifications, ctl::TASK_TICK_US);
+    serial_rx.on_frame(frame_arrived);
+    player.on_step(step_staged);
+}
 
 void setup_dispatch() {
     add_to<MapT,decltype(foo)::RootT>(dispatch_map, foo, foo.sequencable(), foo.read_only());
     add_to<MapT,decltype(bars)::RooT>(dispatch_map, bars, bars.sequencable(-1), bars.read_only(-1));
+    dispatch_map.emplace(ctl::RPC_BAUD, json_delegate<RetT<int>>::create<baud_capabilities>().stub());
+    dispatch_map.emplace(ctl::RPC_BAUD_TRY, json_delegate<RetT<int>,int>::create<baud_request>().stub());
+    dispatch_map.emplace(ctl::RPC_BAUD_CONFIRM, json_delegate<RetT<int>>::create<baud_confirm>().stub());
+    dispatch_map.emplace(ctl::RPC_CHANNELS_GET, json_delegate<RetT<const char*>,const char*>::create<channels_get>().stub());
+    dispatch_map.emplace(ctl::RPC_CHANNELS_SET, json_delegate<RetT<int>,const char*,const char*>::create<channels_set>().stub());
+    dispatch_map.emplace(ctl::RPC_FIXED_GET, json_delegate<RetT<int>,const char*>::create<fixed_get>().stub());
+    dispatch_map.emplace(ctl::RPC_FIXED_SET, json_delegate<RetT<int>,const char*,int>::create<fixed_set>().stub());
+    dispatch_map.emplace(ctl::RPC_DISPATCH_TIME, json_delegate<RetT<const char*>,int>::create<dispatch_stats>().stub());
+    dispatch_map.emplace(ctl::RPC_STATS, json_delegate<RetT<const char*>,int>::create<firmware_stats>().stub());
+    dispatch_map.emplace(ctl::RPC_METHOD_STATS, json_delegate<RetT<const char*>,int>::create<method_stats>().stub());
+    dispatch_map.emplace(ctl::RPC_TASKS, json_delegate<RetT<const char*>,int>::create<scheduler_stats>().stub());
+    dispatch_map.emplace(ctl::RPC_PORT, json_delegate<RetT<int>>::create<server_port>().stub());
+    dispatch_map.emplace(ctl::RPC_METHOD_IDS, json_delegate<RetT<const char*>>::create<method_ids>().stub());
+    dispatch_map.emplace(ctl::RPC_SEQ_CAPACITY, json_delegate<RetT<int>,const char*>::create<seq_capacity>().stub());
+    dispatch_map.emplace(ctl::RPC_SEQ_BEGIN, json_delegate<RetT<int>,const char*,int>::create<seq_upload_begin>().stub());
+    dispatch_map.emplace(ctl::RPC_SEQ_CHUNK, json_delegate<RetT<int>,const char*,int,const char*>::create<seq_upload_chunk>().stub());
+    dispatch_map.emplace(ctl::RPC_SUBSCRIBE, json_delegate<RetT<int>,const char*,int>::create<subscribe_changes>().stub());
+    dispatch_map.emplace(ctl::RPC_VALUES, json_delegate<RetT<const char*>,const char*>::create<read_values>().stub());
+    dispatch_map.emplace(ctl::RPC_SEQ_END, json_delegate<RetT<int>,const char*,int>::create<seq_upload_end>().stub());
+    dispatch_map.emplace(ctl::RPC_SEQ_MEMORY, json_delegate<RetT<const char*>,const char*>::create<seq_memory>().stub());
+    dispatch_map.emplace(ctl::RPC_PLAY_TRACK, json_delegate<RetT<int>,const char*>::create<play_track_of>().stub());
+    dispatch_map.emplace(ctl::RPC_PLAY_START, json_delegate<RetT<int>,int,int,int>::create<play_start>().stub());
+    dispatch_map.emplace(ctl::RPC_PLAY_STOP, json_delegate<RetT<int>,int>::create<play_stop>().stub());
+    dispatch_map.emplace(ctl::RPC_PLAY_STATUS, json_delegate<RetT<const char*>,int>::create<play_status>().stub());
+    // the map is complete: build the hash. Until then find() searches.
+    dispatch_map.seal();
+}
+
+// A method left out of the dispatch map is a build error that only shows
+// at boot. Say so on the log and on Serial, where the hub sees a bad reply,
+// rather than run without it.
+void check_dispatch() {
+    if (dispatch_map.refused() == 0) return;
+    for (;;) {
+        logger.print("dispatch map refused ");
+        logger.print(static_cast<int>(dispatch_map.refused()));
+        logger.println(" methods: raise its capacity or shorten the names");
+        Serial.println("dispatch map full");
+        delay(1000);
+    }
 }
 
 void setup() {
 
-    Serial.begin(9600);
+    Serial.begin(link_rate.rate());
     Serial.setTimeout(2000); // longer timeout on virtual machine
     while (!Serial) {
         ; // wait for serial port to connect. Needed for native USB port only
     }
+#ifdef FIRMWARE_MONITOR_PORT
+    FIRMWARE_MONITOR_PORT.begin(link_rate.rate()); // no wait, the monitoring host is optional
+#endif
     logger_begin();
-    server.logger(&logger);
+    for (ServerT* s : servers) s->logger(&logger);
     logger.println("log started for ArduinoCoreTestFirmware");
 
     foo.logger(&logger);
@@ -88,7 +455,11 @@ void setup() {
     bar3.logger(&logger);
 
     setup_dispatch();
-    logger.println("Map methods:");
+    check_dispatch();
+    setup_tasks();
+    logger.print("Map methods (perfect hash: ");
+    logger.print(dispatch_map.perfect() ? "yes" : "no");
+    logger.println("):");
     for (auto p : dispatch_map) {
         logger.println(p.first.c_str());
     }
@@ -96,6 +467,15 @@ void setup() {
 }
 
 void loop() {
-    server.check_messages();
-    delay(1);
+    telemetry.loop_start();
+#if !FIRMWARE_RX_EVENT
+    serial_rx.drain();
+#endif
+    // while trying a new rate the switch owns the port
+    if (link_rate.poll(millis())) return;
+    scheduler.poll();
+#if FIRMWARE_IDLE_SLEEP
+    // until the next interrupt, USB or playback, or the 1 ms tick
+    ctl::wait_for_input(work_waiting);
+#endif
 }
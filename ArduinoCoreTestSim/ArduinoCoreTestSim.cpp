@@ -0,0 +1,175 @@
+///////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoCoreTestSim.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Loopback serial port to an in-process ArduinoCoreTestFirmware
+// LICENSE:       LGPL
+//
+
+#include "ArduinoCoreTestSim.h"
+#include "FirmwareSim.h"
+#include <ModuleInterface.h>
+#include <chrono>
+#include <cstring>
+#include <mutex>
+#include <thread>
+
+const char* g_linkSerial  = "Serial";
+const char* g_linkMonitor = "SerialUSB1";
+
+namespace {
+    std::mutex g_openLock;
+    int g_openPorts = 0; // the firmware runs while any port is open
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Exported MMDevice API
+///////////////////////////////////////////////////////////////////////////////
+MODULE_API void InitializeModuleData() {
+    RegisterDevice(g_deviceNameSimPort, MM::SerialDevice,
+                   "Loopback port to a simulated ArduinoCoreTestFirmware");
+}
+
+MODULE_API MM::Device* CreateDevice(const char* deviceName) {
+    if (deviceName == 0) return 0;
+    if (strcmp(deviceName, g_deviceNameSimPort) == 0) return new CSimPort;
+    return 0;
+}
+
+MODULE_API void DeleteDevice(MM::Device* pDevice) { delete pDevice; }
+
+///////////////////////////////////////////////////////////////////////////////
+// CSimPort implementation
+// ~~~~~~~~~~~~~~~~~~~~~~~
+//
+CSimPort::CSimPort() : initialized_(false), monitor_(false), answerTimeoutMs_(500.0), holdReplies_(false) {
+    InitializeDefaultErrorMessages();
+
+    // the settings the hub adjusts on a real port
+    CreateProperty(MM::g_Keyword_BaudRate, "57600", MM::String, false);
+    CreateProperty(MM::g_Keyword_Handshaking, "Off", MM::String, false);
+    CreateProperty(MM::g_Keyword_StopBits, "1", MM::String, false);
+    CreateProperty("DelayBetweenCharsMs", "0", MM::Float, false);
+    CPropertyAction* pAct = new CPropertyAction(this, &CSimPort::OnAnswerTimeout);
+    CreateProperty("AnswerTimeout", "500.0", MM::Float, false, pAct);
+
+    // the firmware's server port this one talks to
+    CreateProperty("Link", g_linkSerial, MM::String, false, nullptr, true);
+    AddAllowedValue("Link", g_linkSerial);
+    AddAllowedValue("Link", g_linkMonitor);
+    pAct = new CPropertyAction(this, &CSimPort::OnHoldReplies);
+    CreateProperty("HoldReplies", "0", MM::Integer, false, pAct);
+    AddAllowedValue("HoldReplies", "0");
+    AddAllowedValue("HoldReplies", "1");
+}
+
+CSimPort::~CSimPort() { Shutdown(); }
+
+void CSimPort::GetName(char* name) const {
+    CDeviceUtils::CopyLimitedString(name, g_deviceNameSimPort);
+}
+
+int CSimPort::Initialize() {
+    if (initialized_) return DEVICE_OK;
+    char link[MM::MaxStrLength];
+    GetProperty("Link", link);
+    monitor_ = strcmp(link, g_linkMonitor) == 0;
+    std::lock_guard<std::mutex> guard(g_openLock);
+    if (g_openPorts++ == 0) FirmwareSim::start();
+    initialized_ = true;
+    return DEVICE_OK;
+}
+
+int CSimPort::Shutdown() {
+    if (!initialized_) return DEVICE_OK;
+    std::lock_guard<std::mutex> guard(g_openLock);
+    if (--g_openPorts == 0) FirmwareSim::stop();
+    initialized_ = false;
+    return DEVICE_OK;
+}
+
+BytePipe& CSimPort::toFirmware() {
+    return monitor_ ? FirmwareSim::toMonitor() : FirmwareSim::toFirmware();
+}
+
+BytePipe& CSimPort::fromFirmware() {
+    return monitor_ ? FirmwareSim::fromMonitor() : FirmwareSim::fromFirmware();
+}
+
+int CSimPort::SetCommand(const char* command, const char* term) {
+    int ret = Write(reinterpret_cast<const unsigned char*>(command), strlen(command));
+    if (ret != DEVICE_OK || !term) return ret;
+    return Write(reinterpret_cast<const unsigned char*>(term), strlen(term));
+}
+
+int CSimPort::GetAnswer(char* answer, unsigned bufLength, const char* term) {
+    using namespace std::chrono;
+    if (!answer || bufLength == 0) return DEVICE_ERR;
+    size_t termLen = term ? strlen(term) : 0;
+    unsigned len   = 0;
+    auto deadline  = steady_clock::now() + microseconds(static_cast<long>(answerTimeoutMs_ * 1000));
+    BytePipe& rx   = fromFirmware();
+    while (len + 1 < bufLength) {
+        uint8_t c;
+        if (holdReplies_) {
+            if (steady_clock::now() >= deadline) {
+                answer[len] = '\0';
+                return DEVICE_SERIAL_TIMEOUT;
+            }
+            std::this_thread::sleep_for(milliseconds(1));
+            continue;
+        }
+        if (rx.read(&c, 1) == 0) {
+            auto left = duration_cast<microseconds>(deadline - steady_clock::now());
+            if (left.count() <= 0 || !rx.wait(left)) {
+                answer[len] = '\0';
+                return DEVICE_SERIAL_TIMEOUT;
+            }
+            continue;
+        }
+        answer[len++] = static_cast<char>(c);
+        if (termLen && len >= termLen && memcmp(answer + len - termLen, term, termLen) == 0) {
+            answer[len - termLen] = '\0';
+            return DEVICE_OK;
+        }
+    }
+    answer[len] = '\0';
+    return DEVICE_BUFFER_OVERFLOW;
+}
+
+int CSimPort::Write(const unsigned char* buf, unsigned long bufLen) {
+    if (!initialized_) return DEVICE_NOT_CONNECTED;
+    toFirmware().write(buf, bufLen);
+    return DEVICE_OK;
+}
+
+int CSimPort::Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead) {
+    charsRead = holdReplies_ ? 0 : static_cast<unsigned long>(fromFirmware().read(buf, bufLen));
+    return DEVICE_OK;
+}
+
+int CSimPort::Purge() {
+    fromFirmware().clear();
+    return DEVICE_OK;
+}
+
+int CSimPort::OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(answerTimeoutMs_);
+    } else if (eAct == MM::AfterSet) {
+        pProp->Get(answerTimeoutMs_);
+    }
+    return DEVICE_OK;
+}
+
+int CSimPort::OnHoldReplies(MM::PropertyBase* pProp, MM::ActionType eAct) {
+    if (eAct == MM::BeforeGet) {
+        pProp->Set(holdReplies_ ? 1L : 0L);
+    } else if (eAct == MM::AfterSet) {
+        long hold;
+        pProp->Get(hold);
+        holdReplies_ = hold != 0;
+    }
+    return DEVICE_OK;
+}
@@ -0,0 +1,66 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          ArduinoCoreTestSim.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Loopback serial port to an in-process ArduinoCoreTestFirmware.
+//                Lets the hub run end to end without hardware.
+// LICENSE:       LGPL
+//
+
+#ifndef _ArduinoCoreTestSim_H_
+#define _ArduinoCoreTestSim_H_
+
+#define NOMINMAX
+#include "DeviceBase.h"
+#include <atomic>
+#include <string>
+
+class BytePipe;
+
+const char* g_deviceNameSimPort = "ArduinoCoreTestSim-Port";
+
+/**
+ * @brief Serial port device whose other end is the simulated firmware.
+ *
+ * Use it as the hub's Port. Initialize starts the firmware loop, Shutdown
+ * of the last open port pauses it. BaudRate is accepted but not enforced,
+ * like native USB serial.
+ *
+ * Link picks the firmware's server port: Serial, the control port, or
+ * SerialUSB1, so two hubs can each have their own link to the one board.
+ * While HoldReplies is 1 the port reads nothing, as if the board had
+ * stopped answering; what it sent is read once HoldReplies is 0 again.
+ */
+class CSimPort : public CSerialBase<CSimPort> {
+ public:
+    CSimPort();
+    ~CSimPort();
+
+    int Initialize();
+    int Shutdown();
+    void GetName(char* pszName) const;
+    bool Busy() { return false; }
+
+    MM::PortType GetPortType() const { return MM::SerialPort; }
+
+    int SetCommand(const char* command, const char* term);
+    int GetAnswer(char* answer, unsigned bufLength, const char* term);
+    int Write(const unsigned char* buf, unsigned long bufLen);
+    int Read(unsigned char* buf, unsigned long bufLen, unsigned long& charsRead);
+    int Purge();
+
+    int OnAnswerTimeout(MM::PropertyBase* pProp, MM::ActionType eAct);
+    int OnHoldReplies(MM::PropertyBase* pProp, MM::ActionType eAct);
+
+ private:
+    BytePipe& toFirmware();
+    BytePipe& fromFirmware();
+
+    bool initialized_;
+    bool monitor_; ///< linked to SerialUSB1, fixed at Initialize
+    double answerTimeoutMs_;
+    std::atomic<bool> holdReplies_;
+};
+
+#endif //_ArduinoCoreTestSim_H_
@@ -0,0 +1,163 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          DuplexStream.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   In-memory serial line between the hub and the simulated firmware
+// LICENSE:       LGPL
+//
+
+#ifndef _DuplexStream_H_
+#define _DuplexStream_H_
+
+#include <Stream.h>
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <vector>
+
+/**
+ * @brief Wakes one thread waiting for input on any of several pipes.
+ *
+ * Pipes ring it after every write. The waiter checks its pipes under the
+ * bell's lock, so a write between the check and the wait still wakes it.
+ */
+class Doorbell {
+ public:
+    void ring() {
+        { std::lock_guard<std::mutex> guard(lock_); }
+        rung_.notify_all();
+    }
+
+    /** @return false on timeout. ready() must not ring this bell. */
+    template <class ReadyF>
+    bool wait(std::chrono::microseconds timeout, ReadyF ready) {
+        std::unique_lock<std::mutex> guard(lock_);
+        return rung_.wait_for(guard, timeout, ready);
+    }
+
+ protected:
+    std::mutex lock_;
+    std::condition_variable rung_;
+};
+
+/**
+ * @brief One direction of the simulated serial line.
+ *
+ * Any thread may write or read. The hub side purges and reads from
+ * different threads (MMCore and the link reader), so this is a plain
+ * locked queue rather than an SPSC ring. The bytes sit in a ring that only
+ * grows, so steady traffic never allocates: the firmware's heap test
+ * counts every allocation the firmware thread makes, writes included.
+ */
+class BytePipe {
+ public:
+    BytePipe(size_t capacity = 64 * 1024) : ring_(capacity) {}
+
+    void write(const uint8_t* data, size_t size) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (size_ + size > ring_.size()) grow(size_ + size);
+            for (size_t i = 0; i < size; i++) ring_[(head_ + size_ + i) % ring_.size()] = data[i];
+            size_ += size;
+        }
+        ready_.notify_all();
+        if (bell_) bell_->ring();
+    }
+
+    /** Also ring bell on every write, e.g. to wait on several pipes */
+    void attach(Doorbell* bell) { bell_ = bell; }
+
+    /** Non-blocking. @return bytes read */
+    size_t read(uint8_t* data, size_t size) {
+        std::lock_guard<std::mutex> guard(lock_);
+        size_t n = size < size_ ? size : size_;
+        for (size_t i = 0; i < n; i++) data[i] = ring_[(head_ + i) % ring_.size()];
+        head_ = (head_ + n) % ring_.size();
+        size_ -= n;
+        return n;
+    }
+
+    int peek() {
+        std::lock_guard<std::mutex> guard(lock_);
+        return size_ == 0 ? -1 : ring_[head_];
+    }
+
+    size_t available() {
+        std::lock_guard<std::mutex> guard(lock_);
+        return size_;
+    }
+
+    void clear() {
+        std::lock_guard<std::mutex> guard(lock_);
+        head_ = size_ = 0;
+    }
+
+    /** @return false on timeout */
+    bool wait(std::chrono::microseconds timeout) {
+        std::unique_lock<std::mutex> guard(lock_);
+        return ready_.wait_for(guard, timeout, [this]() { return size_ != 0; });
+    }
+
+ protected:
+    /** Unwraps the bytes into a ring of at least need */
+    void grow(size_t need) {
+        std::vector<uint8_t> bigger(std::max(need, 2 * ring_.size()));
+        for (size_t i = 0; i < size_; i++) bigger[i] = ring_[(head_ + i) % ring_.size()];
+        ring_.swap(bigger);
+        head_ = 0;
+    }
+
+    std::mutex lock_;
+    std::condition_variable ready_;
+    std::vector<uint8_t> ring_;
+    size_t head_ = 0; ///< oldest byte
+    size_t size_ = 0;
+    Doorbell* bell_ = nullptr;
+};
+
+/**
+ * @brief Arduino Stream end of a pair of BytePipes.
+ *
+ * Also has the HardwareSerial bits the firmware uses (begin, end, bool),
+ * so it can stand in for Serial. The baud rate is recorded, not enforced,
+ * like a native USB serial port.
+ */
+class DuplexStream : public arduino::Stream {
+ public:
+    DuplexStream(BytePipe& rx, BytePipe& tx) : rx_(rx), tx_(tx) {}
+
+    void begin(unsigned long baud) { baud_ = baud; }
+    void end() {}
+    explicit operator bool() const { return true; }
+    unsigned long baud() const { return baud_; }
+
+    // Print interface
+
+    size_t write(uint8_t c) override {
+        tx_.write(&c, 1);
+        return 1;
+    }
+    size_t write(const uint8_t* buffer, size_t size) override {
+        tx_.write(buffer, size);
+        return size;
+    }
+    void flush() override {}
+
+    // Stream interface
+
+    int available() override { return static_cast<int>(rx_.available()); }
+    int read() override {
+        uint8_t c;
+        return rx_.read(&c, 1) ? c : -1;
+    }
+    int peek() override { return rx_.peek(); }
+
+ protected:
+    BytePipe& rx_;
+    BytePipe& tx_;
+    unsigned long baud_ = 0;
+};
+
+#endif //_DuplexStream_H_
@@ -0,0 +1,105 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          FirmwareSim.cpp
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   ArduinoCoreTestFirmware running on a host thread.
+//                host/Arduino.h stands in for the board header.
+// LICENSE:       LGPL
+//
+
+#include "FirmwareSim.h"
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+
+namespace {
+    BytePipe g_toFirmware;
+    BytePipe g_fromFirmware;
+    BytePipe g_toMonitor;
+    BytePipe g_fromMonitor;
+    Doorbell g_rx; // either host wrote
+}
+
+DuplexStream Serial(g_toFirmware, g_fromFirmware);
+DuplexStream SerialUSB1(g_toMonitor, g_fromMonitor);
+
+// The firmware idles in ctl::host_idle() below instead of WFI
+#define CTL_HOST_IDLE 1
+// Sequence playback runs off play_timer below instead of TimerOne
+#define CTL_HOST_TIMER 1
+// A second server port on SerialUSB1, like a dual serial USB board
+#define CTL_HOST_MONITOR 1
+
+// The unmodified firmware. Defines setup(), loop() and all firmware globals.
+#include "../ArduinoCoreTestFirmware/src/main.cpp"
+
+namespace {
+    uint32_t playClock() { return static_cast<uint32_t>(micros()); }
+
+    /** The timer interrupt, taken between loop() passes on the firmware thread */
+    void pollPlayTimer() {
+        if (play_timer.due()) play_tick();
+    }
+}
+
+ctl::sim_timer play_timer(playClock);
+
+// Stands in for WFI: either host writing is the RX interrupt, the timeout
+// the 1 ms tick or the next playback timer period, whichever comes first
+void ctl::host_idle() {
+    std::chrono::microseconds timeout(1000);
+    if (play_timer.running()) {
+        int32_t until = static_cast<int32_t>(play_timer.next() - playClock());
+        timeout = std::chrono::microseconds(until < 0 ? 0 : until < 1000 ? until : 1000);
+    }
+    g_rx.wait(timeout, []() { return g_toFirmware.available() > 0 || g_toMonitor.available() > 0; });
+    pollPlayTimer();
+}
+
+namespace {
+    std::mutex g_lock; // start/stop
+    std::thread g_thread;
+    std::atomic<bool> g_running(false);
+    std::atomic<unsigned long> g_loops(0);
+    bool g_setupDone = false;
+
+    void runFirmware() {
+        if (!g_setupDone) {
+            setup();
+            g_setupDone = true;
+        }
+        while (g_running) {
+            loop();
+            pollPlayTimer();
+            g_loops++;
+        }
+    }
+}
+
+namespace FirmwareSim {
+    BytePipe& toFirmware() { return g_toFirmware; }
+    BytePipe& fromFirmware() { return g_fromFirmware; }
+    BytePipe& toMonitor() { return g_toMonitor; }
+    BytePipe& fromMonitor() { return g_fromMonitor; }
+
+    void start() {
+        std::lock_guard<std::mutex> guard(g_lock);
+        if (g_running) return;
+        // before the thread: the host may write as soon as start() returns
+        g_toFirmware.attach(&g_rx);
+        g_toMonitor.attach(&g_rx);
+        g_running = true;
+        g_thread  = std::thread(runFirmware);
+    }
+
+    void stop() {
+        std::lock_guard<std::mutex> guard(g_lock);
+        g_running = false;
+        if (g_thread.joinable()) g_thread.join();
+    }
+
+    bool running() { return g_running; }
+    unsigned long loops() { return g_loops; }
+}
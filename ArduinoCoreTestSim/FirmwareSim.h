@@ -0,0 +1,39 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          FirmwareSim.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   ArduinoCoreTestFirmware running on a host thread
+// LICENSE:       LGPL
+//
+
+#ifndef _FirmwareSim_H_
+#define _FirmwareSim_H_
+
+#include "DuplexStream.h"
+
+/**
+ * @brief The firmware's setup()/loop(), built against ArduinoCore-host.
+ *
+ * The firmware keeps its state in globals, so there is one simulated board
+ * per process. start() runs setup() the first time and then loop() on a
+ * thread until stop(). Stopping only pauses the loop: state and any bytes
+ * in flight survive, like a board whose host port was closed and reopened.
+ */
+namespace FirmwareSim {
+    /** Bytes written by the host, read by the firmware's Serial */
+    BytePipe& toFirmware();
+    /** Bytes written by the firmware's Serial, read by the host */
+    BytePipe& fromFirmware();
+    /** The same for the second server port, SerialUSB1, e.g. a monitoring host */
+    BytePipe& toMonitor();
+    BytePipe& fromMonitor();
+
+    void start();
+    void stop();
+    bool running();
+    /** Completed loop() passes since the first start */
+    unsigned long loops();
+}
+
+#endif //_FirmwareSim_H_
@@ -0,0 +1,29 @@
+//////////////////////////////////////////////////////////////////////////////
+// FILE:          Arduino.h
+// PROJECT:       Micro-Manager
+// SUBSYSTEM:     DeviceAdapters
+//-----------------------------------------------------------------------------
+// DESCRIPTION:   Board header for building the firmware against ArduinoCore-host.
+//                Only on the include path of FirmwareSim.cpp.
+// LICENSE:       LGPL
+//
+
+#ifndef _SimArduino_H_
+#define _SimArduino_H_
+
+// millis(), delay() etc. come from ArduinoCore-host
+#include <Common.h>
+#include <Print.h>
+#include <Stream.h>
+#include <WString.h>
+#include "../DuplexStream.h"
+
+// as on a board, the core API is in the global namespace
+using namespace arduino;
+
+/** The firmware's end of the simulated serial line */
+extern DuplexStream Serial;
+/** Its second server port, as on a dual serial USB board */
+extern DuplexStream SerialUSB1;
+
+#endif //_SimArduino_H_
@@ -37,9 +37,9 @@ namespace sproto {
             : base_t(), stream_(stream), timeout_(timeout) {
         }
 
-        /** Start the output stream */
-        void begin() {
-            stream_.begin(115200);
+        /** Start the output stream. Native USB ports ignore the baud rate. */
+        void begin(unsigned long baud = 115200) {
+            stream_.begin(baud);
             while (!stream_) {
                 ; // wait for serial port to connect. Needed for native USB port only
             }
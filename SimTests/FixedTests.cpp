@@ -0,0 +1,82 @@
+// FixedTests.cpp : Fixed-point writes land in the bar properties themselves.
+//
+// The hub's barA in FixedPoint wire format sends "!fx bar0 <raw>". The raw
+// value must reach the firmware's bar0 property, which the poller reads
+// through "?vals", the channel vector through "?chv" and "?fx" itself. A
+// separate raw channel once took the write while everything else kept
+// reading the old decimal.
+
+#define NOMINMAX
+
+#include "SimTests.h"
+#include "../ArduinoCoreTestSim/FirmwareSim.h"
+#include <LinkChannels.h>
+#include <LinkFixed.h>
+#include <LinkNotify.h>
+#include <rdl/JsonDelegate.h>
+#include <rdl/JsonDispatch.h>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+int TestFirmwareFixedPoint()
+{
+	using namespace std;
+	int failures = 0;
+	auto check = [&](bool ok, const char* what) {
+		if (!ok) {
+			cout << "FAILED: " << what << endl;
+			failures++;
+		}
+	};
+
+	cout << "==== Firmware fixed-point channels ====" << endl;
+	DuplexStream host(FirmwareSim::fromFirmware(), FirmwareSim::toFirmware());
+	rdl::json_client<512> client(host, host);
+
+	const int32_t raw = 123456;
+	const double expected = ctl::BAR_FIXED.value(raw);
+	int reply = 0;
+	string text, initial;
+	check(!client.call_get<rdl::RetT<string>, string>(ctl::RPC_CHANNELS_GET, initial, "bar"), "?chv bar");
+	check(!client.call_get<rdl::RetT<int>, string, int>(ctl::RPC_FIXED_SET, reply, "bar0", raw) && reply == 0,
+		  "!fx bar0");
+
+	check(!client.call_get<rdl::RetT<string>, string>(ctl::RPC_VALUES, text, "bar0"), "?vals bar0");
+	double polled = atof(text.c_str());
+	cout << "!fx bar0 " << raw << ", ?vals bar0: " << text << endl;
+	check(fabs(polled - expected) < ctl::BAR_FIXED.scale / 2, "?vals does not read back the fixed-point write");
+
+	check(!client.call_get<rdl::RetT<string>, string>(ctl::RPC_CHANNELS_GET, text, "bar"), "?chv bar");
+	uint8_t packed[4 * sizeof(double)];
+	int n = ctl::base64_decode(packed, sizeof(packed), text.c_str(), text.size());
+	double channel = n == static_cast<int>(sizeof(packed)) ? ctl::unpack_le<double>(packed) : NAN;
+	cout << "?chv bar, first channel: " << channel << endl;
+	check(fabs(channel - expected) < ctl::BAR_FIXED.scale / 2, "?chv does not read back the fixed-point write");
+
+	check(!client.call_get<rdl::RetT<int>, string>(ctl::RPC_FIXED_GET, reply, "bar0") && reply == raw,
+		  "?fx bar0 does not return the raw value set");
+
+	// a decimal write through the channel vector reads back as raw
+	ctl::pack_le<double>(packed, 2.5);
+	char b64[4 * sizeof(packed) / 3 + 4];
+	size_t nc = ctl::base64_encode(b64, sizeof(b64), packed, sizeof(packed));
+	check(!client.call_get<rdl::RetT<int>, string, string>(ctl::RPC_CHANNELS_SET, reply, "bar", string(b64, nc)) &&
+			  reply == 4,
+		  "!chv bar");
+	check(!client.call_get<rdl::RetT<int>, string>(ctl::RPC_FIXED_GET, reply, "bar0") && reply == 25000,
+		  "?fx bar0 does not read the decimal write");
+
+	check(!client.call_get<rdl::RetT<int>, string, int>(ctl::RPC_FIXED_SET, reply, "baz", raw) &&
+			  reply == ctl::FIXED_ERROR_NAME,
+		  "!fx of an unknown channel");
+	check(!client.call_get<rdl::RetT<int>, string, int>(ctl::RPC_FIXED_SET, reply, "bar0", ctl::FIXED_INVALID) &&
+			  reply == ctl::FIXED_ERROR_VALUE,
+		  "!fx of FIXED_INVALID");
+
+	// leave the bars as the firmware starts them
+	client.call_get<rdl::RetT<int>, string, string>(ctl::RPC_CHANNELS_SET, reply, "bar", initial);
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,167 @@
+// HeapTests.cpp : The firmware's request path never touches the heap.
+//
+// A json_client on the host end of the simulated serial line makes calls
+// through the firmware's real json_server and dispatch_map: string and int
+// arguments, string and int returns, the RPCs that once built Strings.
+// Every malloc in the process is counted, except on the test's own thread,
+// whose client and std::strings are not firmware. After a warm-up pass the
+// firmware thread must not allocate once, however many requests it serves.
+// A board runs for days on a heap that fragments, the host does not.
+
+#define NOMINMAX
+
+#include "SimTests.h"
+#include "../ArduinoCoreTestSim/FirmwareSim.h"
+#include <DispatchTime.h>
+#include <LinkChannels.h>
+#include <LinkFixed.h>
+#include <LinkNotify.h>
+#include <MethodIds.h>
+#include <SequenceUpload.h>
+#include <rdl/JsonDelegate.h>
+#include <rdl/JsonDispatch.h>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+
+namespace {
+	std::atomic<bool> g_counting(false);
+	std::atomic<long> g_allocations(0);
+	thread_local bool t_host = false; // the test's thread, not counted
+
+	void noteAllocation()
+	{
+		if (g_counting && !t_host) g_allocations++;
+	}
+}
+
+// Count at malloc, under operator new, String and any ArduinoJson allocator
+#if defined(_MSC_VER) && defined(_DEBUG)
+#include <crtdbg.h>
+
+namespace {
+	int countingHook(int type, void*, size_t, int, long, const unsigned char*, int)
+	{
+		if (type == _HOOK_ALLOC || type == _HOOK_REALLOC) noteAllocation();
+		return TRUE;
+	}
+
+	bool installHook()
+	{
+		_CrtSetAllocHook(countingHook);
+		return true;
+	}
+}
+#elif defined(__GLIBC__)
+extern "C" {
+	void* __libc_malloc(size_t size);
+	void* __libc_calloc(size_t count, size_t size);
+	void* __libc_realloc(void* p, size_t size);
+
+	void* malloc(size_t size)
+	{
+		noteAllocation();
+		return __libc_malloc(size);
+	}
+	void* calloc(size_t count, size_t size)
+	{
+		noteAllocation();
+		return __libc_calloc(count, size);
+	}
+	void* realloc(void* p, size_t size)
+	{
+		noteAllocation();
+		return __libc_realloc(p, size);
+	}
+}
+
+namespace {
+	bool installHook() { return true; }
+}
+#else
+namespace {
+	bool installHook() { return false; }
+}
+#endif
+
+namespace {
+	using ClientT = rdl::json_client<512>;
+
+	/**
+	 * One of each call, checked where the reply is known.
+	 * @return failed calls, dispatches counts the requests
+	 */
+	int callRound(ClientT& client, long i, long& dispatches)
+	{
+		int failed = 0;
+		auto check = [&](int error, bool ok) {
+			dispatches++;
+			if (error || !ok) failed++;
+		};
+		std::string text;
+		int value = 0;
+
+		check(client.call_get<rdl::RetT<std::string>>("?fname", text), text == "MM-Ardulingua");
+		check(client.call_get<rdl::RetT<int>, std::string>("?fver", value, text), value >= 0);
+
+		int raw = static_cast<int>(i % 1000);
+		check(client.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_FIXED_SET, value, "bar1", raw), true);
+		check(client.call_get<rdl::RetT<int>, std::string>(ctl::RPC_FIXED_GET, value, "bar1"), value == raw);
+
+		check(client.call_get<rdl::RetT<std::string>, std::string>(ctl::RPC_CHANNELS_GET, text, "bar"), !text.empty());
+		check(client.call_get<rdl::RetT<int>, std::string, std::string>(ctl::RPC_CHANNELS_SET, value, "bar", text),
+			  value >= 0);
+
+		check(client.call_get<rdl::RetT<std::string>, std::string>(ctl::RPC_VALUES, text, "foo bar0 bar1"),
+			  !text.empty());
+		check(client.call_get<rdl::RetT<std::string>, int>(ctl::RPC_DISPATCH_TIME, text, 0), !text.empty());
+		check(client.call_get<rdl::RetT<std::string>, std::string>(ctl::RPC_SEQ_MEMORY, text, "foo"), !text.empty());
+		check(client.call_get<rdl::RetT<std::string>>(ctl::RPC_METHOD_IDS, text), !text.empty());
+		return failed;
+	}
+}
+
+int TestFirmwareHeap(long ndispatches)
+{
+	using namespace std;
+	using namespace std::chrono;
+	int failures = 0;
+	t_host = true;
+
+	cout << "==== Firmware heap ====" << endl;
+	if (!installHook()) {
+		cout << "allocations not counted in this build" << endl << endl;
+		return 0;
+	}
+
+	DuplexStream host(FirmwareSim::fromFirmware(), FirmwareSim::toFirmware());
+	ClientT client(host, host);
+
+	// first calls may grow the pipes or set up statics
+	long dispatches = 0;
+	int failed = 0;
+	for (long i = 0; i < 10; i++) failed += callRound(client, i, dispatches);
+
+	dispatches = 0;
+	g_allocations = 0;
+	g_counting = true;
+	auto start = steady_clock::now();
+	for (long i = 0; dispatches < ndispatches; i++) failed += callRound(client, i, dispatches);
+	double seconds = duration<double>(steady_clock::now() - start).count();
+	g_counting = false;
+
+	cout << dispatches << " dispatches, " << g_allocations << " firmware allocations, "
+		<< 1e6 * seconds / dispatches << " us per call" << endl;
+	if (failed) {
+		cout << "FAILED: " << failed << " calls with errors or wrong replies" << endl;
+		failures++;
+	}
+	if (g_allocations != 0) {
+		cout << "FAILED: the firmware allocated serving requests" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,159 @@
+// PortTests.cpp : Both server ports of the firmware at once.
+//
+// A control host on Serial and a monitoring host on SerialUSB1 each run a
+// json_client on their own thread against the firmware's real json_servers
+// and shared dispatch_map. Every reply must come back on the port that
+// asked, "?port" included. The monitor subscribes to foo and unsubscribes
+// again, then subscribes to bar0, while the control host subscribes to foo:
+// once foo and bar0 play, the control port must see foo notifications only
+// and the monitor bar0 only. One shared subscription table sent everything
+// to Serial and let the monitor's unsubscribe silence the hub.
+
+#define NOMINMAX
+
+#include "SimTests.h"
+#include "../ArduinoCoreTestSim/FirmwareSim.h"
+#include <LinkNotify.h>
+#include <SequencePlayer.h>
+#include <SequenceUpload.h>
+#include <ServerPorts.h>
+#include <rdl/JsonDelegate.h>
+#include <rdl/JsonDispatch.h>
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using ClientT = rdl::json_client<512>;
+
+	/** Chunked upload, as the hub sends it. @return RPC_SEQ_END reply or the first error */
+	template <typename T>
+	int upload(ClientT& client, const char* target, const std::vector<T>& values)
+	{
+		const size_t perChunk = ctl::SEQ_CHUNK_BYTES / sizeof(T);
+		const int count = static_cast<int>(values.size());
+		uint8_t raw[ctl::SEQ_CHUNK_BYTES];
+		char b64[4 * ctl::SEQ_CHUNK_BYTES / 3 + 1];
+		uint16_t crc = ctl::CRC16_INIT;
+		int reply = 0;
+		int error = client.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SEQ_BEGIN, reply, target, count);
+		if (error || reply != count) return error ? error : reply;
+		for (int offset = 0; offset < count; offset = reply) {
+			size_t n = std::min(perChunk, static_cast<size_t>(count - offset));
+			for (size_t i = 0; i < n; i++) ctl::pack_le<T>(raw + i * sizeof(T), values[offset + i]);
+			crc = ctl::crc16(raw, n * sizeof(T), crc);
+			size_t nc = ctl::base64_encode(b64, sizeof(b64), raw, n * sizeof(T));
+			error = client.call_get<rdl::RetT<int>, std::string, int, std::string>(ctl::RPC_SEQ_CHUNK, reply, target,
+																				  offset, std::string(b64, nc));
+			if (error || reply != offset + static_cast<int>(n)) return error ? error : reply;
+		}
+		error = client.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SEQ_END, reply, target, crc);
+		return error ? error : reply;
+	}
+
+	/** Subscriptions and ?port calls of one host. @return failed calls */
+	int hostRound(ClientT& client, int port, const std::vector<std::pair<std::string, int>>& subscriptions,
+				  int nrequests)
+	{
+		int failed = 0;
+		int reply = 0;
+		for (const auto& sub : subscriptions) {
+			int error = client.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SUBSCRIBE, reply, sub.first,
+																		   sub.second);
+			if (error || reply != 0) failed++;
+		}
+		for (int i = 0; i < nrequests; i++) {
+			int error = client.call_get<rdl::RetT<int>>(ctl::RPC_PORT, reply);
+			if (error || reply != port) failed++;
+		}
+		return failed;
+	}
+
+	/** Names of the notification frames in bytes read from a port */
+	std::vector<std::string> notifications(BytePipe& pipe)
+	{
+		std::vector<std::string> names;
+		std::vector<uint8_t> frame;
+		uint8_t c;
+		while (pipe.read(&c, 1)) {
+			if (c != ctl::SLIP_END) {
+				frame.push_back(c);
+				continue;
+			}
+			const char *name, *value;
+			size_t nameSize, valueSize;
+			if (ctl::parse_notification(frame.data(), frame.size(), name, nameSize, value, valueSize)) {
+				names.emplace_back(name, nameSize);
+			}
+			frame.clear();
+		}
+		return names;
+	}
+}
+
+int TestFirmwarePorts(int nrequests)
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Firmware server ports ====" << endl;
+	DuplexStream controlHost(FirmwareSim::fromFirmware(), FirmwareSim::toFirmware());
+	DuplexStream monitorHost(FirmwareSim::fromMonitor(), FirmwareSim::toMonitor());
+	ClientT control(controlHost, controlHost), monitor(monitorHost, monitorHost);
+
+	int controlFailed = 0, monitorFailed = 0;
+	thread monitorThread([&]() {
+		monitorFailed = hostRound(monitor, 1, {{"foo", 0}, {"foo", -1}, {"bar0", 0}}, nrequests);
+	});
+	controlFailed = hostRound(control, 0, {{"foo", 0}}, nrequests);
+	monitorThread.join();
+	cout << nrequests << " requests on each port at once, " << controlFailed << " and " << monitorFailed
+		<< " failed" << endl;
+	if (controlFailed || monitorFailed) {
+		cout << "FAILED: replies missing or answered as the other port" << endl;
+		failures++;
+	}
+
+	// play foo and bar0 once, a step a millisecond
+	const size_t steps = 64;
+	vector<int> fooSteps;
+	vector<double> barSteps;
+	for (size_t i = 0; i < steps; i++) {
+		fooSteps.push_back(static_cast<int>(100 + i));
+		barSteps.push_back(0.25 * i);
+	}
+	int fooTrack = 0, barTrack = 0, started = 0;
+	bool ready = upload(control, "foo", fooSteps) == static_cast<int>(steps) &&
+				 upload(control, "bar0", barSteps) == static_cast<int>(steps) &&
+				 !control.call_get<rdl::RetT<int>, std::string>(ctl::RPC_PLAY_TRACK, fooTrack, "foo") &&
+				 !control.call_get<rdl::RetT<int>, std::string>(ctl::RPC_PLAY_TRACK, barTrack, "bar0") &&
+				 fooTrack >= 0 && barTrack >= 0 &&
+				 !control.call_get<rdl::RetT<int>, int, int, int>(ctl::RPC_PLAY_START, started, 1000, 0,
+																	(1 << fooTrack) | (1 << barTrack)) &&
+				 started == 0;
+	this_thread::sleep_for(chrono::milliseconds(3 * steps));
+
+	size_t controlFoo = 0, controlOther = 0, monitorBar = 0, monitorOther = 0;
+	for (const string& name : notifications(FirmwareSim::fromFirmware())) (name == "foo" ? controlFoo : controlOther)++;
+	for (const string& name : notifications(FirmwareSim::fromMonitor())) (name == "bar0" ? monitorBar : monitorOther)++;
+	cout << "control port: " << controlFoo << " foo and " << controlOther << " other notifications; monitor port: "
+		<< monitorBar << " bar0 and " << monitorOther << " other" << endl;
+	if (!ready) {
+		cout << "FAILED: could not upload and start foo and bar0" << endl;
+		failures++;
+	}
+	if (controlFoo == 0 || controlOther != 0 || monitorBar == 0 || monitorOther != 0) {
+		cout << "FAILED: notifications not on the port that subscribed" << endl;
+		failures++;
+	}
+
+	// leave the ports as the other tests expect them
+	int reply = 0;
+	control.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SUBSCRIBE, reply, "foo", -1);
+	monitor.call_get<rdl::RetT<int>, std::string, int>(ctl::RPC_SUBSCRIBE, reply, "bar0", -1);
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,13 @@
+// SimTests.h : Tests of the unmodified firmware, running in-process on
+// FirmwareSim and driven through its serial pipes. No MMCore and no hub.
+// Each returns the number of failed checks.
+//
+
+#pragma once
+
+/** Fixed-point writes read back through the decimal and channel RPCs */
+int TestFirmwareFixedPoint();
+/** Heap allocations by the firmware over ndispatches requests through its json_server */
+int TestFirmwareHeap(long ndispatches);
+/** Requests on both server ports at once, and where each port's notifications go */
+int TestFirmwarePorts(int nrequests);
@@ -0,0 +1,20 @@
+// SimTestsMain.cpp : Runs the firmware simulator tests.
+//
+// SimTests [dispatches]: requests for the heap test, default one million
+
+#include "SimTests.h"
+#include "../ArduinoCoreTestSim/FirmwareSim.h"
+#include <cstdlib>
+
+int main(int argc, char* argv[])
+{
+	long ndispatches = argc > 1 ? atol(argv[1]) : 1000000;
+
+	FirmwareSim::start();
+	int failures = 0;
+	failures += TestFirmwareHeap(ndispatches);
+	failures += TestFirmwarePorts(1000);
+	failures += TestFirmwareFixedPoint();
+	FirmwareSim::stop();
+	return failures ? 1 : 0;
+}
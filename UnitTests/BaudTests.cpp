@@ -0,0 +1,352 @@
+// BaudTests.cpp : Baud rate negotiation over a simulated serial line.
+//
+// The hub end opens the line, the simulated firmware runs ctl::baud_switch
+// on the other end. Both ends share the line settings, so the rate the hub
+// opened the port at is the line rate. The firmware end garbles every byte
+// while its own rate differs from the line rate, and above a simulated cable
+// limit, the way a real UART produces framing errors.
+//
+// On POSIX the line is a pty, so the rate change goes through termios as it
+// does on a real port. Windows has no pty; there the line is a pair of
+// BytePipes with the rate alongside, which exercises the same negotiation.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/BaudNegotiator.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#include "../ArduinoCoreTestSim/DuplexStream.h"
+#else
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#endif
+
+namespace {
+	using namespace std::chrono;
+
+	/** Both ends of one serial line. End 0 is the hub's, end 1 the firmware's. */
+	class SimLine {
+	public:
+		virtual ~SimLine() {}
+		virtual bool ok() const = 0;
+		virtual size_t write(int end, uint8_t c) = 0;
+		virtual int available(int end) = 0;
+		virtual int read(int end) = 0;
+		/** the rate both ends run at, as the hub last opened the port */
+		virtual uint32_t rate() = 0;
+		/** @return 0 on success */
+		virtual int setRate(uint32_t rate) = 0;
+	};
+
+#ifdef _WIN32
+
+	class PipeLine : public SimLine {
+	public:
+		bool ok() const override { return true; }
+		size_t write(int end, uint8_t c) override
+		{
+			pipes_[end].write(&c, 1);
+			return 1;
+		}
+		int available(int end) override { return static_cast<int>(pipes_[1 - end].available()); }
+		int read(int end) override
+		{
+			uint8_t c;
+			return pipes_[1 - end].read(&c, 1) ? c : -1;
+		}
+		uint32_t rate() override { return rate_; }
+		int setRate(uint32_t rate) override
+		{
+			rate_ = rate;
+			return 0;
+		}
+
+	protected:
+		BytePipe pipes_[2]; // indexed by the writing end
+		std::atomic<uint32_t> rate_{ctl::BAUD_DEFAULT};
+	};
+
+	typedef PipeLine TestLine;
+
+#else
+
+	speed_t toSpeed(uint32_t rate)
+	{
+		switch (rate) {
+		case 9600: return B9600;
+		case 19200: return B19200;
+		case 38400: return B38400;
+		case 57600: return B57600;
+		case 115200: return B115200;
+		case 230400: return B230400;
+		case 460800: return B460800;
+		default: return B921600;
+		}
+	}
+
+	class PtyLine : public SimLine {
+	public:
+		PtyLine()
+		{
+			fd_[0] = posix_openpt(O_RDWR | O_NOCTTY);
+			if (fd_[0] < 0 || grantpt(fd_[0]) || unlockpt(fd_[0])) return;
+			fd_[1] = open(ptsname(fd_[0]), O_RDWR | O_NOCTTY);
+			termios tio;
+			tcgetattr(fd_[1], &tio);
+			cfmakeraw(&tio);
+			cfsetospeed(&tio, toSpeed(ctl::BAUD_DEFAULT));
+			cfsetispeed(&tio, toSpeed(ctl::BAUD_DEFAULT));
+			tcsetattr(fd_[1], TCSANOW, &tio);
+		}
+		~PtyLine()
+		{
+			for (int fd : fd_) {
+				if (fd >= 0) close(fd);
+			}
+		}
+
+		bool ok() const override { return fd_[1] >= 0; }
+		size_t write(int end, uint8_t c) override { return ::write(fd_[end], &c, 1) == 1 ? 1 : 0; }
+		int available(int end) override
+		{
+			int n = 0;
+			ioctl(fd_[end], FIONREAD, &n);
+			return n;
+		}
+		int read(int end) override
+		{
+			uint8_t c;
+			if (available(end) <= 0 || ::read(fd_[end], &c, 1) != 1) return -1;
+			return c;
+		}
+		uint32_t rate() override
+		{
+			termios tio;
+			tcgetattr(fd_[0], &tio);
+			for (uint32_t rate : ctl::BAUD_RATES) {
+				if (toSpeed(rate) == cfgetospeed(&tio)) return rate;
+			}
+			return 0;
+		}
+		/** sets the master's side, as reopening the hub's port would */
+		int setRate(uint32_t rate) override
+		{
+			termios tio;
+			tcgetattr(fd_[0], &tio);
+			cfsetospeed(&tio, toSpeed(rate));
+			cfsetispeed(&tio, toSpeed(rate));
+			return tcsetattr(fd_[0], TCSANOW, &tio);
+		}
+
+	protected:
+		int fd_[2] = {-1, -1}; // master, slave
+	};
+
+	typedef PtyLine TestLine;
+
+#endif
+
+	// Stream over one end of the line. Garbles bytes while garbled() says so.
+	class LineStream : public ctl::StreamT {
+	public:
+		LineStream(SimLine& line, int end) : line_(line), end_(end) {}
+		virtual ~LineStream() {}
+
+		size_t write(uint8_t c) override { return line_.write(end_, garbled() ? static_cast<uint8_t>(c ^ 0x5A) : c); }
+		using ctl::StreamT::write;
+
+		int available() override { return line_.available(end_); }
+		int read() override
+		{
+			int c = line_.read(end_);
+			return (c >= 0 && garbled()) ? (c ^ 0x5A) : c;
+		}
+		int peek() override { return -1; }
+
+	protected:
+		virtual bool garbled() { return false; }
+		SimLine& line_;
+		int end_;
+	};
+
+	// The firmware's serial port
+	class SimUart : public LineStream {
+	public:
+		SimUart(SimLine& line, uint32_t cableLimit) : LineStream(line, 1), limit_(cableLimit) {}
+		void begin(uint32_t rate) { rate_ = rate; }
+
+	protected:
+		bool garbled() override
+		{
+			uint32_t line = line_.rate();
+			return rate_ != line || line > limit_;
+		}
+		std::atomic<uint32_t> rate_{ctl::BAUD_DEFAULT};
+		uint32_t limit_;
+	};
+
+	std::string readFrame(ctl::StreamT& in, milliseconds timeout)
+	{
+		std::string frame;
+		auto deadline = steady_clock::now() + timeout;
+		while (steady_clock::now() < deadline) {
+			int c = in.read();
+			if (c < 0) {
+				std::this_thread::sleep_for(milliseconds(1));
+			} else if (c == ctl::SLIP_END) {
+				if (!frame.empty()) return frame;
+			} else {
+				frame.push_back(static_cast<char>(c));
+			}
+		}
+		return std::string();
+	}
+
+	void writeFrame(ctl::StreamT& out, const std::string& text)
+	{
+		ctl::slip_write(out, reinterpret_cast<const uint8_t*>(text.data()), text.size());
+	}
+
+	// Firmware loop with a text stand-in for the json_server:
+	// "<method> [arg]" -> "<int>"
+	class SimFirmware {
+	public:
+		SimFirmware(SimLine& line, uint32_t firmwareLimit, uint32_t cableLimit)
+			: uart_(line, cableLimit), switch_(uart_, ctl::BAUD_DEFAULT, firmwareLimit)
+		{
+			thread_ = std::thread([this]() { run(); });
+		}
+		~SimFirmware()
+		{
+			running_ = false;
+			thread_.join();
+		}
+
+	protected:
+		void run()
+		{
+			auto start = steady_clock::now();
+			std::string frame;
+			while (running_) {
+				unsigned long now = static_cast<unsigned long>(
+					duration_cast<milliseconds>(steady_clock::now() - start).count());
+				if (switch_.poll(now) || uart_.available() <= 0) {
+					std::this_thread::sleep_for(milliseconds(1));
+					continue;
+				}
+				int c = uart_.read();
+				if (c != ctl::SLIP_END) {
+					if (c >= 0) frame.push_back(static_cast<char>(c));
+					continue;
+				}
+				std::string method = frame.substr(0, frame.find(' '));
+				int arg = std::atoi(frame.c_str() + method.size());
+				frame.clear();
+				// garbled requests get no reply, like an unparsable JSON frame
+				if (method == ctl::RPC_BAUD) reply(switch_.capabilities());
+				else if (method == ctl::RPC_BAUD_TRY) reply(switch_.request(arg));
+				else if (method == ctl::RPC_BAUD_CONFIRM) reply(switch_.confirm());
+			}
+		}
+
+		void reply(int value) { writeFrame(uart_, std::to_string(value)); }
+
+		SimUart uart_;
+		ctl::baud_switch<SimUart> switch_;
+		std::atomic<bool> running_{true};
+		std::thread thread_;
+	};
+
+	// The hub's side: RPCs as text frames, reopen sets the line rate
+	class HubLink : public BaudNegotiator::Link {
+	public:
+		HubLink(SimLine& line) : line_(line), port_(line, 0) {}
+
+		int capabilities(int& mask) override { return call(ctl::RPC_BAUD, mask); }
+		int request(int index) override
+		{
+			int reply = -1;
+			int error = call(std::string(ctl::RPC_BAUD_TRY) + " " + std::to_string(index), reply);
+			return error ? error : reply;
+		}
+		int confirm() override
+		{
+			int reply = -1;
+			int error = call(ctl::RPC_BAUD_CONFIRM, reply);
+			return error ? error : (reply > 0 ? 0 : reply);
+		}
+		int reopen(uint32_t rate) override { return line_.setRate(rate); }
+		ctl::StreamT& raw() override { return port_; }
+
+		int call(const std::string& request, int& reply)
+		{
+			writeFrame(port_, request);
+			std::string frame = readFrame(port_, milliseconds(300));
+			if (frame.empty()) return -1;
+			reply = std::atoi(frame.c_str());
+			return 0;
+		}
+
+	protected:
+		SimLine& line_;
+		LineStream port_;
+	};
+
+	// negotiate, then check both ends still talk at the result
+	int runCase(const char* name, uint32_t firmwareLimit, uint32_t cableLimit, uint32_t expected)
+	{
+		using namespace std;
+		TestLine line;
+		if (!line.ok()) {
+			cout << "FAILED: no pty" << endl;
+			return 1;
+		}
+		SimFirmware firmware(line, firmwareLimit, cableLimit);
+		HubLink link(line);
+		BaudNegotiator negotiator(link);
+
+		auto start = steady_clock::now();
+		uint32_t rate = negotiator.negotiate(ctl::BAUD_DEFAULT, 921600);
+		double ms = duration<double, milli>(steady_clock::now() - start).count();
+		int mask = 0;
+		bool talks = link.capabilities(mask) == 0 && mask != 0;
+		cout << name << ": " << rate << " baud after " << negotiator.attempts() << " attempts, "
+			<< ms << " ms" << (talks ? "" : ", link lost") << endl;
+
+		int failures = 0;
+		if (rate != expected || line.rate() != expected || !talks) {
+			cout << "FAILED: expected " << expected << " baud" << endl;
+			failures++;
+		}
+		// back to the connect rate, as the hub does at shutdown
+		if (negotiator.change(rate, ctl::BAUD_DEFAULT) != ctl::BAUD_DEFAULT ||
+			link.capabilities(mask) != 0) {
+			cout << "FAILED: could not step back to " << ctl::BAUD_DEFAULT << endl;
+			failures++;
+		}
+		return failures;
+	}
+}
+
+int TestBaudNegotiation()
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Baud rate negotiation ====" << endl;
+	failures += runCase("clean link", 921600, 921600, 921600);
+	failures += runCase("firmware limit", 115200, 921600, 115200);
+	failures += runCase("cable limit", 921600, 230400, 230400);
+	failures += runCase("no faster rate", 921600, 57600, 57600);
+	cout << endl;
+	return failures;
+}
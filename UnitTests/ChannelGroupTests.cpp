@@ -0,0 +1,90 @@
+// ChannelGroupTests.cpp : A channel property group set and read as one vector.
+//
+// "?chv" returns every channel of a group as base64 of the packed values,
+// and "!chv" sets them all from the same text. What get() returns must set
+// another group to the same values. A vector with one value too few or too
+// many, or text that is not base64, is CHANNELS_ERROR_DATA and must leave
+// every channel as it was: the group checks the whole vector before it sets
+// the first channel, so the channels change all together or not at all.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <LinkChannels.h>
+#include <iostream>
+#include <string>
+
+namespace {
+	/** Channel property, counting its set() calls */
+	struct Channel {
+		double value = 0.0;
+		size_t sets = 0;
+		double get() const { return value; }
+		void set(double v)
+		{
+			value = v;
+			sets++;
+		}
+	};
+
+	/** base64 of packed doubles, as the hub sends "!chv" */
+	std::string packed(const double* values, size_t count)
+	{
+		uint8_t raw[8 * sizeof(double)];
+		char text[4 * sizeof(raw) / 3 + 4];
+		for (size_t i = 0; i < count; i++) ctl::pack_le<double>(raw + i * sizeof(double), values[i]);
+		size_t n = ctl::base64_encode(text, sizeof(text), raw, count * sizeof(double));
+		return std::string(text, n);
+	}
+}
+
+int TestChannelGroup()
+{
+	using namespace std;
+	int failures = 0;
+	auto check = [&](bool ok, const char* what) {
+		if (!ok) {
+			cout << "FAILED: " << what << endl;
+			failures++;
+		}
+	};
+
+	cout << "==== Channel groups ====" << endl;
+	Channel a[4], b[4];
+	Channel* const aChannels[4] = {&a[0], &a[1], &a[2], &a[3]};
+	Channel* const bChannels[4] = {&b[0], &b[1], &b[2], &b[3]};
+	ctl::channel_group<Channel, 4> groupA("barA", aChannels), groupB("barB", bChannels);
+	using Group = ctl::channel_group<Channel, 4>;
+
+	// round trip: a's vector sets b to the same values, bit for bit
+	const double values[4] = {1.5, -2.25, 1e-300, 12345.678901234};
+	for (size_t i = 0; i < 4; i++) a[i].value = values[i];
+	char text[Group::TEXT_SIZE];
+	size_t n = groupA.get(text, sizeof(text));
+	cout << "?chv of " << values[0] << ", " << values[1] << ", " << values[2] << ", " << values[3] << ": " << text
+		<< endl;
+	check(n == Group::TEXT_SIZE - 1 && string(text, n) == packed(values, 4), "get() is not base64 of the packed values");
+	check(groupB.set(text) == 4, "set() of get()'s text");
+	for (size_t i = 0; i < 4; i++) check(b[i].value == values[i] && b[i].sets == 1, "round trip changed a value");
+	check(groupA.get(text, sizeof(text) - 1) == 0, "get() into a short buffer");
+
+	// wrong lengths and bad text: an error and no channel touched
+	const double next[5] = {7.0, 8.0, 9.0, 10.0, 11.0};
+	const string bad[] = {packed(next, 3), packed(next, 5), packed(next, 4).substr(4), "!!!!", ""};
+	for (const string& data : bad) {
+		int ret = groupB.set(data.c_str());
+		if (ret != ctl::CHANNELS_ERROR_DATA) {
+			cout << "FAILED: set(\"" << data << "\") returned " << ret << endl;
+			failures++;
+		}
+	}
+	size_t touched = 0;
+	for (size_t i = 0; i < 4; i++) touched += b[i].sets != 1 || b[i].value != values[i];
+	check(touched == 0, "a rejected vector changed some channels");
+
+	// a good vector changes every channel, once
+	check(groupB.set(packed(next, 4).c_str()) == 4, "set() of four values");
+	for (size_t i = 0; i < 4; i++) check(b[i].value == next[i] && b[i].sets == 2, "not every channel set");
+	cout << endl;
+	return failures;
+}
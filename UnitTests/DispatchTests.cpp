@@ -0,0 +1,132 @@
+// DispatchTests.cpp : Firmware dispatch table lookups on the host.
+//
+// The method names are the ones the firmware registers: its RPC constants
+// plus the get/set/sequence names of foo and the bar channels, in a table
+// of the firmware's size. The flat perfect-hash table must find every method
+// and nothing else, and should beat the unordered_map the firmware used to
+// dispatch through.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <DispatchTime.h>
+#include <FlatDispatch.h>
+#include <LinkBaud.h>
+#include <LinkChannels.h>
+#include <LinkFixed.h>
+#include <LinkNotify.h>
+#include <MethodIds.h>
+#include <SequencePlayer.h>
+#include <SequenceUpload.h>
+#include <ServerPorts.h>
+#include <TaskScheduler.h>
+#include <Telemetry.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+	// as setup_dispatch() in the firmware's main.cpp registers them
+	const char* const g_methods[] = {
+		"?fname", "?fver",
+		"?foo", "!foo", "^foo", "!foo-", "!foo+", "!foo*", "!foo#", "!foo^",
+		"?bar", "!bar", "^bar", "!bar-", "!bar+", "!bar*", "!bar#", "!bar^",
+		ctl::RPC_BAUD, ctl::RPC_BAUD_TRY, ctl::RPC_BAUD_CONFIRM,
+		ctl::RPC_CHANNELS_GET, ctl::RPC_CHANNELS_SET, ctl::RPC_FIXED_GET, ctl::RPC_FIXED_SET,
+		ctl::RPC_DISPATCH_TIME, ctl::RPC_STATS, ctl::RPC_METHOD_STATS, ctl::RPC_TASKS, ctl::RPC_PORT,
+		ctl::RPC_METHOD_IDS, ctl::RPC_SEQ_CAPACITY, ctl::RPC_SEQ_BEGIN, ctl::RPC_SEQ_CHUNK,
+		ctl::RPC_SUBSCRIBE, ctl::RPC_VALUES, ctl::RPC_SEQ_END, ctl::RPC_SEQ_MEMORY,
+		ctl::RPC_PLAY_TRACK, ctl::RPC_PLAY_START, ctl::RPC_PLAY_STOP, ctl::RPC_PLAY_STATUS,
+	};
+	const size_t g_count = sizeof(g_methods) / sizeof(g_methods[0]);
+
+	template <class LookupT>
+	double timeLookups(LookupT lookup, const std::vector<std::string>& keys, size_t nlookups, size_t& found)
+	{
+		using namespace std::chrono;
+		found = 0;
+		auto start = steady_clock::now();
+		for (size_t i = 0; i < nlookups; i++) {
+			found += lookup(keys[i % keys.size()].c_str());
+		}
+		return duration<double, std::nano>(steady_clock::now() - start).count() / nlookups;
+	}
+}
+
+int TestFlatDispatch()
+{
+	using namespace std;
+	const size_t nlookups = 1000000;
+	int failures = 0;
+
+	cout << "==== Dispatch table (" << g_count << " methods) ====" << endl;
+	unordered_map<string, int> hashed;
+	// the firmware's MapT
+	ctl::indexed_map<ctl::flat_dispatch<int, 64>> flat;
+	for (size_t i = 0; i < g_count; i++) {
+		hashed.emplace(g_methods[i], static_cast<int>(i));
+		flat.emplace(g_methods[i], static_cast<int>(i));
+	}
+	bool perfect = flat.seal();
+	flat.index();
+
+	for (size_t i = 0; i < g_count; i++) {
+		auto it = flat.find(g_methods[i]);
+		if (it == flat.end() || it->second != static_cast<int>(i)) {
+			cout << "FAILED: " << g_methods[i] << " not found" << endl;
+			failures++;
+		}
+		string id = "#" + to_string(i);
+		if (flat.find(id.c_str()) == flat.end()) {
+			cout << "FAILED: id " << id << " not found" << endl;
+			failures++;
+		}
+	}
+	for (const char* unknown : {"?fo", "!foo--", "", "?FNAME", "#99"}) {
+		if (flat.find(unknown) != flat.end()) {
+			cout << "FAILED: found unknown method \"" << unknown << "\"" << endl;
+			failures++;
+		}
+	}
+	if (!perfect) {
+		cout << "FAILED: no perfect hash seed" << endl;
+		failures++;
+	}
+
+	// overflow and long keys are refused and counted, not truncated
+	ctl::flat_dispatch<int, 2> small;
+	small.emplace("?a", 1);
+	small.emplace("?b", 2);
+	bool full = small.emplace("?c", 3).second;
+	bool longKey = small.emplace("?a_method_name_much_longer_than_23", 4).second;
+	if (full || longKey || small.refused() != 2 || small.size() != 2 || small.find("?c") != small.end() ||
+		small.find("?a_method_name_much_lon") != small.end()) {
+		cout << "FAILED: full map or long key accepted, " << small.refused() << " refused" << endl;
+		failures++;
+	}
+	// an unsealed map still finds by search, and a const find does not seal
+	const ctl::flat_dispatch<int, 2>& unsealed = small;
+	if (unsealed.find("?b") == unsealed.end() || unsealed.perfect()) {
+		cout << "FAILED: lookup before seal" << endl;
+		failures++;
+	}
+
+	// mostly hits, like a server that only gets valid requests
+	vector<string> keys(g_methods, g_methods + g_count);
+	keys.push_back("?nope");
+	size_t hashedFound, flatFound;
+	double hashedNs = timeLookups([&](const char* key) { return hashed.find(key) != hashed.end(); },
+		keys, nlookups, hashedFound);
+	double flatNs = timeLookups([&](const char* key) { return flat.find(key) != flat.end(); },
+		keys, nlookups, flatFound);
+	cout << "unordered_map: " << hashedNs << " ns/lookup, flat perfect hash (seed " << flat.seed()
+		<< "): " << flatNs << " ns/lookup, " << sizeof(flat) << " bytes static, 0 heap" << endl;
+	if (hashedFound != flatFound) {
+		cout << "FAILED: tables disagree" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
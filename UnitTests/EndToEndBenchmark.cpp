@@ -0,0 +1,62 @@
+// EndToEndBenchmark.cpp : Property round trips through MMCore, the hub,
+// the link and the firmware dispatch.
+//
+// Against the simulated firmware this needs no hardware, so it measures
+// everything above the wire: MMCore, the hub adapter, the RPC layers and
+// the firmware's server loop. A firmware that polls with delay(1) puts the
+// median near 1 ms; maxMedianUs checks that it answers sooner.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <Histogram.h>
+#include <MMCore.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+
+namespace {
+	void report(const char* what, const ctl::log_histogram& ns, double sec)
+	{
+		std::cout << what << ": " << ns.count() / sec << " calls/s, latency"
+			<< " p50=" << ns.percentile(0.5) / 1000.0 << "us"
+			<< " p90=" << ns.percentile(0.9) / 1000.0 << "us"
+			<< " p99=" << ns.percentile(0.99) / 1000.0 << "us"
+			<< " max=" << ns.max() / 1000.0 << "us" << std::endl;
+	}
+}
+
+int BenchmarkEndToEnd(CMMCore& core, const char* hub, int ncalls, double maxMedianUs)
+{
+	using namespace std;
+	using namespace std::chrono;
+	int failures = 0;
+
+	cout << "==== End to end (" << ncalls << " calls each) ====" << endl;
+	ctl::log_histogram setNs, getNs;
+	double setSec = 0, getSec = 0;
+	for (int i = 0; i < ncalls; i++) {
+		string value = to_string(i % 1000);
+		auto start = steady_clock::now();
+		core.setProperty(hub, "foo", value.c_str());
+		auto mid = steady_clock::now();
+		string readback = core.getProperty(hub, "foo");
+		auto end = steady_clock::now();
+
+		setNs.record(static_cast<uint32_t>(duration_cast<nanoseconds>(mid - start).count()));
+		getNs.record(static_cast<uint32_t>(duration_cast<nanoseconds>(end - mid).count()));
+		setSec += duration<double>(mid - start).count();
+		getSec += duration<double>(end - mid).count();
+		if (readback != value && failures++ == 0) {
+			cout << "FAILED: set foo=" << value << ", read back " << readback << endl;
+		}
+	}
+	report("setProperty foo", setNs, setSec);
+	report("getProperty foo", getNs, getSec);
+	if (maxMedianUs > 0 && getNs.percentile(0.5) / 1000.0 > maxMedianUs) {
+		cout << "FAILED: median getProperty above " << maxMedianUs << "us" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,232 @@
+// FramedRxTests.cpp : Serial input moved into a ring, frame by frame.
+//
+// A virtual UART receives one byte every 11 us, 921600 baud, into a 64 byte
+// hardware FIFO that drops bytes when full. The host sends requests back to
+// back while a loop() copy spends 2 ms on each one it handles. Drained every
+// 100 us while it works, as serialEvent() is from the yield() calls of a
+// handler that waits, every request must arrive intact and be counted as a
+// frame before loop() reads a byte of it; drained at the top of loop() only,
+// the FIFO overruns. A producer thread then races a consumer over many
+// frames to check the ring is safe for a UART interrupt too, and a frame
+// bigger than the ring must be cut short, ended by the next frame's leading
+// END once the loop makes room, without corrupting it.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <LinkRx.h>
+#include <atomic>
+#include <cstdio>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <thread>
+
+namespace {
+	const uint32_t g_byteUs = 11;
+	const size_t g_fifoBytes = 64;
+
+	/** Receive side of a UART with a small hardware FIFO, on a virtual clock */
+	class VirtualUart : public arduino::Stream {
+	public:
+		/** Queue bytes for the line, sent one every g_byteUs */
+		void send(const std::string& s) { line.insert(line.end(), s.begin(), s.end()); }
+
+		/** Advance the clock to now_us, moving arrived bytes into the FIFO */
+		void run(uint32_t now_us) {
+			while (!line.empty() && next_ <= now_us) {
+				if (fifo.size() < g_fifoBytes) fifo.push_back(line.front());
+				else overruns++;
+				line.pop_front();
+				next_ += g_byteUs;
+			}
+			if (line.empty() && next_ < now_us) next_ = now_us;
+		}
+
+		size_t write(uint8_t) override { return 1; }
+		using arduino::Stream::write;
+		int available() override { return static_cast<int>(fifo.size()); }
+		int read() override {
+			if (fifo.empty()) return -1;
+			int c = static_cast<uint8_t>(fifo.front());
+			fifo.pop_front();
+			return c;
+		}
+		int peek() override { return fifo.empty() ? -1 : static_cast<uint8_t>(fifo.front()); }
+		void begin(uint32_t) {}
+		explicit operator bool() { return true; }
+
+		std::deque<char> line;
+		std::deque<char> fifo;
+		size_t overruns = 0;
+
+	private:
+		uint32_t next_ = 0;
+	};
+
+	using RxT = ctl::framed_rx<VirtualUart, 1024>;
+
+	std::string request(int id)
+	{
+		char text[64];
+		int n = snprintf(text, sizeof(text), "{\"method\":\"?foo\",\"id\":%d}", id);
+		return std::string(1, static_cast<char>(ctl::SLIP_END)) + std::string(text, n) + static_cast<char>(ctl::SLIP_END);
+	}
+
+	/** Read one frame, without its END, from the ring */
+	std::string readFrame(RxT& rx)
+	{
+		std::string frame;
+		for (int c; (c = rx.read()) >= 0 && c != ctl::SLIP_END;) frame += static_cast<char>(c);
+		return frame;
+	}
+
+	int g_onFrame = 0;
+	void countFrame() { g_onFrame++; }
+
+	struct BusyLoopResult {
+		int handled = 0;
+		int intact = 0;
+		size_t uartOverruns = 0;
+		bool countedFirst = true;
+	};
+
+	/** Requests back to back, 2 ms of work per request, drained during the work or by loop() only */
+	BusyLoopResult busyLoop(int nrequests, bool during)
+	{
+		const uint32_t workUs = 2000, tickUs = 100;
+		VirtualUart uart;
+		RxT rx(uart);
+		BusyLoopResult result;
+		for (int i = 0; i < nrequests; i++) uart.send(request(i));
+
+		uint32_t now = 0, nextTick = tickUs;
+		// time passes in 100 us steps, yield() drains on each
+		auto spend = [&](uint32_t us) {
+			for (uint32_t end = now + us; now < end;) {
+				now = std::min(end, nextTick);
+				uart.run(now);
+				if (now == nextTick) {
+					if (during) rx.drain();
+					nextTick += tickUs;
+				}
+			}
+		};
+		while (result.handled < nrequests && now < 1000000) {
+			if (!during) rx.drain();
+			if (rx.frames() == 0) {
+				spend(tickUs);
+				continue;
+			}
+			// a whole request is counted before any of it is read
+			result.countedFirst = result.countedFirst && rx.available() >= static_cast<int>(request(0).size()) - 2;
+			std::string frame = readFrame(rx);
+			result.intact += frame == request(result.handled).substr(1, frame.size()) &&
+				frame.size() == request(result.handled).size() - 2;
+			result.handled++;
+			spend(workUs);
+		}
+		result.uartOverruns = uart.overruns;
+		return result;
+	}
+}
+
+int TestFramedRx()
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Framed serial RX ====" << endl;
+
+	// frames are counted as they complete, idle ENDs are not frames
+	{
+		VirtualUart uart;
+		RxT rx(uart);
+		rx.on_frame(countFrame);
+		string req = request(7);
+		for (size_t i = 0; i < req.size() - 1; i++) rx.receive(static_cast<uint8_t>(req[i]));
+		size_t before = rx.frames();
+		bool completed = rx.receive(ctl::SLIP_END);
+		rx.receive(ctl::SLIP_END);
+		if (before != 0 || !completed || rx.frames() != 1 || g_onFrame != 1 || readFrame(rx) != req.substr(1, req.size() - 2) ||
+			rx.frames() != 0 || rx.available() != 0) {
+			cout << "FAILED: frame detection, " << before << " frames before END, " << rx.frames() << " after reading" << endl;
+			failures++;
+		}
+	}
+
+	// a busy loop: draining while it works keeps the FIFO empty, once per pass does not
+	const int nrequests = 40;
+	BusyLoopResult during = busyLoop(nrequests, true);
+	BusyLoopResult polled = busyLoop(nrequests, false);
+	cout << "2 ms per request, " << nrequests << " requests back to back at 921600 baud: drained while working "
+		<< during.intact << " intact, " << during.uartOverruns << " bytes overrun; once per loop() " << polled.intact
+		<< " intact, " << polled.uartOverruns << " bytes overrun" << endl;
+	if (during.intact != nrequests || during.uartOverruns != 0 || !during.countedFirst) {
+		cout << "FAILED: requests lost draining while working" << endl;
+		failures++;
+	}
+	if (polled.uartOverruns == 0) {
+		cout << "FAILED: polled RX did not overrun, the test load is too light" << endl;
+		failures++;
+	}
+
+	// a UART interrupt would be concurrent: a producer thread against the consumer
+	{
+		const int nframes = 200000;
+		VirtualUart uart;
+		RxT rx(uart);
+		atomic<bool> done(false);
+		thread producer([&]() {
+			for (int i = 0; i < nframes; i++) {
+				string req = request(i);
+				for (char c : req) {
+					// a full ring would drop bytes: wait, the test is about ordering
+					while (rx.available() >= static_cast<int>(RxT::capacity()) - 1) this_thread::yield();
+					rx.receive(static_cast<uint8_t>(c));
+				}
+			}
+			done = true;
+		});
+		int received = 0, wrong = 0;
+		while (received < nframes) {
+			if (rx.frames() == 0) {
+				if (done && rx.frames() == 0) break;
+				this_thread::yield();
+				continue;
+			}
+			string req = request(received);
+			if (readFrame(rx) != req.substr(1, req.size() - 2)) wrong++;
+			received++;
+		}
+		producer.join();
+		if (received != nframes || wrong != 0 || rx.overruns() != 0) {
+			cout << "FAILED: concurrent ring, " << received << " frames, " << wrong << " wrong, " << rx.overruns()
+				<< " overruns" << endl;
+			failures++;
+		}
+	}
+
+	// a frame bigger than the ring is cut short, the next one is intact
+	{
+		VirtualUart uart;
+		RxT rx(uart);
+		string big = string(1500, 'x') + static_cast<char>(ctl::SLIP_END);
+		for (char c : big) rx.receive(static_cast<uint8_t>(c));
+		// no room for its END until the loop reads
+		size_t framesFull = rx.frames();
+		string cut = readFrame(rx);
+		string next = request(1);
+		for (char c : next) rx.receive(static_cast<uint8_t>(c));
+		string end = readFrame(rx);
+		string after = readFrame(rx);
+		if (framesFull != 0 || cut.size() != RxT::capacity() || !end.empty() || rx.damaged() != 1 ||
+			rx.overruns() != big.size() - RxT::capacity() || after != next.substr(1, next.size() - 2) || rx.frames() != 0) {
+			cout << "FAILED: overrun, " << rx.damaged() << " damaged, " << rx.overruns() << " bytes dropped, next frame \""
+				<< after << "\"" << endl;
+			failures++;
+		}
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,31 @@
+// HostTests.h : Tests that run on the host without any hardware attached.
+// Each returns the number of failed checks.
+//
+
+#pragma once
+
+int TestBaudNegotiation();
+int TestWriteBehind();
+int TestPropertyPoller();
+int TestFlatDispatch();
+int TestSequencePlayer();
+int TestSequenceReload();
+int TestFirmwareTelemetry();
+int TestPackedSequence();
+int TestServerPorts();
+int TestFramedRx();
+int TestTaskScheduler();
+int TestTraceRing();
+int TestLinkReader();
+int TestMethodScan();
+int TestChannelGroup();
+
+class CMMCore;
+/** Set/get round trips of the hub's foo property through MMCore. maxMedianUs 0: no check */
+int BenchmarkEndToEnd(CMMCore& core, const char* hub, int ncalls, double maxMedianUs);
+/** Burst of foo/barA sets with write-behind, checked against the device */
+int TestWriteCoalescing(CMMCore& core, const char* hub, int nsets);
+/** foo reads through MMCore with and without the hub's poller */
+int TestPolledReads(CMMCore& core, const char* hub, int nreads);
+/** Calls to hubB while hubA, on another port, waits for a reply */
+int TestHubPortLocks(CMMCore& core, const char* hubA, const char* hubB, int ncalls);
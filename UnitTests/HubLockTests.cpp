@@ -0,0 +1,75 @@
+// HubLockTests.cpp : Two hubs on separate ports do not wait for each other.
+//
+// Both hubs run in MMCore against the simulated firmware, each on its own
+// loopback port to one of the firmware's two server ports. The first hub's
+// port stops answering (HoldReplies) while the hub's write-behind thread is
+// in a call, so that thread holds the first port's lock until the reply is
+// let through. The second hub must make all its calls in the meantime, and
+// the first hub's call must still be waiting, then complete. With one lock
+// for all hubs the second hub would wait until the first call timed out.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/PortLock.h"
+#include <MMCore.h>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+
+int TestHubPortLocks(CMMCore& core, const char* hubA, const char* hubB, int ncalls)
+{
+	using namespace std;
+	using namespace std::chrono;
+	int failures = 0;
+
+	cout << "==== Hub port locks (" << ncalls << " calls) ====" << endl;
+	string portA = core.getProperty(hubA, "Port");
+	string writeBehindA = core.getProperty(hubA, "WriteBehind");
+	string writeBehindB = core.getProperty(hubB, "WriteBehind");
+	core.setProperty(hubA, "WriteBehind", "On");
+	core.setProperty(hubB, "WriteBehind", "Off");
+
+	// the first hub's write goes out and its reply is held
+	core.setProperty(portA.c_str(), "HoldReplies", "1");
+	core.setProperty(hubA, "foo", "4321");
+	this_thread::sleep_for(milliseconds(20));
+
+	int failed = 0;
+	auto start = steady_clock::now();
+	for (int i = 0; i < ncalls; i++) {
+		try {
+			core.setProperty(hubB, "foo", to_string(i).c_str());
+		} catch (CMMError&) {
+			failed++;
+		}
+	}
+	double ms = duration<double, milli>(steady_clock::now() - start).count();
+	bool held = core.deviceBusy(hubA);
+	core.setProperty(portA.c_str(), "HoldReplies", "0");
+	core.waitForDevice(hubA);
+
+	cout << ncalls << " calls to " << hubB << " in " << ms << " ms while " << hubA << " waited for a reply, "
+		<< failed << " failed" << endl;
+	if (failed || !held) {
+		cout << "FAILED: " << hubB << " waited for " << hubA << "'s port" << endl;
+		failures++;
+	}
+	try {
+		core.getProperty(hubA, "foo");
+	} catch (CMMError& err) {
+		cout << "FAILED: the held write: " << err.getMsg() << endl;
+		failures++;
+	}
+	core.setProperty(hubA, "WriteBehind", writeBehindA.c_str());
+	core.setProperty(hubB, "WriteBehind", writeBehindB.c_str());
+
+	if (&PortLock::get("SimPort0") != &PortLock::get("SimPort0") ||
+		&PortLock::get("SimPort0") == &PortLock::get("SimPort1")) {
+		cout << "FAILED: port lock identity" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
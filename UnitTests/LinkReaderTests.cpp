@@ -0,0 +1,136 @@
+// LinkReaderTests.cpp : The hub's background reader of the serial link.
+//
+// The wire is a pair of BytePipes; the test writes the device's frames into
+// one and the reader's requests land in the other. Replies must reach read()
+// and notifications the subscribers, each only there. After a request the
+// reader polls the wire without sleeping for replySpin() only: a device that
+// answers late, or not at all, must not keep it polling for longer, and a
+// late reply is still read. purge() drops a queued reply and a half-read
+// frame, so neither is taken for the next reply.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/LinkReader.h"
+#include "../ArduinoCoreTestSim/DuplexStream.h"
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	using namespace std::chrono;
+
+	/** Hub end of the wire, counting how often it is polled */
+	class PolledWire : public DuplexStream {
+	public:
+		PolledWire(BytePipe& rx, BytePipe& tx) : DuplexStream(rx, tx) {}
+		int available() override {
+			polls++;
+			return DuplexStream::available();
+		}
+		std::atomic<size_t> polls{0};
+	};
+
+	void send(BytePipe& pipe, const std::string& bytes)
+	{
+		pipe.write(reinterpret_cast<const uint8_t*>(bytes.data()), bytes.size());
+	}
+
+	/** One reply frame from the reader, up to its SLIP_END. Empty on timeout. */
+	std::string readReply(LinkReader& reader, milliseconds timeout)
+	{
+		std::string reply;
+		auto deadline = steady_clock::now() + timeout;
+		while (steady_clock::now() < deadline) {
+			int c = reader.read();
+			if (c < 0) {
+				std::this_thread::sleep_for(microseconds(100));
+				continue;
+			}
+			reply += static_cast<char>(c);
+			if (c == ctl::SLIP_END) return reply;
+		}
+		return std::string();
+	}
+
+	template <class ReadyF>
+	bool waitFor(ReadyF ready, milliseconds timeout)
+	{
+		auto deadline = steady_clock::now() + timeout;
+		while (!ready()) {
+			if (steady_clock::now() > deadline) return false;
+			std::this_thread::sleep_for(milliseconds(1));
+		}
+		return true;
+	}
+}
+
+int TestLinkReader()
+{
+	using namespace std;
+	int failures = 0;
+	auto check = [&](bool ok, const char* what) {
+		if (!ok) {
+			cout << "FAILED: " << what << endl;
+			failures++;
+		}
+	};
+
+	cout << "==== Link reader ====" << endl;
+	BytePipe toDevice, fromDevice;
+	PolledWire wire(fromDevice, toDevice);
+	LinkReader reader(wire);
+	mutex noticeLock;
+	vector<string> notices;
+	reader.subscribe([&](const uint8_t* frame, size_t size) {
+		lock_guard<mutex> guard(noticeLock);
+		notices.emplace_back(reinterpret_cast<const char*>(frame), size);
+	});
+	reader.start();
+	const string END(1, static_cast<char>(ctl::SLIP_END));
+
+	// a notification ahead of the reply goes to the subscriber only
+	reader.write(reinterpret_cast<const uint8_t*>("?foo"), 4);
+	send(fromDevice, "!foo=1" + END + "{\"result\":1}" + END);
+	string reply = readReply(reader, milliseconds(500));
+	check(reply == "{\"result\":1}" + END, "reply not read, or not alone");
+	check(waitFor([&]() { lock_guard<mutex> guard(noticeLock); return !notices.empty(); }, milliseconds(500)),
+		  "notification not dispatched");
+	{
+		lock_guard<mutex> guard(noticeLock);
+		check(notices.size() == 1 && notices[0] == "!foo=1", "notification garbled or repeated");
+	}
+	check(reader.replyFrames() == 1 && reader.notifications() == 1 && reader.droppedFrames() == 0,
+		  "frame counts");
+
+	// no reply for a while: the reader stops polling flat out after replySpin()
+	reader.write(reinterpret_cast<const uint8_t*>("?bar"), 4);
+	this_thread::sleep_for(milliseconds(10));
+	size_t polls = wire.polls;
+	this_thread::sleep_for(milliseconds(40));
+	polls = wire.polls - polls;
+	cout << "wire polled " << polls << " times in the 40 ms of a late reply" << endl;
+	check(polls < 1000, "reader spins while a reply is late");
+	send(fromDevice, "{\"result\":2}" + END);
+	check(readReply(reader, milliseconds(500)) == "{\"result\":2}" + END, "late reply not read");
+
+	// a reply nobody read, and half a frame, are gone after purge()
+	send(fromDevice, "{\"result\":3}" + END);
+	check(waitFor([&]() { return reader.available() > 0; }, milliseconds(500)), "stale reply not queued");
+	send(fromDevice, "{\"res");
+	check(waitFor([&]() { return fromDevice.available() == 0; }, milliseconds(500)), "partial frame not read");
+	reader.purge();
+	check(reader.available() == 0, "purge() left the stale reply");
+	send(fromDevice, "{\"result\":4}" + END);
+	reply = readReply(reader, milliseconds(500));
+	check(reply == "{\"result\":4}" + END, "purge() left part of a frame");
+	if (!reply.empty() && reply != "{\"result\":4}" + END) cout << "read: " << reply << endl;
+
+	reader.stop();
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,82 @@
+// MethodScanTests.cpp : Spotting the method of a request as it streams out.
+//
+// The RPC monitor and the method id stream both feed a MethodScan every
+// byte of a request and take the string that opens where feed() returns
+// true as the method. Only the top level "method" or "m" key counts: the
+// same text as a parameter, an id, a nested key, or inside a string with
+// escaped quotes must not. A frame cut short leaves the scanner mid-string;
+// reset() must make the next frame scan as if it were the first.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/MethodScan.h"
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	/** Methods the scanner finds in a frame, each read up to its closing quote */
+	std::vector<std::string> methods(MethodScan& scan, const std::string& frame)
+	{
+		std::vector<std::string> found;
+		for (size_t i = 0; i < frame.size(); i++) {
+			if (!scan.feed(static_cast<uint8_t>(frame[i]))) continue;
+			size_t end = frame.find('"', i + 1);
+			found.push_back(frame.substr(i + 1, end == std::string::npos ? std::string::npos : end - i - 1));
+		}
+		return found;
+	}
+}
+
+int TestMethodScan()
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Method scan ====" << endl;
+	struct Case {
+		const char* what;
+		string frame;
+		vector<string> expected;
+	};
+	const Case cases[] = {
+		{"plain request", "{\"method\":\"?foo\",\"params\":[1],\"id\":2}", {"?foo"}},
+		{"compact request", "{\"m\":\"!bar\",\"p\":[\"m\",2.5]}", {"!bar"}},
+		{"spaces around the colon", "{ \"method\" : \"?vals\" }", {"?vals"}},
+		{"method as a parameter", "{\"params\":[\"method\",\"?no\"],\"method\":\"?yes\"}", {"?yes"}},
+		{"method as a nested key", "{\"params\":{\"method\":\"?no\",\"m\":\"?no\"},\"m\":\"?yes\"}", {"?yes"}},
+		{"method as an id", "{\"id\":\"method\",\"method\":\"?yes\"}", {"?yes"}},
+		{"escaped quotes in a parameter", "{\"params\":[\"a\\\",\\\"method\\\":\\\"?no\"],\"method\":\"?yes\"}",
+		 {"?yes"}},
+		{"escaped quote in a parameter", "{\"params\":[\"6\\\" cable\"],\"method\":\"?yes\"}", {"?yes"}},
+		{"escaped backslash before a quote", "{\"params\":[\"a\\\\\"],\"method\":\"?yes\"}", {"?yes"}},
+		{"longer key ending in method", "{\"xmethod\":\"?no\",\"methods\":\"?no\"}", {}},
+	};
+	MethodScan scan;
+	for (const Case& c : cases) {
+		scan.reset();
+		vector<string> found = methods(scan, c.frame);
+		if (found != c.expected) {
+			cout << "FAILED: " << c.what << ": found " << found.size() << " methods in " << c.frame << endl;
+			failures++;
+		}
+	}
+
+	// frames cut short, mid-string and mid-key, then a whole frame
+	const string truncated[] = {"{\"params\":[\"abc", "{\"method\":\"?fo", "{\"params\":{\"method", "{\"me"};
+	for (const string& frame : truncated) {
+		scan.reset();
+		methods(scan, frame);
+		scan.reset();
+		vector<string> found = methods(scan, "{\"params\":[\"x\"],\"method\":\"?next\"}");
+		if (found != vector<string>{"?next"}) {
+			cout << "FAILED: after the truncated frame " << frame << ", found " << found.size() << " methods" << endl;
+			failures++;
+		}
+	}
+	if (!failures) cout << sizeof(cases) / sizeof(cases[0]) << " frames and " << sizeof(truncated) / sizeof(truncated[0])
+						<< " truncated frames scanned" << endl;
+	cout << endl;
+	return failures;
+}
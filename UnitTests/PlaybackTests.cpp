@@ -0,0 +1,273 @@
+// PlaybackTests.cpp : Interrupt-driven sequence playback on a virtual clock.
+//
+// ctl::sim_timer stands in for TimerOne and reads a clock the test advances
+// one microsecond at a time. Each timer interrupt is taken after a pseudo
+// random latency of a few microseconds, like a real ISR entry, and its
+// staged step is applied right after, as by the firmware's play task. The
+// steps must follow the schedule within that latency, an interrupt held off
+// for several periods must count as missed steps without shifting the
+// sequence, and triggers past the end of a one-shot sequence must count as
+// underruns. Tracks started and stopped by mask must play on their own.
+//
+// TestSequenceReload uploads a new sequence into an A/B store while the old
+// one plays. The old sequence must play to its end untouched, the new one
+// must follow on the next period without a gap, and the time from the end
+// of the upload to the first new step is the swap latency.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <SequencePlayer.h>
+#include <SequenceUpload.h>
+#include <iostream>
+#include <vector>
+
+namespace {
+	const uint32_t g_periodUs = 100;
+	const uint32_t g_maxLatencyUs = 8;
+
+	uint32_t g_now = 0;
+	uint32_t virtualClock() { return g_now; }
+
+	/** Records the step index and time of every output */
+	class RecordingTrack : public ctl::play_track {
+	public:
+		RecordingTrack(size_t length) : length_(length) {}
+		size_t length() const override { return length_; }
+		void stage(size_t i) override { steps.push_back(std::make_pair(i, g_now)); }
+
+		std::vector<std::pair<size_t, uint32_t>> steps;
+
+	private:
+		size_t length_;
+	};
+
+	/** Property that records what the player sets, and when */
+	struct RecordingProp {
+		void set(int value) { values.push_back(std::make_pair(value, g_now)); }
+		std::vector<std::pair<int, uint32_t>> values;
+	};
+
+	/** Trigger pin stand-in, the test calls tick() per edge */
+	class ManualTrigger : public ctl::play_source {
+	public:
+		bool begin(uint32_t period_us) override { return period_us == 0; }
+		void end() override {}
+	};
+
+	/** Advance the virtual clock, taking timer interrupts unless held off */
+	template <class PlayerT>
+	void run(PlayerT& player, ctl::sim_timer& timer, uint32_t us, uint32_t& lcg, bool heldOff = false)
+	{
+		for (uint32_t t = 0; t < us; t++) {
+			g_now++;
+			if (heldOff || !timer.due()) continue;
+			lcg = lcg * 1664525u + 1013904223u;
+			uint32_t latency = (lcg >> 16) % (g_maxLatencyUs + 1);
+			g_now += latency;
+			player.tick(g_now);
+			player.apply();
+		}
+	}
+}
+
+int TestSequencePlayer()
+{
+	using namespace std;
+	const size_t length = 10;
+	int failures = 0;
+
+	cout << "==== Sequence playback (virtual timer) ====" << endl;
+	RecordingTrack track(length), shortTrack(3);
+	ctl::play_track* const tracks[] = {&track, &shortTrack};
+	ctl::sim_timer timer(virtualClock);
+	ManualTrigger trigger;
+	ctl::sequence_player<2> player(tracks, &timer, &trigger);
+	uint32_t lcg = 1;
+
+	// looped timer playback
+	g_now = 1000;
+	uint32_t start = g_now;
+	int ret = player.start(g_periodUs, ctl::PLAY_LOOP, ctl::PLAY_ALL_TRACKS, g_now);
+	run(player, timer, 100 * g_periodUs, lcg);
+	bool ordered = true;
+	uint32_t worstUs = 0;
+	for (size_t k = 0; k < track.steps.size(); k++) {
+		uint32_t due = start + static_cast<uint32_t>(k + 1) * g_periodUs;
+		uint32_t late = track.steps[k].second - due;
+		if (late > worstUs) worstUs = late;
+		ordered = ordered && track.steps[k].first == k % length && shortTrack.steps[k].first == k % length % 3;
+	}
+	cout << player.steps() << " steps, jitter p99 " << player.jitter().percentile(0.99) << " us, max "
+		<< player.jitter().max() << " us (latency up to " << g_maxLatencyUs << " us)" << endl;
+	if (ret != 0 || player.steps() < 99 || !ordered || worstUs > g_maxLatencyUs || player.missed() != 0) {
+		cout << "FAILED: " << player.steps() << " steps, ordered " << ordered << ", worst " << worstUs
+			<< " us late, " << player.missed() << " missed" << endl;
+		failures++;
+	}
+
+	// an interrupt held off for four periods right after a step skips three
+	// steps and stays on time
+	for (size_t n = player.steps(); n == player.steps();) run(player, timer, 1, lcg);
+	size_t before = track.steps.size();
+	size_t next = track.steps.back().first + 1;
+	run(player, timer, 4 * g_periodUs, lcg, true);
+	run(player, timer, g_periodUs, lcg);
+	if (player.missed() != 3 || track.steps.size() <= before || track.steps[before].first != (next + 3) % length) {
+		cout << "FAILED: held off interrupt missed " << player.missed() << " steps, resumed at step "
+			<< (track.steps.size() > before ? track.steps[before].first : length) << endl;
+		failures++;
+	}
+	long played = player.stop();
+	if (played != static_cast<long>(player.steps()) || timer.running()) {
+		cout << "FAILED: stop() left the timer running" << endl;
+		failures++;
+	}
+
+	// a timed one-shot stops itself after the last step
+	track.steps.clear();
+	player.start(g_periodUs, 0, ctl::PLAY_ALL_TRACKS, g_now);
+	run(player, timer, 20 * g_periodUs, lcg);
+	if (track.steps.size() != length || player.running() || timer.running()) {
+		cout << "FAILED: one-shot played " << track.steps.size() << " of " << length << " steps" << endl;
+		failures++;
+	}
+
+	// triggers past the end of a one-shot are underruns
+	track.steps.clear();
+	player.start(0, 0, ctl::PLAY_ALL_TRACKS, g_now);
+	for (size_t i = 0; i < length + 4; i++) player.tick(g_now++);
+	char text[ctl::PLAY_TEXT_SIZE];
+	player.text(text, sizeof(text), false);
+	cout << "triggered one-shot: " << text << endl;
+	if (track.steps.size() != length || player.underruns() != 4 || !player.running()) {
+		cout << "FAILED: " << track.steps.size() << " triggered steps, " << player.underruns()
+			<< " underruns" << endl;
+		failures++;
+	}
+	player.stop();
+
+	// each property starts and stops its own track
+	track.steps.clear();
+	shortTrack.steps.clear();
+	int alone = player.start(g_periodUs, ctl::PLAY_LOOP, 1u << 1, g_now);
+	run(player, timer, 10 * g_periodUs, lcg);
+	bool shortOnly = track.steps.empty() && !shortTrack.steps.empty();
+	int joined = player.start(g_periodUs, ctl::PLAY_LOOP, 1u << 0, g_now);
+	int busy = player.start(2 * g_periodUs, ctl::PLAY_LOOP, 1u << 0, g_now);
+	run(player, timer, 10 * g_periodUs, lcg);
+	bool both = !track.steps.empty() && player.tracks() == 3;
+	player.stop(1u << 1);
+	size_t shortSteps = shortTrack.steps.size(), longSteps = track.steps.size();
+	run(player, timer, 10 * g_periodUs, lcg);
+	bool longOnly = player.running() && timer.running() && shortTrack.steps.size() == shortSteps &&
+		track.steps.size() > longSteps;
+	player.stop(1u << 0);
+	if (alone != 0 || joined != 0 || busy != ctl::PLAY_ERROR_BUSY || !shortOnly || !both || !longOnly ||
+		player.running() || timer.running()) {
+		cout << "FAILED: track masks, started " << alone << "/" << joined << "/" << busy << ", short only "
+			<< shortOnly << ", both " << both << ", long only " << longOnly << endl;
+		failures++;
+	}
+
+	// start errors
+	RecordingTrack empty(0);
+	ctl::play_track* const emptyTracks[] = {&empty};
+	ctl::sequence_player<1> idle(emptyTracks, &timer, nullptr);
+	ctl::sequence_player<2> timerOnly(tracks, &timer, nullptr);
+	if (idle.start(g_periodUs, 0, ctl::PLAY_ALL_TRACKS, g_now) != ctl::PLAY_ERROR_EMPTY ||
+		player.start(ctl::PLAY_MIN_PERIOD_US - 1, 0, ctl::PLAY_ALL_TRACKS, g_now) != ctl::PLAY_ERROR_PERIOD ||
+		timerOnly.start(0, 0, ctl::PLAY_ALL_TRACKS, g_now) != ctl::PLAY_ERROR_SOURCE ||
+		player.start(g_periodUs, 0, 0, g_now) != ctl::PLAY_ERROR_EMPTY) {
+		cout << "FAILED: start errors" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
+
+int TestSequenceReload()
+{
+	using namespace std;
+	const int oldLength = 10, newLength = 16;
+	const size_t chunkElements = 4;
+	int failures = 0;
+
+	cout << "==== Sequence reload (A/B buffers) ====" << endl;
+	ctl::ab_sequence_store<int, 64> store("foo");
+	RecordingProp prop;
+	ctl::store_track<decltype(store), RecordingProp> track(store, prop);
+	ctl::play_track* const tracks[] = {&track};
+	ctl::sim_timer timer(virtualClock);
+	ctl::sequence_player<1> player(tracks, &timer, nullptr);
+	uint32_t lcg = 7;
+
+	// one chunk per call, with playback running in between like loop() would
+	auto upload = [&](int first, int count, uint32_t usPerChunk) {
+		uint8_t raw[ctl::SEQ_CHUNK_BYTES];
+		char b64[4 * ctl::SEQ_CHUNK_BYTES / 3 + 1];
+		uint16_t crc = ctl::CRC16_INIT;
+		store.begin(count);
+		for (int offset = 0; offset < count; offset += static_cast<int>(chunkElements)) {
+			size_t n = min(chunkElements, static_cast<size_t>(count - offset));
+			for (size_t i = 0; i < n; i++) ctl::pack_le<int>(raw + i * sizeof(int), first + offset + static_cast<int>(i));
+			crc = ctl::crc16(raw, n * sizeof(int), crc);
+			size_t nc = ctl::base64_encode(b64, sizeof(b64) - 1, raw, n * sizeof(int));
+			b64[nc] = '\0';
+			store.chunk(offset, b64);
+			run(player, timer, usPerChunk, lcg);
+		}
+		return store.end(crc);
+	};
+
+	g_now = 5000;
+	upload(0, oldLength, 0);
+	store.swap(); // nothing playing: current right away
+	player.start(g_periodUs, ctl::PLAY_LOOP, ctl::PLAY_ALL_TRACKS, g_now);
+	run(player, timer, 25 * g_periodUs + g_periodUs / 2, lcg);
+
+	// reload in the middle of the third pass
+	size_t before = prop.values.size();
+	int ended = upload(100, newLength, g_periodUs / 4);
+	uint32_t readyAt = g_now;
+	run(player, timer, (oldLength + newLength) * g_periodUs, lcg);
+	player.stop();
+
+	size_t first = before;
+	while (first < prop.values.size() && prop.values[first].first < 100) first++;
+	bool ordered = ended == newLength && first < prop.values.size() && first > before;
+	for (size_t i = before; ordered && i < first; i++) {
+		ordered = prop.values[i].first == prop.values[i - 1].first + 1 ||
+			(prop.values[i].first == 0 && prop.values[i - 1].first == oldLength - 1);
+	}
+	ordered = ordered && prop.values[first - 1].first == oldLength - 1;
+	for (size_t i = first; ordered && i < first + newLength && i < prop.values.size(); i++) {
+		ordered = prop.values[i].first == 100 + static_cast<int>(i - first);
+	}
+	uint32_t gapUs = 0;
+	for (size_t i = 1; i < prop.values.size(); i++) {
+		gapUs = max(gapUs, prop.values[i].second - prop.values[i - 1].second);
+	}
+	double latencyUs = first < prop.values.size() ? prop.values[first].second - readyAt : -1.0;
+	cout << "swap latency " << latencyUs << " us (sequence " << oldLength * g_periodUs
+		<< " us), longest step interval " << gapUs << " us at a " << g_periodUs << " us period, "
+		<< player.swaps() << " swap(s)" << endl;
+	if (player.track("foo") != 0 || player.track("bar0") != ctl::PLAY_ERROR_TRACK) {
+		cout << "FAILED: track of an upload target" << endl;
+		failures++;
+	}
+	if (!ordered || player.swaps() != 1 || store.swaps() != 2) {
+		cout << "FAILED: old sequence not played out before the new one" << endl;
+		failures++;
+	}
+	if (gapUs > g_periodUs + g_maxLatencyUs) {
+		cout << "FAILED: " << gapUs << " us gap at the swap" << endl;
+		failures++;
+	}
+	if (latencyUs < 0 || latencyUs > oldLength * g_periodUs + g_maxLatencyUs) {
+		cout << "FAILED: swap took longer than one sequence" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,149 @@
+// PropertyPollerTests.cpp : Polled property cache against a simulated device.
+//
+// The simulated device counts batches and answers after a fixed round trip.
+// Cached values must never be older than their maximum age, properties
+// without a maximum age must not be fetched, and a value stored by update()
+// must not be overwritten by an older batch.
+//
+// TestPolledReads compares GetProperty through MMCore with and without the
+// hub's poller, and reads polled properties right after writes to them,
+// one by one and through their channel group.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/PropertyPoller.h"
+#include <MMCore.h>
+#include <atomic>
+#include <chrono>
+#include <iostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	const std::chrono::microseconds g_roundTrip(2000);
+}
+
+int TestPropertyPoller()
+{
+	using namespace std;
+	using namespace std::chrono;
+	int failures = 0;
+
+	cout << "==== Property poller ====" << endl;
+	atomic<int> counter(0);
+	atomic<size_t> fetched(0);
+	PropertyPoller poller([&](const vector<string>& targets, vector<string>& values) {
+		this_thread::sleep_for(g_roundTrip);
+		fetched += targets.size();
+		int now = ++counter;
+		for (auto& target : targets) values.push_back(target + to_string(now));
+		return 0;
+	});
+	poller.add("foo", "f");
+	poller.add("bar", "b");
+	poller.start();
+
+	string value;
+	poller.interval(milliseconds(5));
+	this_thread::sleep_for(milliseconds(30));
+	if (fetched != 0 || poller.cached("foo", value)) {
+		cout << "FAILED: polled without a maximum age" << endl;
+		failures++;
+	}
+
+	poller.maxAge("foo", milliseconds(20));
+	this_thread::sleep_for(milliseconds(30));
+	size_t batches = poller.batches();
+	int hits = 0, reads = 0;
+	auto start = steady_clock::now();
+	while (steady_clock::now() - start < milliseconds(100)) {
+		reads++;
+		if (poller.cached("foo", value)) hits++;
+	}
+	double staleMs = poller.staleness("foo").count() / 1000.0;
+	batches = poller.batches() - batches;
+	cout << reads << " reads in 100 ms, " << hits << " from cache, " << batches
+		<< " batches, staleness " << staleMs << " ms" << endl;
+	if (hits == 0 || staleMs > 20 || value.compare(0, 1, "f") != 0) {
+		cout << "FAILED: cache hits " << hits << ", value " << value << endl;
+		failures++;
+	}
+	if (poller.cached("bar", value)) {
+		cout << "FAILED: bar served without a maximum age" << endl;
+		failures++;
+	}
+
+	// a known value wins over the batch in flight
+	poller.update("foo", "written");
+	if (!poller.cached("foo", value) || value != "written") {
+		cout << "FAILED: update not served, got " << value << endl;
+		failures++;
+	}
+
+	// no polling: stale values are not served
+	poller.interval(milliseconds(0));
+	this_thread::sleep_for(milliseconds(30));
+	if (poller.cached("foo", value)) {
+		cout << "FAILED: served a value with polling off" << endl;
+		failures++;
+	}
+	poller.stop();
+	cout << endl;
+	return failures;
+}
+
+int TestPolledReads(CMMCore& core, const char* hub, int nreads)
+{
+	using namespace std;
+	using namespace std::chrono;
+	int failures = 0;
+
+	cout << "==== Polled reads (" << nreads << " foo reads) ====" << endl;
+	auto readAll = [&]() {
+		auto start = steady_clock::now();
+		for (int i = 0; i < nreads; i++) core.getProperty(hub, "foo");
+		return duration<double, micro>(steady_clock::now() - start).count() / nreads;
+	};
+
+	double directUs = readAll();
+	core.setProperty(hub, "PollMaxAgeMs foo", 100L);
+	core.setProperty(hub, "PollIntervalMs", 20L);
+	this_thread::sleep_for(milliseconds(100));
+	double polledUs = readAll();
+
+	// a write is visible right away, not after the next batch
+	core.setProperty(hub, "foo", "4242");
+	string readback = core.getProperty(hub, "foo");
+	double staleMs = stod(core.getProperty(hub, "PollStalenessMs foo"));
+
+	// so is a write of the whole channel group
+	core.setProperty(hub, "PollMaxAgeMs barA", 100L);
+	string bars = core.getProperty(hub, "barAll");
+	core.getProperty(hub, "barA");
+	core.setProperty(hub, "barAll", "7.5,8.5,3.3,4.4");
+	double barA = stod(core.getProperty(hub, "barA"));
+	core.setProperty(hub, "barAll", bars.c_str());
+
+	core.setProperty(hub, "PollIntervalMs", 0L);
+	core.setProperty(hub, "PollMaxAgeMs foo", 0L);
+	core.setProperty(hub, "PollMaxAgeMs barA", 0L);
+
+	cout << "direct: " << directUs << " us/read, polled: " << polledUs << " us/read, staleness "
+		<< staleMs << " ms" << endl;
+	if (readback != "4242") {
+		cout << "FAILED: read " << readback << " after writing 4242" << endl;
+		failures++;
+	}
+	if (barA != 7.5) {
+		cout << "FAILED: read barA " << barA << " after writing 7.5 to barAll" << endl;
+		failures++;
+	}
+	if (staleMs > 100) {
+		cout << "FAILED: served a value older than its maximum age" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,178 @@
+// SchedulerTests.cpp : Cooperative task scheduler on a virtual clock.
+//
+// Tasks advance a virtual microsecond clock by a fixed cost when they run,
+// and the loop() copy advances it 10 us when nothing was due, so every
+// release, start and finish time is known and the accounting must match
+// exactly. A 1 ms task next to a 2.5 ms task shows the lateness and
+// overruns the long task causes. An event task standing in for the server,
+// signalled by request "interrupts" that fall inside other tasks' run
+// time, must answer every request within its deadline. Signals count once
+// and their wait from the first, and a stall of several periods must skip
+// the missed releases rather than run them back to back.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <TaskScheduler.h>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	using SchedulerT = ctl::task_scheduler<4>;
+
+	uint32_t g_now = 0;
+	uint32_t virtualClock() { return g_now; }
+
+	// requests arrive every 700 us from 350 us on and signal the server like
+	// the RX interrupt, each takes 100 us to serve
+	const uint32_t g_arrivalUs = 700;
+	SchedulerT* g_rxScheduler = nullptr;
+	int g_serve = -1;
+	uint32_t g_nextArrival = 350;
+	uint32_t g_arrived = 0;
+	uint32_t g_served = 0;
+	uint32_t g_waitMax = 0;
+
+	/** Time passes, with the request interrupts that fall in it */
+	void advance(uint32_t us)
+	{
+		uint32_t end = g_now + us;
+		while (g_rxScheduler && g_nextArrival <= end) {
+			g_now = g_nextArrival;
+			g_arrived++;
+			g_rxScheduler->signal(g_serve);
+			g_nextArrival += g_arrivalUs;
+		}
+		g_now = end;
+	}
+
+	void notifyTask() { advance(50); }
+	void slowTask() { advance(2500); }
+	void stallTask() { advance(3500); }
+	void tickTask() {}
+
+	bool requestWaiting() { return g_arrived > g_served; }
+	void serveTask()
+	{
+		if (!requestWaiting()) return;
+		uint32_t arrival = 350 + g_served * g_arrivalUs;
+		if (g_now - arrival > g_waitMax) g_waitMax = g_now - arrival;
+		g_served++;
+		advance(100);
+	}
+
+	void runUntil(SchedulerT& scheduler, uint32_t until)
+	{
+		while (g_now < until) {
+			if (scheduler.poll() == 0) advance(10);
+		}
+	}
+}
+
+int TestTaskScheduler()
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Task scheduler (virtual clock) ====" << endl;
+
+	// a 1 ms task alone keeps its period to the idle step
+	{
+		g_now = 0;
+		SchedulerT scheduler(virtualClock);
+		int notify = scheduler.periodic("notify", notifyTask, 1000);
+		runUntil(scheduler, 100000);
+		const ctl::task_stats& s = scheduler.stats(notify);
+		if (s.runs != 100 || s.overruns != 0 || s.skipped != 0 || s.late_max != 0 || s.run_max != 50) {
+			cout << "FAILED: periodic task alone, " << s.runs << " runs, late " << s.late_max << " us" << endl;
+			failures++;
+		}
+	}
+
+	// a 1 ms task and a 5 ms task that takes 2.5 ms against a 2 ms deadline
+	{
+		g_now = 0;
+		SchedulerT scheduler(virtualClock);
+		int notify = scheduler.periodic("notify", notifyTask, 1000);
+		int slow   = scheduler.periodic("slow", slowTask, 5000, 2000);
+		runUntil(scheduler, 100000);
+		const ctl::task_stats& n  = scheduler.stats(notify);
+		const ctl::task_stats& sl = scheduler.stats(slow);
+		// slow starts 50 us late behind notify and holds it up past two
+		// releases: the first then starts 1550 us late and finishes late
+		if (sl.runs != 20 || sl.overruns != 20 || sl.run_max != 2500 || sl.late_max != 50 || n.runs != 100 ||
+			n.skipped != 0 || n.overruns != 20 || n.late_max != 1550) {
+			cout << "FAILED: slow " << sl.runs << " runs, " << sl.overruns << " overruns; notify " << n.runs << " runs, "
+				<< n.overruns << " overruns, late " << n.late_max << " us" << endl;
+			failures++;
+		}
+	}
+
+	// the same with the server first: requests wait at most for the slow task
+	{
+		g_now = 0;
+		SchedulerT scheduler(virtualClock);
+		int serve = scheduler.event("serve", serveTask, requestWaiting, 3000);
+		scheduler.periodic("notify", notifyTask, 1000);
+		int slow      = scheduler.periodic("slow", slowTask, 5000, 2000);
+		g_rxScheduler = &scheduler;
+		g_serve       = serve;
+		runUntil(scheduler, 100000);
+		g_rxScheduler = nullptr;
+		const ctl::task_stats& sv = scheduler.stats(serve);
+
+		char text[ctl::TASKS_TEXT_SIZE];
+		scheduler.text(text, sizeof(text), false);
+		cout << "?tasks: " << text << endl;
+		cout << g_served << " of " << g_arrived << " requests served, longest wait " << g_waitMax << " us" << endl;
+		if (g_arrived - g_served > 1 || sv.overruns != 0 || g_waitMax > 2500 + 50 || sv.late_max != g_waitMax) {
+			cout << "FAILED: serve " << sv.runs << " runs, " << sv.overruns << " overruns, late " << sv.late_max << " us"
+				<< endl;
+			failures++;
+		}
+		scheduler.text(text, sizeof(text), true);
+		if (!strstr(text, "slow 20 2500 2500 ") || scheduler.stats(slow).runs != 0) {
+			cout << "FAILED: tasks reply or reset" << endl;
+			failures++;
+		}
+	}
+
+	// a signal counts from when it was raised, and twice before a run is one run
+	{
+		g_now = 0;
+		SchedulerT scheduler(virtualClock);
+		int rx = scheduler.event("rx", tickTask, nullptr, 500);
+		scheduler.poll();
+		g_now = 1000;
+		scheduler.signal(rx);
+		g_now += 200;
+		scheduler.signal(rx);
+		g_now += 400;
+		scheduler.poll();
+		scheduler.poll();
+		const ctl::task_stats& s = scheduler.stats(rx);
+		if (s.runs != 1 || s.late_max != 600 || s.overruns != 1) {
+			cout << "FAILED: signalled task, " << s.runs << " runs, late " << s.late_max << " us" << endl;
+			failures++;
+		}
+	}
+
+	// a 3.5 ms stall skips the 1 ms releases it covered
+	{
+		g_now = 0;
+		SchedulerT scheduler(virtualClock);
+		int stall = scheduler.event("stall", stallTask, nullptr, 10000);
+		int tick  = scheduler.periodic("tick", tickTask, 1000);
+		runUntil(scheduler, 10000);
+		scheduler.signal(stall);
+		runUntil(scheduler, 20000);
+		const ctl::task_stats& s = scheduler.stats(tick);
+		if (s.runs != 18 || s.skipped != 2 || s.overruns != 1 || s.late_max != 3500) {
+			cout << "FAILED: stalled task, " << s.runs << " runs, " << s.skipped << " skipped, " << s.overruns
+				<< " overruns, late " << s.late_max << " us" << endl;
+			failures++;
+		}
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,200 @@
+// SequenceStoreTests.cpp : Delta and run-length coded sequence stores.
+//
+// Sequences shaped like acquisitions, a focus ramp with a hold, decimal
+// ramps and channel levels held for several frames, go through the same
+// chunked upload the hub uses into packed stores sized like the firmware's
+// A/B stores, typical_capacity() steps long. Integers must read back exactly
+// and doubles to half a fixed-point step, in order and with skips like missed
+// player steps. capacity() must be reached by random values that change every
+// step, typical_capacity() by random values each held 16 steps, and be eight
+// times or more the steps of a raw store of the same RAM. The decode time per
+// step is timed with the steady clock. An upload that does not compress, or
+// has a value out of range, must fail without touching the playing sequence.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <PackedSequence.h>
+#include <SequencePlayer.h>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+namespace {
+	/** Chunked upload of values, as the hub sends them. @return RPC_SEQ_END reply or the first error */
+	template <class StoreT, typename T>
+	int upload(StoreT& store, const std::vector<T>& values)
+	{
+		const size_t perChunk = ctl::SEQ_CHUNK_BYTES / sizeof(T);
+		uint8_t raw[ctl::SEQ_CHUNK_BYTES];
+		char b64[4 * ctl::SEQ_CHUNK_BYTES / 3 + 1];
+		uint16_t crc = ctl::CRC16_INIT;
+		int ret = store.begin(static_cast<long>(values.size()));
+		if (ret < 0) return ret;
+		for (size_t offset = 0; offset < values.size(); offset += perChunk) {
+			size_t n = std::min(perChunk, values.size() - offset);
+			for (size_t i = 0; i < n; i++) ctl::pack_le<T>(raw + i * sizeof(T), values[offset + i]);
+			crc = ctl::crc16(raw, n * sizeof(T), crc);
+			size_t nc = ctl::base64_encode(b64, sizeof(b64) - 1, raw, n * sizeof(T));
+			b64[nc] = '\0';
+			ret = store.chunk(static_cast<long>(offset), b64);
+			if (ret < 0) return ret;
+		}
+		return store.end(crc);
+	}
+
+	struct RecordingProp {
+		void set(double value) { values.push_back(value); }
+		std::vector<double> values;
+	};
+
+	/** Random values, each held for hold steps: 1 for capacity(), PACKED_HOLD_STEPS for typical_capacity() */
+	template <typename T>
+	std::vector<T> heldNoise(size_t size, T lowest, T highest, size_t hold = ctl::PACKED_HOLD_STEPS)
+	{
+		std::vector<T> values;
+		uint32_t lcg = 7;
+		T v = lowest;
+		for (size_t i = 0; i < size; i++) {
+			if (i % hold == 0) {
+				lcg = lcg * 1664525u + 1013904223u;
+				v = static_cast<T>(lowest + (static_cast<double>(highest) - lowest) * (lcg / 4294967296.0));
+			}
+			values.push_back(v);
+		}
+		return values;
+	}
+
+	/** Upload, swap in and read back, each step within tolerance. @return failed checks */
+	template <class StoreT, typename T>
+	int checkStore(const char* title, StoreT& store, const std::vector<T>& values, size_t rawCapacity,
+				   double tolerance = 0.0)
+	{
+		using namespace std;
+		using namespace std::chrono;
+		int failures = 0;
+		int ret = upload(store, values);
+		store.swap();
+
+		// in order, several passes like a looped sequence
+		const int passes = 20;
+		bool same = ret == static_cast<int>(values.size()) && store.size() == values.size();
+		auto start = steady_clock::now();
+		for (int p = 0; p < passes && same; p++) {
+			for (size_t i = 0; i < values.size(); i++) same = same && std::fabs(static_cast<double>(store[i]) - values[i]) <= tolerance;
+		}
+		double ns = duration<double, nano>(steady_clock::now() - start).count() / (passes * values.size());
+
+		char text[ctl::SEQ_MEMORY_TEXT_SIZE];
+		store.memory_text(text, sizeof(text));
+		double bytesPerStep = static_cast<double>(store.used_bytes()) / values.size();
+		double codesPerRead = static_cast<double>(store.decoded()) / store.reads();
+		cout << title << ": " << values.size() << " steps in " << store.used_bytes() << " of "
+			<< store.buffer_bytes() << " bytes (" << bytesPerStep << " bytes/step, raw " << sizeof(T)
+			<< "), " << store.typical_capacity() / rawCapacity << "x the steps of a raw store, decode " << ns
+			<< " ns/step, " << codesPerRead << " codes/step; ?sqm " << text << endl;
+		if (!same) {
+			cout << "FAILED: " << title << " did not read back (upload " << ret << ")" << endl;
+			failures++;
+		}
+		if (store.typical_capacity() < 8 * rawCapacity || store.used_bytes() > store.buffer_bytes()) {
+			cout << "FAILED: " << title << " holds " << store.typical_capacity() << " steps, raw " << rawCapacity << endl;
+			failures++;
+		}
+
+		// skips forward, like missed steps, and back to the start
+		auto near = [&](size_t i) { return std::fabs(static_cast<double>(store[i]) - values[i]) <= tolerance; };
+		bool skipped = true;
+		for (size_t i = 0; i < values.size(); i += 7) skipped = skipped && near(i);
+		for (size_t i = values.size(); i-- > values.size() - 5;) skipped = skipped && near(i);
+		skipped = skipped && near(0);
+		if (!skipped) {
+			cout << "FAILED: " << title << " wrong value after a skip" << endl;
+			failures++;
+		}
+		return failures;
+	}
+}
+
+int TestPackedSequence()
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Packed sequence stores ====" << endl;
+
+	// focus: 64 step ramp, 64 step hold, over and over. Same RAM as ab_sequence_store<int, 1024>.
+	static ctl::packed_sequence_store<int, 1024 * sizeof(int)> focus("foo");
+	vector<int> ramp;
+	for (size_t i = 0; i < focus.typical_capacity(); i++) {
+		size_t k = i % 128;
+		ramp.push_back(1000 + 10 * static_cast<int>(k < 64 ? k : 63));
+	}
+	failures += checkStore("noise (int)", focus, heldNoise<int>(focus.capacity(), INT32_MIN + 1, INT32_MAX, 1), 1024);
+	failures += checkStore("held noise (int)", focus,
+						   heldNoise<int>(focus.typical_capacity(), INT32_MIN + 1, INT32_MAX), 1024);
+	failures += checkStore("ramp and hold (int)", focus, ramp, 1024);
+
+	// channels in 1e-4 steps like the firmware's bars. Same RAM as ab_sequence_store<double, 256>.
+	const ctl::fixed_point fixed(1e-4);
+	const double tolerance = fixed.scale / 2;
+	static ctl::packed_sequence_store<double, 256 * sizeof(double)> levels("bar0", fixed);
+	failures += checkStore("noise (double)", levels,
+						   heldNoise<double>(levels.capacity(), fixed.lowest(), fixed.highest(), 1), 256, tolerance);
+	failures += checkStore("held noise (double)", levels,
+						   heldNoise<double>(levels.typical_capacity(), fixed.lowest(), fixed.highest()), 256, tolerance);
+
+	vector<double> decimalRamp;
+	for (size_t i = 0; i < levels.typical_capacity(); i++) decimalRamp.push_back(0.1 * i);
+	failures += checkStore("decimal ramp (double)", levels, decimalRamp, 256, tolerance);
+
+	const double level[] = {0.0, 1.5, 2.75, -5.0};
+	const double decimal[] = {0.3, 1.7, -2.45, 0.05};
+	vector<double> channels;
+	for (size_t i = 0; i < levels.typical_capacity(); i++) {
+		size_t k = (i / 16) % 8;
+		channels.push_back(k < 4 ? level[k] : decimal[k - 4]);
+	}
+	failures += checkStore("held levels (double)", levels, channels, 256, tolerance);
+
+	// plays through store_track like the raw stores
+	RecordingProp prop;
+	ctl::store_track<decltype(levels), RecordingProp> track(levels, prop);
+	for (size_t i = 0; i < 80; i++) {
+		track.stage(i);
+		track.apply();
+	}
+	track.apply(); // nothing staged: no second set
+	auto played = [&](size_t i, double v) { return std::fabs(prop.values[i] - v) <= tolerance; };
+	if (prop.values.size() != 80 || !played(17, 1.5) || !played(40, 2.75) || !played(63, -5.0) ||
+		!played(70, 0.3)) {
+		cout << "FAILED: store_track over a packed store" << endl;
+		failures++;
+	}
+
+	// noise does not compress: the upload fails and the ramp stays current
+	vector<int> noise;
+	uint32_t lcg = 3;
+	for (size_t i = 0; i < 4096; i++) {
+		lcg = lcg * 1664525u + 1013904223u;
+		noise.push_back(static_cast<int>(lcg));
+	}
+	int ret = upload(focus, noise);
+	if (ret != ctl::SEQ_ERROR_FULL || focus.ready() || focus.swap() || focus.size() != ramp.size() ||
+		focus[100] != ramp[100]) {
+		cout << "FAILED: incompressible upload returned " << ret << ", " << focus.size() << " steps current" << endl;
+		failures++;
+	}
+
+	// past the fixed-point range: refused as a value, not as too big
+	vector<double> far(32, 1.0);
+	far[20] = 2 * fixed.highest();
+	ret = upload(levels, far);
+	if (ret != ctl::SEQ_ERROR_RANGE || levels.swap() || levels.size() != channels.size()) {
+		cout << "FAILED: out of range upload returned " << ret << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
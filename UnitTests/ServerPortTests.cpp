@@ -0,0 +1,151 @@
+// ServerPortTests.cpp : round_robin service order over two server ports.
+//
+// Only the order is under test here: two in-memory streams stand in for
+// Serial and SerialUSB1, each with a line-based stand-in for json_server
+// that keeps its own parse buffer and handles one request per
+// check_messages(). The firmware's own servers, and where each port's
+// notifications go, are driven on the simulator by SimTests/PortTests.cpp.
+// Both dispatch through one shared table. A control host floods port 0
+// while a monitoring host sends a few requests on port 1: every one of
+// those must be answered within a pass of arriving, on its own port, and
+// a request split across passes must not mix with the other port's.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <FlatDispatch.h>
+#include <ServerPorts.h>
+#include <deque>
+#include <iostream>
+#include <string>
+#include <vector>
+
+namespace {
+	/** One direction of bytes per side, for the firmware end */
+	class MemoryStream : public arduino::Stream {
+	public:
+		void host_write(const std::string& s) { rx.insert(rx.end(), s.begin(), s.end()); }
+
+		size_t write(uint8_t c) override { tx.push_back(static_cast<char>(c)); return 1; }
+		using arduino::Stream::write;
+		int available() override { return static_cast<int>(rx.size()); }
+		int read() override {
+			if (rx.empty()) return -1;
+			int c = static_cast<uint8_t>(rx.front());
+			rx.pop_front();
+			return c;
+		}
+		int peek() override { return rx.empty() ? -1 : static_cast<uint8_t>(rx.front()); }
+
+		std::deque<char> rx;
+		std::string tx;
+	};
+
+	using Handler = int (*)();
+	using MapT = ctl::flat_dispatch<Handler, 8>;
+
+	ctl::round_robin<2> g_ports;
+	int g_foo = 0;
+
+	int getPort() { return g_ports.current(); }
+	int setFoo() { return ++g_foo; }
+
+	/** "method\n" -> "result\n", one request per check_messages() */
+	class LineServer {
+	public:
+		LineServer(MemoryStream& stream, MapT& map) : stream_(stream), map_(map) {}
+
+		void check_messages() {
+			while (stream_.available() > 0) {
+				char c = static_cast<char>(stream_.read());
+				if (c != '\n') {
+					line_ += c;
+					continue;
+				}
+				MapT::iterator it = map_.find(line_.c_str());
+				std::string reply = it != map_.end() ? std::to_string(it->second()) : "?";
+				stream_.write(reinterpret_cast<const uint8_t*>(reply.data()), reply.size());
+				stream_.write('\n');
+				line_.clear();
+				return;
+			}
+		}
+
+	private:
+		MemoryStream& stream_;
+		MapT& map_;
+		std::string line_;
+	};
+
+	std::vector<std::string> lines(const std::string& text)
+	{
+		std::vector<std::string> out;
+		size_t start = 0;
+		for (size_t end; (end = text.find('\n', start)) != std::string::npos; start = end + 1) {
+			out.push_back(text.substr(start, end - start));
+		}
+		return out;
+	}
+}
+
+int TestServerPorts()
+{
+	using namespace std;
+	const int nflood = 1000, nmonitor = 10;
+	int failures = 0;
+
+	cout << "==== Server ports (round robin) ====" << endl;
+	MapT map{{"?port", getPort}, {"!foo", setFoo}};
+	map.seal();
+	MemoryStream control, monitor;
+	LineServer controlServer(control, map), monitorServer(monitor, map);
+	MemoryStream* const streams[] = {&control, &monitor};
+	LineServer* const servers[] = {&controlServer, &monitorServer};
+
+	for (int i = 0; i < nflood; i++) control.host_write("!foo\n");
+	for (int i = 0; i < nmonitor; i++) monitor.host_write("?port\n");
+
+	vector<size_t> order;
+	auto ready = [&](size_t port) { return streams[port]->available() > 0; };
+	auto serve = [&](size_t port) { order.push_back(port); servers[port]->check_messages(); };
+
+	// each pass answers one request per port with input
+	int passes = 0;
+	while (monitor.available() > 0 && passes < 2 * nmonitor) {
+		g_ports.poll(ready, serve);
+		passes++;
+	}
+	vector<string> monitorReplies = lines(monitor.tx);
+	bool onPort = monitorReplies.size() == static_cast<size_t>(nmonitor);
+	for (const string& r : monitorReplies) onPort = onPort && r == "1";
+	cout << nmonitor << " monitor requests answered in " << passes << " passes behind " << nflood
+		<< " queued control requests" << endl;
+	if (passes != nmonitor || !onPort) {
+		cout << "FAILED: monitor port starved or answered as port 0 (" << monitorReplies.size() << " replies)" << endl;
+		failures++;
+	}
+	// no port is always first
+	bool alternates = true;
+	for (size_t i = 2; i < order.size(); i += 2) alternates = alternates && order[i] != order[i - 2];
+	if (!alternates || g_ports.serviced(0) != static_cast<size_t>(nmonitor) || g_ports.serviced(1) != static_cast<size_t>(nmonitor)) {
+		cout << "FAILED: service order does not rotate" << endl;
+		failures++;
+	}
+
+	// a request split across passes stays in its port's buffer
+	monitor.tx.clear();
+	monitor.host_write("?po");
+	for (int i = 0; i < 3; i++) g_ports.poll(ready, serve);
+	monitor.host_write("rt\n");
+	g_ports.poll(ready, serve);
+	while (control.available() > 0) g_ports.poll(ready, serve);
+	vector<string> controlReplies = lines(control.tx);
+	bool counted = controlReplies.size() == static_cast<size_t>(nflood) && controlReplies.back() == to_string(nflood);
+	if (monitor.tx != "1\n" || !counted || g_ports.current() != -1) {
+		cout << "FAILED: split request got \"" << monitor.tx << "\", " << controlReplies.size()
+			<< " control replies" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
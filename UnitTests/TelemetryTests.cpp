@@ -0,0 +1,194 @@
+// TelemetryTests.cpp : Firmware telemetry counters on a virtual cycle counter.
+//
+// A host copy of the firmware's loop(): the telemetry hooks around the
+// task scheduler's passes, with a serve task that looks its method up in an
+// indexed flat dispatch map and a periodic task on the scheduler tick. The
+// loop sleeps until the next request or tick, as wait_for_input() does, so
+// loop periods vary. The cycle counter is a virtual clock the test advances
+// by a known cost per method, and each counter read costs one tick, so the
+// histograms, the per-method times and the measured overhead all have
+// exact expected values. The hooks must cost less than 1% of the scheduler
+// tick, both on the virtual counter and timed with the host's steady clock.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include <FlatDispatch.h>
+#include <MethodIds.h>
+#include <TaskScheduler.h>
+#include <Telemetry.h>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+namespace {
+	const uint32_t g_ticksPerUs = 10;
+	const uint32_t g_requestUs = 700; // between requests, out of step with the tick
+	const uint32_t g_notifyUs = 2;    // run time of the periodic task
+
+	uint32_t g_ticks = 0;
+	uint32_t virtualCounter() { return g_ticks++; }
+	// the scheduler's micros(), free to read
+	uint32_t virtualMicros() { return g_ticks / g_ticksPerUs; }
+
+	uint32_t steadyCounter()
+	{
+		using namespace std::chrono;
+		return static_cast<uint32_t>(duration_cast<nanoseconds>(steady_clock::now().time_since_epoch()).count());
+	}
+
+	using MapT = ctl::indexed_map<ctl::flat_dispatch<uint32_t, 8>, 8>;
+	using TelemetryT = ctl::firmware_telemetry<8>;
+
+	MapT* g_map = nullptr;
+	TelemetryT* g_telemetry = nullptr;
+	const char* g_request = nullptr; // waiting for the serve task
+
+	bool requestWaiting() { return g_request != nullptr; }
+
+	/** The serve task: one server pass, taking its method's cost in us */
+	void serve()
+	{
+		MapT& map = *g_map;
+		map.clear_found();
+		g_telemetry->pass_start(static_cast<int>(strlen(g_request)));
+		MapT::iterator it = map.find(g_request);
+		if (it != map.end()) g_ticks += it->second * g_ticksPerUs;
+		MapT::iterator found = map.found();
+		g_telemetry->pass_end(found != map.end() ? static_cast<int>(found - map.begin()) : -1);
+		g_request = nullptr;
+	}
+
+	void notify() { g_ticks += g_notifyUs * g_ticksPerUs; }
+}
+
+int TestFirmwareTelemetry()
+{
+	using namespace std;
+	const int nloops = 10000;
+	int failures = 0;
+
+	cout << "==== Firmware telemetry (virtual cycle counter) ====" << endl;
+	// method -> microseconds its handler takes
+	MapT map{{"?foo", 5}, {"!foo", 20}, {"?stats", 40}};
+	map.seal();
+	map.index();
+	static TelemetryT telemetry(virtualCounter, g_ticksPerUs);
+	g_map = &map;
+	g_telemetry = &telemetry;
+	ctl::task_scheduler<2> scheduler(virtualMicros);
+	scheduler.event("serve", serve, requestWaiting, ctl::TASK_TICK_US);
+	scheduler.periodic("notify", notify, ctl::TASK_TICK_US);
+
+	// requests cycle through these; by id once the hub has the ids
+	char fooId[8];
+	snprintf(fooId, sizeof(fooId), "#%d", static_cast<int>(map.find("?foo") - map.begin()));
+	const char* const requests[] = {"?foo", "!foo", fooId, "?nope"};
+	size_t sent = 0;
+	uint32_t nextRequest = g_requestUs, nextTick = ctl::TASK_TICK_US;
+	uint32_t firstStart = 0, lastStart = 0;
+	for (int i = 0; i < nloops; i++) {
+		lastStart = g_ticks; // what loop_start() reads
+		if (i == 0) firstStart = lastStart;
+		telemetry.loop_start();
+		scheduler.poll();
+		// sleep until the RX interrupt or the tick
+		uint32_t now = virtualMicros();
+		while (nextTick <= now) nextTick += ctl::TASK_TICK_US;
+		uint32_t wake = nextRequest < nextTick ? nextRequest : nextTick;
+		if (wake > now) g_ticks = wake * g_ticksPerUs;
+		if (nextRequest <= virtualMicros()) {
+			g_request = requests[sent++ % 4];
+			nextRequest += g_requestUs;
+		}
+	}
+	if (g_request) sent--; // never served
+	g_request = nullptr;
+
+	size_t getFoo = map.find("?foo") - map.begin();
+	size_t setFoo = map.find("!foo") - map.begin();
+	uint32_t gets = static_cast<uint32_t>(sent / 4 * 2 + (sent % 4 > 0) + (sent % 4 > 2));
+	uint32_t sets = static_cast<uint32_t>(sent / 4 + (sent % 4 > 1));
+	const ctl::method_stats& get = telemetry.method(getFoo);
+	const ctl::method_stats& set = telemetry.method(setFoo);
+	// a pass also takes the counter reads of the hooks
+	if (get.count != gets || set.count != sets || telemetry.us(get.max) != 5 ||
+		telemetry.us(set.total / set.count) != 20) {
+		cout << "FAILED: ?foo " << get.count << " calls, max " << telemetry.us(get.max) << " us, !foo "
+			<< set.count << " calls, mean " << telemetry.us(set.total / set.count) << " us" << endl;
+		failures++;
+	}
+	// no loop sleeps past the tick, passes are the handler plus one counter read
+	const ctl::log_histogram& pass = telemetry.passes().histogram();
+	if (telemetry.loops().count() != nloops - 1 || telemetry.loops().max() > ctl::TASK_TICK_US * g_ticksPerUs ||
+		pass.count() != sent || pass.max() != 20) {
+		cout << "FAILED: " << telemetry.loops().count() << " loops, max " << telemetry.loops().max()
+			<< " ticks, " << pass.count() << " passes of " << sent << ", max " << pass.max() << " us" << endl;
+		failures++;
+	}
+	// one counter read per hook is overhead: 1 tick per loop, 2 more per pass
+	uint32_t expectPpm = static_cast<uint32_t>((nloops + 2ull * sent) * 1000000 / (lastStart - firstStart));
+	double elapsedTicks = static_cast<double>(lastStart - firstStart) / (ctl::TASK_TICK_US * g_ticksPerUs);
+	double loopsPerTick = (nloops - 1) / elapsedTicks;
+	cout << sent << " requests, " << loopsPerTick << " loops per " << ctl::TASK_TICK_US << " us tick, overhead "
+		<< telemetry.overhead_ppm() << " ppm" << endl;
+	if (telemetry.overhead_ppm() != expectPpm || telemetry.overhead_ppm() >= 10000) {
+		cout << "FAILED: overhead " << telemetry.overhead_ppm() << " ppm, expected " << expectPpm << endl;
+		failures++;
+	}
+
+	char text[ctl::STATS_TEXT_SIZE];
+	char expectLoops[32];
+	snprintf(expectLoops, sizeof(expectLoops), "\"loop\":[%d,", nloops - 1);
+	telemetry.frame_errors(3);
+	size_t n = telemetry.text(text, sizeof(text), true);
+	cout << "?stats: " << text << endl;
+	if (n == 0 || !strstr(text, expectLoops) || !strstr(text, "\"heap\":0,\"stack\":0,") ||
+		!strstr(text, "\"rx\":5,") || !strstr(text, "\"ferr\":3,") ||
+		telemetry.loops().count() != 0 || telemetry.passes().histogram().count() != 0) {
+		cout << "FAILED: stats reply or reset" << endl;
+		failures++;
+	}
+
+	auto name = [&map](size_t i) { return map.begin()[i].first.c_str(); };
+	char methods[ctl::METHOD_STATS_TEXT_SIZE];
+	char expectGet[32], expectSet[32];
+	snprintf(expectGet, sizeof(expectGet), "?foo %lu 5 5", static_cast<unsigned long>(gets));
+	snprintf(expectSet, sizeof(expectSet), "!foo %lu 20 20", static_cast<unsigned long>(sets));
+	telemetry.method_text(methods, sizeof(methods), false, name);
+	cout << "?mstats: " << methods << endl;
+	if (!strstr(methods, expectGet) || !strstr(methods, expectSet) || strstr(methods, "?stats")) {
+		cout << "FAILED: method stats" << endl;
+		failures++;
+	}
+	// a short buffer drops whole entries
+	char cut[16];
+	size_t ncut = telemetry.method_text(cut, sizeof(cut), true, name);
+	if (ncut != strlen(cut) || strncmp(cut, methods, ncut) != 0 || (methods[ncut] != ';' && methods[ncut] != '\0') ||
+		telemetry.method(getFoo).count != 0) {
+		cout << "FAILED: truncated method stats \"" << cut << "\"" << endl;
+		failures++;
+	}
+
+	// the hooks on a real clock, as often per tick as the loop above ran,
+	// against 1% of the tick
+	const int nhooks = 1000000;
+	static TelemetryT timed(steadyCounter, 1000);
+	auto start = chrono::steady_clock::now();
+	for (int i = 0; i < nhooks; i++) {
+		timed.loop_start();
+		timed.pass_start(1);
+		timed.pass_end(i % 3);
+	}
+	double hookNs = chrono::duration<double, nano>(chrono::steady_clock::now() - start).count() / nhooks;
+	double tickPercent = hookNs * loopsPerTick / (ctl::TASK_TICK_US * 10.0);
+	cout << "hooks: " << hookNs << " ns per loop, " << tickPercent << "% of a " << ctl::TASK_TICK_US
+		<< " us tick" << endl;
+	if (tickPercent >= 1.0) {
+		cout << "FAILED: telemetry costs 1% or more of the tick" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
@@ -0,0 +1,87 @@
+// TraceRingTests.cpp : The hub's always-on trace of the last link frames.
+//
+// A small ring takes more frames than it keeps: dump() must return the
+// newest ones, oldest first, and recorded() count them all. Frames longer
+// than a slot are cut with "...", bytes that are not printable come out as
+// \xHH, and a dump of the last few frames stops at the newest.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/TraceRing.h"
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace {
+	using SmallTrace = TraceRing<4, 8>;
+
+	void record(SmallTrace& trace, SmallTrace::Direction dir, const std::string& frame)
+	{
+		trace.record(dir, reinterpret_cast<const uint8_t*>(frame.data()), frame.size());
+	}
+
+	/** The frame text of each dump line, without its time and direction */
+	std::vector<std::string> frames(const std::string& dump, std::string& directions)
+	{
+		std::vector<std::string> out;
+		std::istringstream in(dump);
+		std::string line;
+		directions.clear();
+		while (std::getline(in, line)) {
+			size_t space = line.find(' ');
+			if (space == std::string::npos || space + 2 >= line.size()) continue;
+			directions += line[space + 1];
+			out.push_back(line.substr(space + 3));
+		}
+		return out;
+	}
+}
+
+int TestTraceRing()
+{
+	using namespace std;
+	int failures = 0;
+
+	cout << "==== Trace ring ====" << endl;
+	SmallTrace trace;
+	string directions;
+	if (trace.recorded() != 0 || !trace.dump().empty()) {
+		cout << "FAILED: new trace not empty" << endl;
+		failures++;
+	}
+
+	// six frames through four slots: the last four are kept
+	for (int i = 0; i < 6; i++) {
+		record(trace, i % 2 ? SmallTrace::RECEIVED : SmallTrace::SENT, "f" + to_string(i));
+	}
+	vector<string> kept = frames(trace.dump(), directions);
+	if (trace.recorded() != 6 || kept != vector<string>{"f2", "f3", "f4", "f5"} || directions != "><><") {
+		cout << "FAILED: wrap-around kept " << kept.size() << " frames, " << trace.recorded() << " recorded:" << endl
+			<< trace.dump();
+		failures++;
+	}
+	kept = frames(trace.dump(2), directions);
+	if (kept != vector<string>{"f4", "f5"}) {
+		cout << "FAILED: dump(2) returned " << kept.size() << " frames" << endl;
+		failures++;
+	}
+
+	// longer than a slot: truncated and marked; control bytes escaped
+	record(trace, SmallTrace::SENT, "{\"method\":\"?foo\"}");
+	record(trace, SmallTrace::RECEIVED, string("a\xC0\\b", 4));
+	kept = frames(trace.dump(2), directions);
+	if (kept.size() != 2 || kept[0] != "{\"method..." || kept[1] != "a\\xC0\\x5Cb") {
+		cout << "FAILED: truncation or escaping:" << endl << trace.dump(2);
+		failures++;
+	}
+
+	trace.clear();
+	if (trace.recorded() != 0 || !trace.dump().empty()) {
+		cout << "FAILED: clear() left frames" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
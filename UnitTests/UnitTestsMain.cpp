@@ -6,6 +6,7 @@
 #include <MMCore.h>
 #include <MMDevice.h>
 #include "DeviceBase.h"
+#include "HostTests.h"
 #include <iostream>
 #include <string>
 #include <vector>
@@ -33,24 +34,49 @@ inline std::string getPropertyTypeVerbose(MM::PropertyType t)
 	return os.str();
 }
 
-int main()
+int main(int argc, char* argv[])
 {
 	using namespace std;
 
+	// Host-only tests first. They need no hardware.
+	int failures = 0;
+	failures += TestBaudNegotiation();
+	failures += TestWriteBehind();
+	failures += TestPropertyPoller();
+	failures += TestFlatDispatch();
+	failures += TestSequencePlayer();
+	failures += TestSequenceReload();
+	failures += TestFirmwareTelemetry();
+	failures += TestPackedSequence();
+	failures += TestServerPorts();
+	failures += TestFramedRx();
+	failures += TestTaskScheduler();
+	failures += TestTraceRing();
+	failures += TestLinkReader();
+	failures += TestMethodScan();
+	failures += TestChannelGroup();
+
 	string moduleName("ArduinoCoreTestDevice");
 	string deviceName("ArduinoCoreTestDevice-Hub");
 	string portLabel("HubSerial");
-	string portOutput("COM8");
+	// UnitTests [COMx]: a real board on COMx, otherwise the simulated firmware
+	bool simulated = argc < 2;
+	string portOutput(simulated ? "" : argv[1]);
 	CMMCore core;
 	core.enableStderrLog(true);
 	core.enableDebugLog(true);
 	string hubLabel("Hub");
 	try {
-		// setup the serial port from the serial manager
-		core.loadDevice(portLabel.c_str(), "SerialManager", portOutput.c_str());
-		//cout << "Fast USB to Serial was: " << core.getProperty(portLabel.c_str(), "Fast USB to Serial") << endl;
-		core.setProperty(portLabel.c_str(), "Fast USB to Serial", "Enable");
-		core.setProperty(portLabel.c_str(), "Verbose", "0");
+		if (simulated) {
+			// loopback port to the firmware running in-process
+			core.loadDevice(portLabel.c_str(), "ArduinoCoreTestSim", "ArduinoCoreTestSim-Port");
+		} else {
+			// setup the serial port from the serial manager
+			core.loadDevice(portLabel.c_str(), "SerialManager", portOutput.c_str());
+			//cout << "Fast USB to Serial was: " << core.getProperty(portLabel.c_str(), "Fast USB to Serial") << endl;
+			core.setProperty(portLabel.c_str(), "Fast USB to Serial", "Enable");
+			core.setProperty(portLabel.c_str(), "Verbose", "0");
+		}
 		core.initializeDevice(portLabel.c_str());
 		// Initialize the device and set the serial port
 		core.loadDevice(hubLabel.c_str(), moduleName.c_str(), deviceName.c_str());
@@ -67,6 +93,28 @@ int main()
 		core.setProperty(hubLabel.c_str(), "Test", "Run");
 		cout << "Results: " << core.getProperty(hubLabel.c_str(), "Test") << endl << endl;
 
+		// Run link benchmarks
+		core.setProperty(hubLabel.c_str(), "Benchmark", "Run");
+		cout << "Benchmark: " << core.getProperty(hubLabel.c_str(), "Benchmark") << endl << endl;
+
+		// the simulated firmware wakes on input, so well under a 1 ms poll
+		failures += BenchmarkEndToEnd(core, hubLabel.c_str(), 1000, simulated ? 500.0 : 0.0);
+		failures += TestWriteCoalescing(core, hubLabel.c_str(), 100);
+		failures += TestPolledReads(core, hubLabel.c_str(), 1000);
+
+		if (simulated) {
+			// a second hub, on the firmware's second server port
+			string monitorPortLabel("MonitorSerial");
+			string monitorHubLabel("MonitorHub");
+			core.loadDevice(monitorPortLabel.c_str(), "ArduinoCoreTestSim", "ArduinoCoreTestSim-Port");
+			core.setProperty(monitorPortLabel.c_str(), "Link", "SerialUSB1");
+			core.initializeDevice(monitorPortLabel.c_str());
+			core.loadDevice(monitorHubLabel.c_str(), moduleName.c_str(), deviceName.c_str());
+			core.setProperty(monitorHubLabel.c_str(), "Port", monitorPortLabel.c_str());
+			core.initializeDevice(monitorHubLabel.c_str());
+			failures += TestHubPortLocks(core, hubLabel.c_str(), monitorHubLabel.c_str(), 100);
+		}
+
 		// unload the device
 		// -----------------
 		core.unloadAllDevices();
@@ -75,5 +123,5 @@ int main()
 		cout << err.getMsg();
 		return 1;
 	}
-	return 0;
+	return failures ? 1 : 0;
 }
@@ -0,0 +1,209 @@
+// WriteBehindTests.cpp : Queued property writes against a slow simulated device.
+//
+// The simulated device takes a fixed time per write. Posting must not wait
+// for it, the queue must only send the latest value of a property, and a
+// failed write must show up once on the next error() call.
+//
+// TestWriteCoalescing runs a burst of property sets through MMCore against
+// the hub, with and without write-behind, and reads the values back from
+// the device.
+
+#define NOMINMAX
+
+#include "HostTests.h"
+#include "../ArduinoCoreTestDevice/WriteBehind.h"
+#include <MMCore.h>
+#include <cmath>
+#include <chrono>
+#include <iostream>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace {
+	const std::chrono::microseconds g_writeTime(2000);
+	const int g_errorCode = 42;
+
+	struct SlowDevice {
+		std::mutex lock;
+		std::vector<std::pair<std::string, std::string>> writes;
+
+		int write(const std::string& name, const std::string& value)
+		{
+			std::this_thread::sleep_for(g_writeTime);
+			std::lock_guard<std::mutex> guard(lock);
+			writes.push_back(std::make_pair(name, value));
+			return value == "bad" ? g_errorCode : 0;
+		}
+
+		std::string last(const std::string& name)
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			for (auto it = writes.rbegin(); it != writes.rend(); ++it) {
+				if (it->first == name) return it->second;
+			}
+			return "";
+		}
+	};
+}
+
+int TestWriteBehind()
+{
+	using namespace std;
+	using namespace std::chrono;
+	const int nposts = 100;
+	int failures = 0;
+
+	cout << "==== Write-behind ====" << endl;
+	SlowDevice device;
+	WriteBehind writes([&device](const string& name, const string& value) {
+		return device.write(name, value);
+	});
+	writes.add("foo");
+	writes.add("bar");
+	if (writes.post("foo", "0")) {
+		cout << "FAILED: post before start" << endl;
+		failures++;
+	}
+	writes.start();
+
+	auto start = steady_clock::now();
+	for (int i = 1; i <= nposts; i++) {
+		writes.post("foo", to_string(i));
+		writes.post("bar", to_string(-i));
+	}
+	double postUs = duration<double, micro>(steady_clock::now() - start).count() / (2 * nposts);
+	bool busy = writes.busy();
+	string pending;
+	bool queued = writes.pending("foo", pending);
+	bool flushed = writes.flush(milliseconds(5000));
+	double totalMs = duration<double, milli>(steady_clock::now() - start).count();
+
+	cout << 2 * nposts << " posts: " << postUs << " us/post, " << writes.sent() << " writes sent, "
+		<< writes.coalesced() << " coalesced, idle after " << totalMs << " ms" << endl;
+	if (!busy || !queued || pending != to_string(nposts)) {
+		cout << "FAILED: queued writes not visible (busy " << busy << ", pending " << pending << ")" << endl;
+		failures++;
+	}
+	if (!flushed || writes.busy()) {
+		cout << "FAILED: queue did not drain" << endl;
+		failures++;
+	}
+	if (device.last("foo") != to_string(nposts) || device.last("bar") != to_string(-nposts)) {
+		cout << "FAILED: device has foo=" << device.last("foo") << " bar=" << device.last("bar") << endl;
+		failures++;
+	}
+	if (writes.sent() + writes.coalesced() != 2 * nposts || writes.sent() >= 2 * nposts) {
+		cout << "FAILED: expected fewer writes than posts" << endl;
+		failures++;
+	}
+	if (writes.pending("foo", pending)) {
+		cout << "FAILED: acknowledged write still pending" << endl;
+		failures++;
+	}
+
+	// errors come back once, on the next call
+	writes.post("foo", "bad");
+	writes.post("bar", "1");
+	writes.flush(milliseconds(5000));
+	int first = writes.error();
+	int second = writes.error();
+	if (first != g_errorCode || second != 0 || writes.failed() != "foo" || device.last("bar") != "1") {
+		cout << "FAILED: error " << first << " then " << second << " from " << writes.failed() << endl;
+		failures++;
+	}
+
+	// a window collects a burst into one write
+	size_t sent = writes.sent();
+	writes.window("foo", milliseconds(20));
+	for (int i = 0; i < 5; i++) {
+		writes.post("foo", "burst" + to_string(i));
+		this_thread::sleep_for(milliseconds(1));
+	}
+	this_thread::sleep_for(milliseconds(100));
+	if (writes.sent() != sent + 1 || writes.elided("foo") < 4 || device.last("foo") != "burst4") {
+		cout << "FAILED: burst sent " << writes.sent() - sent << " writes, "
+			<< writes.elided("foo") << " elided" << endl;
+		failures++;
+	}
+
+	// unknown names are refused, not registered on the fly
+	if (writes.window("baz", milliseconds(20)) || writes.post("baz", "1") || writes.handles("baz")) {
+		cout << "FAILED: unregistered property accepted" << endl;
+		failures++;
+	}
+
+	// flush does not wait out the window
+	writes.window("foo", milliseconds(5000));
+	writes.post("foo", "hurry");
+	start = steady_clock::now();
+	writes.flush(milliseconds(5000));
+	if (steady_clock::now() - start > milliseconds(1000) || device.last("foo") != "hurry") {
+		cout << "FAILED: flush waited for the window" << endl;
+		failures++;
+	}
+
+	// stop() sends what is still queued
+	writes.post("foo", "last");
+	writes.stop();
+	if (device.last("foo") != "last") {
+		cout << "FAILED: stop dropped a queued write" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
+
+int TestWriteCoalescing(CMMCore& core, const char* hub, int nsets)
+{
+	using namespace std;
+	using namespace std::chrono;
+	int failures = 0;
+
+	cout << "==== Write coalescing (" << nsets << " foo/barA set pairs) ====" << endl;
+	auto burst = [&](int offset) {
+		auto start = steady_clock::now();
+		for (int i = 0; i < nsets; i++) {
+			core.setProperty(hub, "foo", to_string(offset + i).c_str());
+			core.setProperty(hub, "barA", to_string(0.5 * (offset + i)).c_str());
+		}
+		core.waitForDevice(hub);
+		return duration<double, milli>(steady_clock::now() - start).count();
+	};
+	auto check = [&](int last) {
+		long foo = stol(core.getProperty(hub, "foo"));
+		double barA = stod(core.getProperty(hub, "barA"));
+		if (foo != last || fabs(barA - 0.5 * last) > 1e-6) {
+			cout << "FAILED: device has foo=" << foo << " barA=" << barA << ", expected "
+				<< last << " " << 0.5 * last << endl;
+			failures++;
+		}
+	};
+
+	double syncMs = burst(0);
+	check(nsets - 1);
+
+	core.setProperty(hub, "WriteBehind", "On");
+	core.setProperty(hub, "WriteWindowMs foo", 20L);
+	core.setProperty(hub, "WriteWindowMs barA", 20L);
+	long elidedBefore = stol(core.getProperty(hub, "WritesElided foo")) +
+		stol(core.getProperty(hub, "WritesElided barA"));
+	double asyncMs = burst(nsets);
+	long elided = stol(core.getProperty(hub, "WritesElided foo")) +
+		stol(core.getProperty(hub, "WritesElided barA")) - elidedBefore;
+	core.setProperty(hub, "WriteWindowMs foo", 0L);
+	core.setProperty(hub, "WriteWindowMs barA", 0L);
+	// reads come from the device again
+	core.setProperty(hub, "WriteBehind", "Off");
+	check(2 * nsets - 1);
+
+	cout << "synchronous: " << syncMs << " ms, write-behind: " << asyncMs << " ms with "
+		<< elided << " of " << 2 * nsets << " writes elided" << endl;
+	if (elided <= 0) {
+		cout << "FAILED: no writes elided" << endl;
+		failures++;
+	}
+	cout << endl;
+	return failures;
+}
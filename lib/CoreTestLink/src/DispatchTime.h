@@ -0,0 +1,48 @@
+#pragma once
+
+#ifndef __DISPATCHTIME_H__
+    #define __DISPATCHTIME_H__
+
+    #include "Histogram.h"
+    #include "LinkCommon.h"
+    #include <stdio.h>
+
+namespace ctl {
+
+    /**
+     * Device-side dispatch time.
+     *
+     * RPC_DISPATCH_TIME(reset) -> "count p50 p99 max", microseconds spent in
+     * the server per loop() pass that had input waiting. A non-zero reset
+     * clears the histogram after reading it.
+     */
+    constexpr const char* RPC_DISPATCH_TIME = "?dspt";
+
+    constexpr size_t DISPATCH_TEXT_SIZE = 48;
+
+    /** Histogram of server passes, with the RPC_DISPATCH_TIME reply */
+    class dispatch_timer {
+     public:
+        void record(uint32_t us) { hist_.record(us); }
+        void reset() { hist_.reset(); }
+
+        /** @return characters written, 0 if dest is too small */
+        size_t text(char* dest, size_t dest_size, bool reset) {
+            int n = snprintf(dest, dest_size, "%lu %lu %lu %lu",
+                             static_cast<unsigned long>(hist_.count()),
+                             static_cast<unsigned long>(hist_.percentile(0.5)),
+                             static_cast<unsigned long>(hist_.percentile(0.99)),
+                             static_cast<unsigned long>(hist_.max()));
+            if (reset) hist_.reset();
+            return (n > 0 && static_cast<size_t>(n) < dest_size) ? static_cast<size_t>(n) : 0;
+        }
+
+        const log_histogram& histogram() const { return hist_; }
+
+     protected:
+        log_histogram hist_;
+    };
+
+}; // namespace
+
+#endif // #ifndef __DISPATCHTIME_H__
@@ -0,0 +1,198 @@
+#pragma once
+
+#ifndef __FLATDISPATCH_H__
+    #define __FLATDISPATCH_H__
+
+    #include "LinkCommon.h"
+    #include <initializer_list>
+    #include <string.h>
+    #include <utility>
+
+namespace ctl {
+
+    /**
+     * Null terminated string in a fixed buffer of N.
+     * A string longer than N-1 characters is not cut short but left empty,
+     * so it can never pass for a shorter one.
+     */
+    template <size_t N>
+    class fixed_string {
+     public:
+        fixed_string(const char* s = "") { assign(s); }
+        /** From any string type with c_str(), e.g. String or std::string */
+        template <class StringT, class = decltype(std::declval<const StringT&>().c_str())>
+        fixed_string(const StringT& s) { assign(s.c_str()); }
+
+        const char* c_str() const { return s_; }
+        size_t length() const { return strlen(s_); }
+        bool empty() const { return s_[0] == '\0'; }
+
+        bool operator==(const char* other) const { return strcmp(s_, other) == 0; }
+        bool operator==(const fixed_string& other) const { return strcmp(s_, other.s_) == 0; }
+        bool operator!=(const fixed_string& other) const { return !(*this == other); }
+
+     protected:
+        void assign(const char* s) {
+            size_t n = 0;
+            for (; s && s[n] && n + 1 < N; n++) s_[n] = s[n];
+            s_[(s && s[n]) ? 0 : n] = '\0';
+        }
+        char s_[N];
+    };
+
+    /** 32-bit FNV-1a with a seed folded into the basis, plus a final avalanche */
+    inline uint32_t seeded_hash(const char* s, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        while (*s) {
+            h ^= static_cast<uint8_t>(*s++);
+            h *= 16777619u;
+        }
+        h ^= h >> 16;
+        h *= 0x45d9f3bu;
+        h ^= h >> 16;
+        return h;
+    }
+
+    /** Smallest power of two >= n */
+    constexpr size_t next_pow2(size_t n, size_t p = 1) { return p >= n ? p : next_pow2(n, p * 2); }
+
+    /**
+     * @brief Fixed-capacity dispatch map with a perfect hash.
+     *
+     * Drop-in for the server's MapT (find, emplace, iteration, initializer
+     * list). Entries live in a static array and keys are copied into fixed
+     * buffers, so nothing comes from the heap.
+     *
+     * The methods are only known once setup() has added the properties, so
+     * the hash is built at run time: seal(), at the end of setup(), tries
+     * seeds until every key lands in its own slot of a table of 4N slots.
+     * A lookup is then one hash, one slot read and one string compare. Until
+     * seal(), after any later emplace(), or if no seed works, find() falls
+     * back to a linear search; perfect() tells. find() never changes the map.
+     *
+     * emplace() refuses a key longer than KEY_SIZE-1 or a key past capacity
+     * N. Both are setup errors: refused() counts them so setup() can check
+     * once at the end instead of at every emplace().
+     *
+     * @tparam ValueT    mapped type, e.g. json_stub
+     * @tparam N         capacity, at most 255
+     * @tparam KEY_SIZE  longest method name + 1
+     */
+    template <class ValueT, size_t N, size_t KEY_SIZE = 24>
+    class flat_dispatch {
+        static_assert(N < 255, "slot indices are 8-bit");
+
+     public:
+        using key_type    = fixed_string<KEY_SIZE>;
+        using mapped_type = ValueT;
+        struct value_type {
+            key_type first;
+            ValueT second;
+        };
+        using size_type      = size_t;
+        using iterator       = value_type*;
+        using const_iterator = const value_type*;
+
+        static constexpr size_t SLOTS     = next_pow2(4 * N);
+        static constexpr uint32_t SEEDS   = 1024; ///< seeds tried before falling back
+        static constexpr uint8_t EMPTY    = 0xFF;
+
+        flat_dispatch() {}
+        flat_dispatch(std::initializer_list<value_type> init) {
+            for (const value_type& entry : init) emplace(entry.first, entry.second);
+        }
+
+        iterator begin() { return entries_; }
+        iterator end() { return entries_ + size_; }
+        const_iterator begin() const { return entries_; }
+        const_iterator end() const { return entries_ + size_; }
+        size_t size() const { return size_; }
+        bool empty() const { return size_ == 0; }
+        static constexpr size_t capacity() { return N; }
+
+        /** Appends unless the key exists, is too long or the map is full */
+        std::pair<iterator, bool> emplace(const key_type& key, const ValueT& value) {
+            iterator it = begin() + search(key.c_str());
+            if (it != end()) return std::make_pair(it, false);
+            if (key.empty() || size_ >= N) {
+                refused_++;
+                return std::make_pair(end(), false);
+            }
+            entries_[size_].first  = key;
+            entries_[size_].second = value;
+            sealed_                = false;
+            return std::make_pair(&entries_[size_++], true);
+        }
+
+        std::pair<iterator, bool> insert(const value_type& entry) { return emplace(entry.first, entry.second); }
+
+        /** A refused key gets a scratch value that no find() returns */
+        ValueT& operator[](const key_type& key) {
+            std::pair<iterator, bool> added = emplace(key, ValueT());
+            if (added.first != end()) return added.first->second;
+            static ValueT scratch;
+            scratch = ValueT();
+            return scratch;
+        }
+
+        iterator find(const char* key) { return begin() + lookup(key); }
+        iterator find(const key_type& key) { return find(key.c_str()); }
+
+        const_iterator find(const char* key) const { return begin() + lookup(key); }
+        const_iterator find(const key_type& key) const { return find(key.c_str()); }
+
+        size_t count(const key_type& key) const { return find(key) != end() ? 1 : 0; }
+
+        /** Build the hash now, e.g. at the end of setup(). @return perfect() */
+        bool seal() {
+            sealed_  = true;
+            perfect_ = false;
+            for (uint32_t seed = 0; seed < SEEDS && !perfect_; seed++) {
+                perfect_ = try_seed(seed);
+            }
+            return perfect_;
+        }
+
+        bool perfect() const { return sealed_ && perfect_; }
+        uint32_t seed() const { return seed_; }
+        /** emplace() calls refused for a key too long or a full map */
+        size_t refused() const { return refused_; }
+
+     protected:
+        bool try_seed(uint32_t seed) {
+            memset(slots_, EMPTY, sizeof(slots_));
+            for (size_t i = 0; i < size_; i++) {
+                uint8_t& slot = slots_[seeded_hash(entries_[i].first.c_str(), seed) & (SLOTS - 1)];
+                if (slot != EMPTY) return false;
+                slot = static_cast<uint8_t>(i);
+            }
+            seed_ = seed;
+            return true;
+        }
+
+        /** @return index of key, size_ if absent */
+        size_t lookup(const char* key) const {
+            if (!perfect()) return search(key);
+            uint8_t i = slots_[seeded_hash(key, seed_) & (SLOTS - 1)];
+            return (i != EMPTY && entries_[i].first == key) ? i : size_;
+        }
+
+        size_t search(const char* key) const {
+            for (size_t i = 0; i < size_; i++) {
+                if (entries_[i].first == key) return i;
+            }
+            return size_;
+        }
+
+        value_type entries_[N];
+        uint8_t slots_[SLOTS];
+        size_t size_    = 0;
+        size_t refused_ = 0;
+        uint32_t seed_  = 0;
+        bool sealed_   = false;
+        bool perfect_  = false;
+    };
+
+}; // namespace
+
+#endif // #ifndef __FLATDISPATCH_H__
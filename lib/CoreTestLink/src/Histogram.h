@@ -0,0 +1,100 @@
+#pragma once
+
+#ifndef __HISTOGRAM_H__
+    #define __HISTOGRAM_H__
+
+    #include "LinkCommon.h"
+    #ifdef _MSC_VER
+        #include <intrin.h>
+    #endif
+
+namespace ctl {
+
+    /** Index of the highest set bit. v must be non-zero. */
+    inline unsigned ilog2(uint32_t v) {
+    #ifdef _MSC_VER
+        unsigned long index;
+        _BitScanReverse(&index, v);
+        return static_cast<unsigned>(index);
+    #else
+        return 31u - static_cast<unsigned>(__builtin_clz(v));
+    #endif
+    }
+
+    /**
+     * @brief Log-linear histogram of unsigned 32-bit samples.
+     *
+     * Values below 8 get their own bucket. Above that every power of two is
+     * split into 8 linear sub-buckets, so bucket bounds are within 12.5% of
+     * any recorded value. Recording is a bit scan, two shifts and an
+     * increment; no floating point, so it is cheap enough for an ISR.
+     *
+     * 240 buckets cover the full uint32_t range. Counters saturate rather
+     * than wrap.
+     */
+    class log_histogram {
+     public:
+        static constexpr unsigned SUB_BITS = 3;
+        static constexpr unsigned SUB      = 1u << SUB_BITS;
+        static constexpr unsigned BUCKETS  = (32 - SUB_BITS + 1) * SUB;
+
+        static unsigned bucket(uint32_t v) {
+            if (v < SUB) return v;
+            unsigned e = ilog2(v);
+            return (e - SUB_BITS + 1) * SUB + ((v >> (e - SUB_BITS)) & (SUB - 1));
+        }
+
+        /** Smallest value that falls into bucket b */
+        static uint32_t lower_bound(unsigned b) {
+            if (b < SUB) return b;
+            unsigned e = b / SUB + SUB_BITS - 1;
+            return (1u << e) | ((b % SUB) << (e - SUB_BITS));
+        }
+
+        /** Largest value that falls into bucket b */
+        static uint32_t upper_bound(unsigned b) {
+            return b + 1 < BUCKETS ? lower_bound(b + 1) - 1 : 0xFFFFFFFFu;
+        }
+
+        void record(uint32_t v) {
+            uint32_t& c = counts_[bucket(v)];
+            if (c != 0xFFFFFFFFu) c++;
+            if (v > max_) max_ = v;
+            sum_ += v;
+            count_++;
+        }
+
+        void reset() {
+            for (unsigned b = 0; b < BUCKETS; b++) counts_[b] = 0;
+            count_ = sum_ = 0;
+            max_          = 0;
+        }
+
+        uint32_t count() const { return count_; }
+        uint32_t max() const { return max_; }
+        uint32_t at(unsigned b) const { return counts_[b]; }
+        double mean() const { return count_ ? static_cast<double>(sum_) / count_ : 0.0; }
+
+        /** Upper bound of the bucket holding the given fraction (0..1) of samples */
+        uint32_t percentile(double fraction) const {
+            if (count_ == 0) return 0;
+            uint64_t rank = static_cast<uint64_t>(fraction * count_ + 0.5);
+            if (rank < 1) rank = 1;
+            uint64_t seen = 0;
+            for (unsigned b = 0; b < BUCKETS; b++) {
+                seen += counts_[b];
+                if (seen >= rank) return upper_bound(b) < max_ ? upper_bound(b) : max_;
+            }
+            return max_;
+        }
+
+     protected:
+        uint32_t counts_[BUCKETS] = {};
+        uint32_t count_           = 0;
+        uint32_t max_             = 0;
+        uint64_t sum_             = 0;
+    };
+
+}; // namespace
+
+#endif // #ifndef __HISTOGRAM_H__
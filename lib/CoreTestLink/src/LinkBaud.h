@@ -0,0 +1,186 @@
+#pragma once
+
+#ifndef __LINKBAUD_H__
+    #define __LINKBAUD_H__
+
+    #include "LinkChecksum.h"
+    #include "LinkCommon.h"
+    #include "SlipFrame.h"
+
+namespace ctl {
+
+    /**
+     * Baud rate negotiation RPCs.
+     *
+     * Both ends start at BAUD_DEFAULT. Then, for each candidate rate from the
+     * fastest down:
+     *
+     * 1. RPC_BAUD_TRY(index) -> 0. The firmware replies at the old rate,
+     *    switches, and waits up to BAUD_TRIAL_MS for a test burst.
+     * 2. The hub switches and sends a burst frame (see make_burst). The
+     *    firmware echoes it if the CRC matches, otherwise it keeps waiting.
+     * 3. If the echo comes back intact, RPC_BAUD_CONFIRM() -> new rate makes
+     *    it permanent. Without a confirm within another BAUD_TRIAL_MS the
+     *    firmware falls back to the old rate on its own.
+     *
+     * RPC_BAUD() -> mask of supported BAUD_RATES indices.
+     */
+    constexpr const char* RPC_BAUD         = "?baud";
+    constexpr const char* RPC_BAUD_TRY     = "!baud";
+    constexpr const char* RPC_BAUD_CONFIRM = "!bauc";
+
+    constexpr uint32_t BAUD_RATES[] = {9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600};
+    constexpr int BAUD_COUNT        = sizeof(BAUD_RATES) / sizeof(BAUD_RATES[0]);
+
+    constexpr uint32_t BAUD_DEFAULT       = 57600; ///< rate both ends connect at
+    constexpr unsigned long BAUD_TRIAL_MS = 250;   ///< firmware wait for burst, then for confirm
+
+    constexpr uint8_t BAUD_BURST_MARKER = '~';
+    constexpr size_t BAUD_BURST_BYTES   = 64; ///< payload, plus marker and crc16
+
+    constexpr int BAUD_ERROR_RATE  = -1; ///< unsupported rate index
+    constexpr int BAUD_ERROR_STATE = -2; ///< nothing to confirm
+
+    /** Index of a rate in BAUD_RATES, or -1 */
+    inline int baud_index(uint32_t rate) {
+        for (int i = 0; i < BAUD_COUNT; i++) {
+            if (BAUD_RATES[i] == rate) return i;
+        }
+        return -1;
+    }
+
+    /**
+     * Fill buf with an un-escaped burst frame: marker, payload, crc16 (big
+     * endian). The payload walks all byte values, including the SLIP
+     * specials, so escaping is exercised too. buf needs BAUD_BURST_BYTES + 3.
+     * @return frame size
+     */
+    inline size_t make_burst(uint8_t* buf, uint8_t seed) {
+        buf[0] = BAUD_BURST_MARKER;
+        for (size_t i = 0; i < BAUD_BURST_BYTES; i++) {
+            buf[1 + i] = static_cast<uint8_t>(seed + i * 37);
+        }
+        uint16_t crc               = crc16(buf, BAUD_BURST_BYTES + 1);
+        buf[BAUD_BURST_BYTES + 1] = static_cast<uint8_t>(crc >> 8);
+        buf[BAUD_BURST_BYTES + 2] = static_cast<uint8_t>(crc & 0xFF);
+        return BAUD_BURST_BYTES + 3;
+    }
+
+    /** Check an un-escaped burst frame */
+    inline bool check_burst(const uint8_t* frame, size_t size) {
+        if (size != BAUD_BURST_BYTES + 3 || frame[0] != BAUD_BURST_MARKER) return false;
+        uint16_t crc = crc16(frame, BAUD_BURST_BYTES + 1);
+        return frame[BAUD_BURST_BYTES + 1] == (crc >> 8) && frame[BAUD_BURST_BYTES + 2] == (crc & 0xFF);
+    }
+
+    /**
+     * @brief Firmware side of the baud rate negotiation.
+     *
+     * Call poll() at the top of loop(). While it returns true the switch owns
+     * the serial port (it is looking for the test burst) and the server must
+     * not run.
+     *
+     * @tparam SerialT  anything with begin(rate), flush() and the Stream interface
+     */
+    template <class SerialT>
+    class baud_switch {
+     public:
+        baud_switch(SerialT& serial, uint32_t rate = BAUD_DEFAULT, uint32_t max_rate = 921600)
+            : serial_(serial), rate_(rate), old_rate_(rate) {
+            for (int i = 0; i < BAUD_COUNT; i++) {
+                if (BAUD_RATES[i] <= max_rate) supported_ |= 1 << i;
+            }
+        }
+
+        uint32_t rate() const { return rate_; }
+        int capabilities() const { return supported_; }
+
+        /** RPC_BAUD_TRY handler. Switches on the next poll(), after the reply. */
+        int request(int index) {
+            if (index < 0 || index >= BAUD_COUNT || !(supported_ & (1 << index))) return BAUD_ERROR_RATE;
+            pending_ = BAUD_RATES[index];
+            state_   = PENDING;
+            return 0;
+        }
+
+        /** RPC_BAUD_CONFIRM handler */
+        int confirm() {
+            if (state_ != CONFIRM) return BAUD_ERROR_STATE;
+            old_rate_ = rate_;
+            state_    = IDLE;
+            return static_cast<int>(rate_);
+        }
+
+        /** @return true while the switch owns the port */
+        bool poll(unsigned long now_ms) {
+            switch (state_) {
+                case IDLE:
+                    return false;
+                case PENDING:
+                    serial_.flush();
+                    begin(pending_);
+                    state_ = TRIAL;
+                    since_ = now_ms;
+                    len_   = 0;
+                    return true;
+                case TRIAL:
+                    if (now_ms - since_ > BAUD_TRIAL_MS) {
+                        fall_back();
+                        return false;
+                    }
+                    read_burst(now_ms);
+                    return state_ == TRIAL;
+                case CONFIRM:
+                    if (now_ms - since_ > BAUD_TRIAL_MS) fall_back();
+                    return false;
+            }
+            return false;
+        }
+
+     protected:
+        enum state_t { IDLE, PENDING, TRIAL, CONFIRM };
+
+        void begin(uint32_t rate) {
+            rate_ = rate;
+            serial_.begin(rate);
+        }
+
+        void fall_back() {
+            serial_.flush();
+            begin(old_rate_);
+            state_ = IDLE;
+        }
+
+        // garbage at a mismatched rate is discarded frame by frame
+        void read_burst(unsigned long now_ms) {
+            while (serial_.available() > 0) {
+                int c = serial_.read();
+                if (c < 0) break;
+                if (c != SLIP_END) {
+                    if (len_ < sizeof(buf_)) buf_[len_++] = static_cast<uint8_t>(c);
+                    continue;
+                }
+                size_t n = slip_decode(buf_, len_);
+                len_     = 0;
+                if (check_burst(buf_, n)) {
+                    slip_write(serial_, buf_, n);
+                    serial_.flush();
+                    state_ = CONFIRM;
+                    since_ = now_ms;
+                    return;
+                }
+            }
+        }
+
+        SerialT& serial_;
+        uint32_t rate_, old_rate_, pending_ = 0;
+        int supported_ = 0;
+        state_t state_ = IDLE;
+        unsigned long since_ = 0;
+        uint8_t buf_[2 * (BAUD_BURST_BYTES + 3)];
+        size_t len_ = 0;
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKBAUD_H__
@@ -0,0 +1,79 @@
+#pragma once
+
+#ifndef __LINKCHANNELS_H__
+    #define __LINKCHANNELS_H__
+
+    #include "LinkCommon.h"
+    #include "SequenceUpload.h"
+    #include <type_traits>
+    #include <utility>
+
+namespace ctl {
+
+    /**
+     * All-channel RPCs of a channel property group.
+     *
+     * RPC_CHANNELS_GET(group) -> base64 of all channel values, packed
+     * little-endian like a sequence upload chunk; empty for an unknown group.
+     *
+     * RPC_CHANNELS_SET(group, base64) -> number of channels set, or <0.
+     * The values are decoded and checked first and then applied back to
+     * back, so either every channel changes in the same loop() pass or none.
+     */
+    constexpr const char* RPC_CHANNELS_GET = "?chv";
+    constexpr const char* RPC_CHANNELS_SET = "!chv";
+
+    constexpr int CHANNELS_ERROR_GROUP = -1; ///< unknown channel group
+    constexpr int CHANNELS_ERROR_DATA  = -2; ///< not base64 or not one value per channel
+
+    /**
+     * @brief The channels of a channel property, set and read as one vector.
+     *
+     * @tparam PropT  channel property with get() and set(value), e.g. rdl::simple_prop_base
+     * @tparam N      number of channels
+     */
+    template <class PropT, size_t N>
+    class channel_group {
+     public:
+        using ValueT = typename std::decay<decltype(std::declval<PropT&>().get())>::type;
+
+        static constexpr size_t PACKED_BYTES = N * sizeof(ValueT);
+        /** get() buffer size, including the terminating null */
+        static constexpr size_t TEXT_SIZE = 4 * ((PACKED_BYTES + 2) / 3) + 1;
+
+        channel_group(const char* name, PropT* const (&channels)[N]) : name_(name) {
+            for (size_t i = 0; i < N; i++) channels_[i] = channels[i];
+        }
+
+        const char* name() const { return name_; }
+        size_t size() const { return N; }
+
+        /** All values as null terminated base64. @return characters written, 0 if dest is too small */
+        size_t get(char* dest, size_t dest_size) const {
+            uint8_t packed[PACKED_BYTES];
+            for (size_t i = 0; i < N; i++) pack_le<ValueT>(packed + i * sizeof(ValueT), channels_[i]->get());
+            if (dest_size < TEXT_SIZE) return 0;
+            size_t n = base64_encode(dest, dest_size, packed, PACKED_BYTES);
+            dest[n]  = '\0';
+            return n;
+        }
+
+        /** @return N or CHANNELS_ERROR_DATA */
+        int set(const char* data) {
+            uint8_t packed[PACKED_BYTES];
+            int n = base64_decode(packed, sizeof(packed), data, strlen(data));
+            if (n != static_cast<int>(PACKED_BYTES)) return CHANNELS_ERROR_DATA;
+            ValueT values[N];
+            for (size_t i = 0; i < N; i++) values[i] = unpack_le<ValueT>(packed + i * sizeof(ValueT));
+            for (size_t i = 0; i < N; i++) channels_[i]->set(values[i]);
+            return static_cast<int>(N);
+        }
+
+     protected:
+        const char* name_;
+        PropT* channels_[N];
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKCHANNELS_H__
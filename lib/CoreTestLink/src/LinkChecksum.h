@@ -0,0 +1,30 @@
+#pragma once
+
+#ifndef __LINKCHECKSUM_H__
+    #define __LINKCHECKSUM_H__
+
+    #include "LinkCommon.h"
+
+namespace ctl {
+
+    constexpr uint16_t CRC16_INIT = 0xFFFF;
+
+    /**
+     * @brief CRC-16/CCITT-FALSE, bitwise.
+     *
+     * Small enough for the MCU and fast enough for the few kilobytes we check.
+     * Pass the previous result as crc to checksum a buffer in pieces.
+     */
+    inline uint16_t crc16(const uint8_t* data, size_t size, uint16_t crc = CRC16_INIT) {
+        while (size--) {
+            crc ^= static_cast<uint16_t>(*data++) << 8;
+            for (int bit = 0; bit < 8; bit++) {
+                crc = (crc & 0x8000) ? static_cast<uint16_t>((crc << 1) ^ 0x1021) : static_cast<uint16_t>(crc << 1);
+            }
+        }
+        return crc;
+    }
+
+}; // namespace
+
+#endif // #ifndef __LINKCHECKSUM_H__
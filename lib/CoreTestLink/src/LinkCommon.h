@@ -0,0 +1,59 @@
+#pragma once
+
+#ifndef __LINKCOMMON_H__
+    #define __LINKCOMMON_H__
+
+    #include <stddef.h>
+    #include <stdint.h>
+
+    #ifdef ARDUINO
+        #include <Arduino.h>
+    #else
+        #include <Stream.h> // for arduino::Stream
+    #endif
+
+/**
+ * @brief Link-level helpers shared by the hub (host) and the firmware (MCU).
+ *
+ * Everything in this namespace must compile on both sides: no exceptions,
+ * no threads, and no heap allocation after construction.
+ */
+namespace ctl {
+
+    #ifdef ARDUINO
+    using StreamT = ::Stream;
+    using PrintT  = ::Print;
+    #else
+    using StreamT = arduino::Stream;
+    using PrintT  = arduino::Print;
+    #endif
+
+    typedef int error_t;
+
+    constexpr error_t NO_ERROR       = 0;  ///< no error
+    constexpr error_t ERROR_TIMEOUT  = -1; ///< stream timeout error
+    constexpr error_t ERROR_BUFFER   = -2; ///< frame did not fit in the buffer
+
+    /**
+     * @brief Interrupts held off for the guard's scope.
+     *
+     * For loop() code sharing more than one word with an interrupt handler,
+     * never for the handler itself: it enables interrupts on the way out.
+     * Host builds take their interrupts between loop() passes (CTL_HOST_TIMER)
+     * or have none, so there it does nothing.
+     */
+    class interrupt_guard {
+     public:
+    #if defined(ARDUINO) && !defined(CTL_HOST_TIMER)
+        interrupt_guard() { noInterrupts(); }
+        ~interrupt_guard() { interrupts(); }
+    #else
+        interrupt_guard() {}
+    #endif
+        interrupt_guard(const interrupt_guard&) = delete;
+        interrupt_guard& operator=(const interrupt_guard&) = delete;
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKCOMMON_H__
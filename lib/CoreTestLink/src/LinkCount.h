@@ -0,0 +1,57 @@
+#pragma once
+
+#ifndef __LINKCOUNT_H__
+    #define __LINKCOUNT_H__
+
+    #include "LinkCommon.h"
+
+namespace ctl {
+
+    /**
+     * @brief Pass-through stream that counts the bytes on the wire.
+     *
+     * Sits between an rdl::json_client and the physical stream, so the hub's
+     * benchmarks can report wire bytes per call. Bytes pass unchanged.
+     */
+    class counting_stream : public StreamT {
+     public:
+        counting_stream(StreamT& wire) : wire_(wire) {}
+
+        size_t wire_tx_bytes() const { return wire_tx_; }
+        size_t wire_rx_bytes() const { return wire_rx_; }
+        void reset_stats() { wire_tx_ = wire_rx_ = 0; }
+
+        StreamT& wire() { return wire_; }
+
+        // Print interface
+
+        size_t write(uint8_t c) override {
+            size_t n = wire_.write(c);
+            wire_tx_ += n;
+            return n;
+        }
+
+        using StreamT::write;
+
+        void flush() override { wire_.flush(); }
+
+        // Stream interface
+
+        int available() override { return wire_.available(); }
+
+        int read() override {
+            int c = wire_.read();
+            if (c >= 0) wire_rx_++;
+            return c;
+        }
+
+        int peek() override { return wire_.peek(); }
+
+     protected:
+        StreamT& wire_;
+        size_t wire_tx_ = 0, wire_rx_ = 0;
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKCOUNT_H__
@@ -0,0 +1,109 @@
+#pragma once
+
+#ifndef __LINKFIXED_H__
+    #define __LINKFIXED_H__
+
+    #include "LinkCommon.h"
+    #include <string.h>
+
+namespace ctl {
+
+    /**
+     * Fixed-point channel RPCs.
+     *
+     * A channel value travels as a scaled integer: value = raw * scale +
+     * offset. The hub converts to and from decimal text, so the device never
+     * formats or parses a decimal number; it applies raw to the channel's
+     * own property with one multiply-add, and reads it back the same way:
+     *
+     *  - RPC_FIXED_GET(name)      -> raw, or FIXED_INVALID for an unknown channel
+     *  - RPC_FIXED_SET(name, raw) -> 0, or <0
+     */
+    constexpr const char* RPC_FIXED_GET = "?fx";
+    constexpr const char* RPC_FIXED_SET = "!fx";
+
+    constexpr int FIXED_ERROR_NAME  = -1; ///< unknown channel
+    constexpr int FIXED_ERROR_VALUE = -2; ///< FIXED_INVALID is not a value
+    constexpr int32_t FIXED_INVALID = INT32_MIN; ///< get() of an unknown channel
+
+    /** Scale and offset of one fixed-point channel */
+    struct fixed_point {
+        constexpr fixed_point(double scale_ = 0.0, double offset_ = 0.0) : scale(scale_), offset(offset_) {}
+
+        bool valid() const { return scale != 0.0; }
+
+        double value(int32_t raw) const { return raw * scale + offset; }
+
+        /** Nearest raw value. @return false if v is out of the int32 range */
+        bool raw(double v, int32_t& out) const {
+            double r = (v - offset) / scale;
+            r        = r < 0 ? r - 0.5 : r + 0.5;
+            if (!(r > -2147483648.0 && r < 2147483648.0)) return false;
+            out = static_cast<int32_t>(r);
+            return out != FIXED_INVALID;
+        }
+
+        /** Smallest and largest value raw() takes */
+        double lowest() const { return value(scale > 0 ? FIXED_INVALID + 1 : INT32_MAX); }
+        double highest() const { return value(scale > 0 ? INT32_MAX : FIXED_INVALID + 1); }
+
+        double scale;
+        double offset;
+    };
+
+    /** Scale and offset of the bar channels, shared by the hub and the firmware */
+    constexpr fixed_point BAR_FIXED(1e-4, 0.0);
+
+    /**
+     * @brief Device side of the fixed-point RPCs over N named properties.
+     *
+     * set() writes value(raw) into the property itself and get() returns its
+     * current value as raw, so a channel set here reads back the same through
+     * the property's decimal and channel RPCs, playback and notifications.
+     *
+     * @tparam PropT  property with get() and set(double), e.g. rdl::simple_prop_base<double>
+     * @tparam N      number of channels
+     */
+    template <class PropT, size_t N>
+    class fixed_channels {
+     public:
+        fixed_channels(const char* const (&names)[N], PropT* const (&props)[N], fixed_point fixed)
+            : fixed_(fixed) {
+            for (size_t i = 0; i < N; i++) {
+                names_[i] = names[i];
+                props_[i] = props[i];
+            }
+        }
+
+        /** @return raw, or FIXED_INVALID for an unknown channel or a value out of range */
+        int32_t get(const char* name) const {
+            int i = find(name);
+            int32_t raw;
+            if (i < 0 || !fixed_.raw(props_[i]->get(), raw)) return FIXED_INVALID;
+            return raw;
+        }
+
+        int set(const char* name, int32_t raw) {
+            int i = find(name);
+            if (i < 0) return FIXED_ERROR_NAME;
+            if (raw == FIXED_INVALID) return FIXED_ERROR_VALUE;
+            props_[i]->set(fixed_.value(raw));
+            return 0;
+        }
+
+     protected:
+        int find(const char* name) const {
+            for (size_t i = 0; i < N; i++) {
+                if (strcmp(names_[i], name) == 0) return static_cast<int>(i);
+            }
+            return -1;
+        }
+
+        const fixed_point fixed_;
+        const char* names_[N];
+        PropT* props_[N];
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKFIXED_H__
@@ -0,0 +1,41 @@
+#pragma once
+
+#ifndef __LINKIDLE_H__
+    #define __LINKIDLE_H__
+
+    #include "LinkCommon.h"
+
+namespace ctl {
+
+    #if defined(CTL_HOST_IDLE)
+    /** Provided by a host build: block until input arrives or the next 1 ms tick */
+    void host_idle();
+    #endif
+
+    /**
+     * Sleep until there may be work, in place of delay(1).
+     *
+     * ready() says whether the next loop() pass has work already: a whole
+     * request, input on a port nothing drains from an interrupt, a task an
+     * interrupt signalled. It must read only what interrupts write, never
+     * wait. On Cortex-M this is WFI with interrupts masked: an interrupt that
+     * arrives between the check and the WFI is left pending and still ends
+     * the sleep. The 1 ms tick also ends it, so millis() timers keep running.
+     * Elsewhere it returns at once unless the build provides host_idle().
+     */
+    template <class ReadyF>
+    inline void wait_for_input(ReadyF ready) {
+    #if defined(CTL_HOST_IDLE)
+        if (!ready()) host_idle();
+    #elif defined(ARDUINO) && defined(__arm__)
+        __asm__ volatile("cpsid i" ::: "memory");
+        if (!ready()) __asm__ volatile("wfi");
+        __asm__ volatile("cpsie i" ::: "memory");
+    #else
+        (void)ready;
+    #endif
+    }
+
+}; // namespace
+
+#endif // #ifndef __LINKIDLE_H__
@@ -0,0 +1,280 @@
+#pragma once
+
+#ifndef __LINKNOTIFY_H__
+    #define __LINKNOTIFY_H__
+
+    #include "LinkCommon.h"
+    #include "SlipFrame.h"
+    #include <string.h>
+    #include <type_traits>
+    #include <utility>
+
+namespace ctl {
+
+    /**
+     * Property change subscription RPC.
+     *
+     * RPC_SUBSCRIBE(name, interval_ms) -> 0, or <0 if the property is unknown.
+     * interval_ms is the minimum time between two notifications of that
+     * property; a negative interval unsubscribes. Subscriptions belong to
+     * the server port the request came in on, and so do the notifications.
+     *
+     * Notifications are unsolicited text frames:
+     * NOTIFY_MARKER name '=' value SLIP_END
+     */
+    constexpr const char* RPC_SUBSCRIBE = "!sub";
+
+    /**
+     * Batched read of watched properties.
+     *
+     * RPC_VALUES("name name ...") -> "value value ...", current values in
+     * request order, VALUES_UNKNOWN for a name that is not watched. Empty if
+     * the reply would not fit in VALUES_TEXT_SIZE.
+     */
+    constexpr const char* RPC_VALUES = "?vals";
+
+    constexpr int NOTIFY_ERROR_UNKNOWN = -1; ///< no such watched property
+    constexpr char VALUES_SEPARATOR    = ' ';
+    constexpr char VALUES_UNKNOWN      = '?';
+    constexpr size_t VALUES_TEXT_SIZE  = 160;
+
+    /**
+     * Split a decoded notification frame into name and value.
+     * @return false if the frame is not a notification
+     */
+    inline bool parse_notification(const uint8_t* frame, size_t size,
+                                   const char*& name, size_t& name_size,
+                                   const char*& value, size_t& value_size) {
+        if (size < 3 || frame[0] != NOTIFY_MARKER) return false;
+        const char* text = reinterpret_cast<const char*>(frame) + 1;
+        const char* eq   = static_cast<const char*>(memchr(text, '=', size - 1));
+        if (!eq) return false;
+        name       = text;
+        name_size  = static_cast<size_t>(eq - text);
+        value      = eq + 1;
+        value_size = size - 1 - name_size - 1;
+        return name_size > 0;
+    }
+
+    /** Print adapter that SLIP escapes everything written through it */
+    class slip_print : public PrintT {
+     public:
+        slip_print(PrintT& out) : out_(out) {}
+        size_t write(uint8_t c) override {
+            if (c == SLIP_END) return out_.write(SLIP_ESC) + out_.write(SLIP_ESC_END);
+            if (c == SLIP_ESC) return out_.write(SLIP_ESC) + out_.write(SLIP_ESC_ESC);
+            return out_.write(c);
+        }
+        using PrintT::write;
+
+     protected:
+        PrintT& out_;
+    };
+
+    /** Print into a fixed buffer, always null terminated */
+    class text_print : public PrintT {
+     public:
+        text_print(char* dest, size_t size) : dest_(dest), size_(size), len_(0), overflow_(false) {
+            if (size_) dest_[0] = '\0';
+        }
+        size_t write(uint8_t c) override {
+            if (len_ + 1 >= size_) {
+                overflow_ = true;
+                return 0;
+            }
+            dest_[len_++] = static_cast<char>(c);
+            dest_[len_]   = '\0';
+            return 1;
+        }
+        using PrintT::write;
+
+        size_t length() const { return len_; }
+        bool overflow() const { return overflow_; }
+
+     protected:
+        char* dest_;
+        size_t size_;
+        size_t len_;
+        bool overflow_;
+    };
+
+    /// @name print values at full precision (Print defaults to 2 decimals)
+    /// @{
+    inline size_t print_value(PrintT& out, double v) { return out.print(v, 9); }
+    inline size_t print_value(PrintT& out, float v) { return out.print(v, 6); }
+    template <typename T>
+    inline size_t print_value(PrintT& out, T v) { return out.print(v); }
+    /// @}
+
+    /** Type-erased watched value, polled for changes */
+    class value_watch {
+     public:
+        value_watch(const char* name) : name_(name) {}
+        virtual ~value_watch() {}
+
+        const char* name() const { return name_; }
+
+        /** Latch the current value. @return true if it differs from the last latch */
+        virtual bool changed()                 = 0;
+        /** The latched value */
+        virtual void print_value(PrintT& out) = 0;
+        /** The current value, without latching it */
+        virtual void print_current(PrintT& out) = 0;
+
+     protected:
+        const char* name_;
+    };
+
+    /**
+     * Watch any property with a get() accessor, e.g. rdl::simple_prop_base.
+     */
+    template <class PropT>
+    class prop_watch : public value_watch {
+     public:
+        using ValueT = typename std::decay<decltype(std::declval<PropT&>().get())>::type;
+
+        prop_watch(const char* name, PropT& prop) : value_watch(name), prop_(prop), last_(prop.get()) {}
+
+        bool changed() override {
+            ValueT now = prop_.get();
+            if (now == last_) return false;
+            last_ = now;
+            return true;
+        }
+
+        void print_value(PrintT& out) override { ctl::print_value(out, last_); }
+        void print_current(PrintT& out) override { ctl::print_value(out, prop_.get()); }
+
+     protected:
+        PropT& prop_;
+        ValueT last_;
+    };
+
+    /**
+     * @brief Pushes coalesced, rate-limited change notifications.
+     *
+     * poll() is called from the main loop after the server has handled its
+     * messages, so notifications never interleave with a reply. Changes that
+     * happen faster than a property's interval are coalesced: only the latest
+     * value goes out once the interval has passed.
+     *
+     * Each server port has its own subscriptions, interval and rate limit,
+     * and its notifications go out on that port only: a monitoring host
+     * subscribing or unsubscribing does not touch what the hub gets.
+     *
+     * @tparam N      watched values
+     * @tparam PORTS  server ports
+     */
+    template <size_t N, size_t PORTS = 1>
+    class change_notifier {
+     public:
+        template <size_t M>
+        change_notifier(value_watch* const (&watches)[M]) : count_(M < N ? M : N) {
+            for (size_t i = 0; i < count_; i++) watches_[i] = watches[i];
+        }
+
+        /** @param port  the server port asking, see round_robin::current() */
+        int subscribe(const char* name, long interval_ms, size_t port = 0) {
+            int i = find(name);
+            if (i < 0 || port >= PORTS) return NOTIFY_ERROR_UNKNOWN;
+            // latch; only report changes from now on, but keep the other ports' news
+            if (watches_[i]->changed()) mark_dirty(static_cast<size_t>(i));
+            subscription& sub = subs_[i][port];
+            sub.interval_ms   = interval_ms;
+            sub.dirty         = false;
+            return 0;
+        }
+
+        /**
+         * Current values of the space separated watched names, see RPC_VALUES.
+         * Does not disturb change detection.
+         * @return false if the reply does not fit
+         */
+        bool values(const char* names, char* dest, size_t dest_size) {
+            text_print out(dest, dest_size);
+            bool first = true;
+            while (*names) {
+                const char* end = strchr(names, VALUES_SEPARATOR);
+                size_t len      = end ? static_cast<size_t>(end - names) : strlen(names);
+                if (len > 0) {
+                    if (!first) out.write(VALUES_SEPARATOR);
+                    int i = find(names, len);
+                    if (i >= 0) {
+                        watches_[i]->print_current(out);
+                    } else {
+                        out.write(VALUES_UNKNOWN);
+                    }
+                    first = false;
+                }
+                names += end ? len + 1 : len;
+            }
+            if (out.overflow() && dest_size) dest[0] = '\0';
+            return !out.overflow();
+        }
+
+        /**
+         * @param outs  each port's stream, PORTS of them
+         * @return number of notifications sent
+         */
+        template <class OutT>
+        size_t poll(unsigned long now_ms, OutT* const (&outs)[PORTS]) {
+            size_t sent = 0;
+            for (size_t i = 0; i < count_; i++) {
+                if (watches_[i]->changed()) mark_dirty(i);
+                for (size_t port = 0; port < PORTS; port++) {
+                    subscription& sub = subs_[i][port];
+                    if (!sub.dirty || now_ms - sub.last_sent < static_cast<unsigned long>(sub.interval_ms)) continue;
+                    send(*outs[port], *watches_[i]);
+                    sub.dirty     = false;
+                    sub.last_sent = now_ms;
+                    sent++;
+                }
+            }
+            return sent;
+        }
+
+        /** Single port notifier */
+        size_t poll(unsigned long now_ms, PrintT& out) {
+            PrintT* const outs[] = {&out};
+            return poll(now_ms, outs);
+        }
+
+     protected:
+        struct subscription {
+            long interval_ms        = -1; ///< <0: not subscribed
+            unsigned long last_sent = 0;
+            bool dirty              = false; ///< changed but held back by the rate limit
+        };
+
+        /** A change every subscribed port has to hear about */
+        void mark_dirty(size_t i) {
+            for (size_t port = 0; port < PORTS; port++) subs_[i][port].dirty = subs_[i][port].interval_ms >= 0;
+        }
+
+        static void send(PrintT& out, value_watch& w) {
+            slip_print escaped(out);
+            out.write(NOTIFY_MARKER);
+            escaped.print(w.name());
+            escaped.write('=');
+            w.print_value(escaped);
+            out.write(SLIP_END);
+        }
+
+        int find(const char* name) { return name ? find(name, strlen(name)) : -1; }
+
+        int find(const char* name, size_t len) {
+            for (size_t i = 0; i < count_; i++) {
+                const char* wn = watches_[i]->name();
+                if (strncmp(wn, name, len) == 0 && wn[len] == '\0') return static_cast<int>(i);
+            }
+            return -1;
+        }
+
+        value_watch* watches_[N];
+        subscription subs_[N][PORTS];
+        size_t count_;
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKNOTIFY_H__
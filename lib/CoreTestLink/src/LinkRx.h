@@ -0,0 +1,147 @@
+#pragma once
+
+#ifndef __LINKRX_H__
+    #define __LINKRX_H__
+
+    #include "LinkCommon.h"
+    #include "SlipFrame.h"
+    #include "SpscQueue.h"
+    #include <atomic>
+
+namespace ctl {
+
+    /**
+     * @brief Serial input moved into a ring buffer, frame by frame.
+     *
+     * drain() moves whatever the serial port holds into the ring and counts
+     * each SLIP_END that closes a frame, so the loop can tell a whole request
+     * is waiting from frames() without reading a byte. Idle ENDs between
+     * frames are dropped. on_frame() is called from drain() when a frame
+     * completes, e.g. to time the request's wait from there.
+     *
+     * The firmware drains from serialEvent(), which the core calls from
+     * yield() between loop() passes and while delay() waits, or else at the
+     * top of loop(): at yield time, not from an interrupt. The ring is
+     * single producer, single consumer, so a UART receive interrupt could
+     * feed it with receive() one byte at a time while loop() reads.
+     *
+     * If the ring fills, the rest of that frame is dropped up to its END,
+     * which is still queued once there is room: the server then sees one
+     * short frame it rejects instead of two frames run together. Bytes lost
+     * are in overruns(), frames cut short in damaged().
+     *
+     * Everything else is the Stream the server and the baud switch read
+     * from, and begin(), flush() and writes go straight to the serial port.
+     *
+     * @tparam SerialT  the port, anything with begin(rate), flush() and the Stream interface
+     * @tparam N        ring size in bytes, a power of two
+     */
+    template <class SerialT, size_t N>
+    class framed_rx : public StreamT {
+     public:
+        framed_rx(SerialT& serial) : serial_(serial) {}
+
+        /** Called by the producer each time a frame completes */
+        void on_frame(void (*callback)()) { on_frame_ = callback; }
+
+        /// @name producer, serialEvent() or an interrupt only
+        /// @{
+        /** Move all waiting input into the ring. @return frames completed */
+        size_t drain() {
+            size_t frames = 0;
+            while (serial_.available() > 0) {
+                int c = serial_.read();
+                if (c < 0) break;
+                if (receive(static_cast<uint8_t>(c))) frames++;
+            }
+            return frames;
+        }
+
+        /** One byte, for producers that get them singly. @return true if it completed a frame */
+        bool receive(uint8_t c) {
+            if (c != SLIP_END) {
+                if (!discard_ && ring_.push(c)) {
+                    pending_++;
+                    return false;
+                }
+                if (!discard_) damaged_.fetch_add(1, std::memory_order_relaxed);
+                discard_ = true;
+                overruns_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if (pending_ == 0 && !discard_) return false; // idle END
+            if (!ring_.push(c)) {
+                overruns_.fetch_add(1, std::memory_order_relaxed);
+                return false; // still discarding, this END is lost too
+            }
+            pending_  = 0;
+            discard_  = false;
+            size_t in = frames_in_.load(std::memory_order_relaxed) + 1;
+            frames_in_.store(in, std::memory_order_release);
+            size_t used = ring_.size();
+            if (used > peak_.load(std::memory_order_relaxed)) peak_.store(used, std::memory_order_relaxed);
+            if (on_frame_) on_frame_();
+            return true;
+        }
+        /// @}
+
+        /// @name consumer, loop() only
+        /// @{
+        /** Complete frames waiting in the ring */
+        size_t frames() const {
+            return frames_in_.load(std::memory_order_acquire) - frames_out_.load(std::memory_order_relaxed);
+        }
+
+        size_t overruns() const { return overruns_.load(std::memory_order_relaxed); }
+        size_t damaged() const { return damaged_.load(std::memory_order_relaxed); }
+        /** Most bytes the ring held when a frame completed */
+        size_t peak() const { return peak_.load(std::memory_order_relaxed); }
+        static constexpr size_t capacity() { return N; }
+
+        int available() override { return static_cast<int>(ring_.size()); }
+
+        int read() override {
+            uint8_t c;
+            if (!ring_.pop(c)) return -1;
+            if (c == SLIP_END) {
+                size_t out = frames_out_.load(std::memory_order_relaxed) + 1;
+                frames_out_.store(out, std::memory_order_relaxed);
+            }
+            return c;
+        }
+
+        int peek() override {
+            uint8_t c;
+            return ring_.front(c) ? c : -1;
+        }
+        /// @}
+
+        size_t write(uint8_t c) override { return serial_.write(c); }
+        size_t write(const uint8_t* buffer, size_t size) override { return serial_.write(buffer, size); }
+        using StreamT::write;
+
+        void flush() override { serial_.flush(); }
+        void begin(uint32_t rate) { serial_.begin(rate); }
+        explicit operator bool() { return static_cast<bool>(serial_); }
+
+        SerialT& serial() { return serial_; }
+
+     protected:
+        SerialT& serial_;
+        spsc_queue<uint8_t, N> ring_;
+        void (*on_frame_)() = nullptr;
+
+        // producer side
+        size_t pending_ = 0; ///< bytes of the current frame queued
+        bool discard_   = false;
+
+        std::atomic<size_t> frames_in_{0};
+        std::atomic<size_t> frames_out_{0};
+        std::atomic<size_t> overruns_{0};
+        std::atomic<size_t> damaged_{0};
+        std::atomic<size_t> peak_{0};
+    };
+
+}; // namespace
+
+#endif // #ifndef __LINKRX_H__
@@ -0,0 +1,116 @@
+#pragma once
+
+#ifndef __METHODIDS_H__
+    #define __METHODIDS_H__
+
+    #include "LinkCommon.h"
+    #include <string.h>
+
+namespace ctl {
+
+    /**
+     * Method id negotiation RPC.
+     *
+     * RPC_METHOD_IDS() -> "name0 name1 name2 ...", the dispatch table in id
+     * order. From then on the hub may send "#<id>" in place of a method name.
+     * The firmware keeps accepting names, so a hub that never asks, or a
+     * firmware that does not know the RPC, keeps working with names.
+     */
+    constexpr const char* RPC_METHOD_IDS = "?mids";
+
+    constexpr char METHOD_ID_PREFIX = '#';
+    constexpr char METHOD_ID_SEPARATOR = ' ';
+
+    /** @return the id of a "#<id>" method, or -1 for a method name */
+    inline int method_id(const char* method) {
+        if (!method || method[0] != METHOD_ID_PREFIX || method[1] == '\0') return -1;
+        int id = 0;
+        for (const char* p = method + 1; *p; p++) {
+            if (*p < '0' || *p > '9' || id > 9999) return -1;
+            id = id * 10 + (*p - '0');
+        }
+        return id;
+    }
+
+    /**
+     * @brief Dispatch map that also finds its methods by id.
+     *
+     * Drop-in for the server's MapT. Names are looked up in the underlying map
+     * as before; "#<id>" methods are an array index into the iterators latched
+     * by index(), so the hot path does no string hashing.
+     *
+     * Call index() once the map is complete (e.g. from the RPC_METHOD_IDS
+     * handler). Adding methods afterwards invalidates the ids until the next
+     * index().
+     *
+     * @tparam MapT  underlying map, e.g. std::unordered_map<StringT, json_stub, ...>
+     * @tparam N     most methods that get an id
+     */
+    template <class MapT, size_t N = 64>
+    class indexed_map : public MapT {
+     public:
+        using typename MapT::const_iterator;
+        using typename MapT::iterator;
+        using typename MapT::key_type;
+
+        using MapT::MapT;
+
+        /** Assign ids in iteration order. @return number of ids */
+        size_t index() {
+            count_ = 0;
+            for (iterator it = MapT::begin(); it != MapT::end() && count_ < N; ++it) {
+                ids_[count_++] = it;
+            }
+            return count_;
+        }
+
+        size_t indexed() const { return count_; }
+
+        /** Method name of an id. Only valid below indexed(). */
+        const key_type& name(size_t id) const { return ids_[id]->first; }
+
+        /** The id table in the RPC_METHOD_IDS reply format. @return false if it does not fit */
+        bool table(char* out, size_t size) const {
+            size_t len = 0;
+            for (size_t id = 0; id < count_; id++) {
+                const char* s = name(id).c_str();
+                size_t n      = strlen(s);
+                if (len + (id ? 1 : 0) + n + 1 > size) return false;
+                if (id) out[len++] = METHOD_ID_SEPARATOR;
+                memcpy(out + len, s, n);
+                len += n;
+            }
+            if (size == 0) return false;
+            out[len] = '\0';
+            return true;
+        }
+
+        iterator find(const key_type& key) {
+            int id = method_id(key.c_str());
+            if (id < 0) {
+                found_ = MapT::find(key);
+            } else {
+                found_ = static_cast<size_t>(id) < count_ ? ids_[id] : MapT::end();
+            }
+            return found_;
+        }
+
+        /** Result of the last non-const find() since clear_found(), else end() */
+        iterator found() const { return found_; }
+        void clear_found() { found_ = MapT::end(); }
+
+        const_iterator find(const key_type& key) const {
+            int id = method_id(key.c_str());
+            if (id < 0) return MapT::find(key);
+            return static_cast<size_t>(id) < count_ ? const_iterator(ids_[id]) : MapT::end();
+        }
+
+     protected:
+        iterator ids_[N];
+        size_t count_ = 0;
+        iterator found_{};
+    };
+
+}; // namespace
+
+#endif // #ifndef __METHODIDS_H__
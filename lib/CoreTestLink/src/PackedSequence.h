@@ -0,0 +1,271 @@
+#pragma once
+
+#ifndef __PACKEDSEQUENCE_H__
+    #define __PACKEDSEQUENCE_H__
+
+    #include "LinkCommon.h"
+    #include "LinkFixed.h"
+    #include "SequenceUpload.h"
+
+namespace ctl {
+
+    /**
+     * Integer raw value a sequence value is coded as. Integers are their own
+     * raw value; doubles are scaled to int32 by the store's fixed_point, so
+     * a decimal ramp, 0.1 per step, has a constant delta like an integer one.
+     */
+    template <typename T>
+    struct packed_raw {
+        using type = T;
+    };
+    template <>
+    struct packed_raw<double> {
+        using type = int32_t;
+    };
+
+    /// @name sequence values to and from their raw integer, as 64-bit keys
+    /// @{
+    inline bool packed_key(int v, const fixed_point&, uint64_t& key) {
+        key = static_cast<uint64_t>(static_cast<int64_t>(v));
+        return true;
+    }
+    inline bool packed_key(long v, const fixed_point&, uint64_t& key) {
+        key = static_cast<uint64_t>(static_cast<int64_t>(v));
+        return true;
+    }
+    inline bool packed_key(double v, const fixed_point& fixed, uint64_t& key) {
+        int32_t raw;
+        if (!fixed.raw(v, raw)) return false;
+        key = static_cast<uint64_t>(static_cast<int64_t>(raw));
+        return true;
+    }
+
+    inline void packed_value(uint64_t key, const fixed_point&, int& v) { v = static_cast<int>(static_cast<int64_t>(key)); }
+    inline void packed_value(uint64_t key, const fixed_point&, long& v) { v = static_cast<long>(static_cast<int64_t>(key)); }
+    inline void packed_value(uint64_t key, const fixed_point& fixed, double& v) {
+        v = fixed.value(static_cast<int32_t>(static_cast<int64_t>(key)));
+    }
+    /// @}
+
+    /** Hold, in steps, of the sequences typical_capacity() is promised for */
+    constexpr size_t PACKED_HOLD_STEPS = 16;
+
+    /**
+     * @brief Sequence storage holding delta and run-length codes.
+     *
+     * Each step is stored as the difference to the step before. A delta that
+     * repeats, a constant value or a constant ramp, is stored once with the
+     * number of steps it covers. Codes are varints: the first byte carries a
+     * run flag and the low 6 bits of the zigzagged delta, later bytes 7 bits
+     * each; a flagged code is followed by a varint run length.
+     *
+     * Doubles are coded as fixed-point integers, raw = (v - offset) / scale
+     * rounded, with the store's fixed_point; they read back as the nearest
+     * multiple of scale. Integers are coded as they are.
+     *
+     * capacity() is what fits of any sequence, one widest code per step.
+     * Typical sequences, steps between a few levels or repeated ramps, take
+     * one to three bytes per change and nothing for steps that repeat the
+     * last change. typical_capacity() is what fits of any sequence that
+     * holds each value for PACKED_HOLD_STEPS steps or more, whatever the
+     * values: one widest delta and one zero run per hold. Ramps cost less.
+     * begin() takes up to typical_capacity() steps; past capacity() a
+     * sequence that changes more often can be too big. That upload fails
+     * with SEQ_ERROR_FULL and leaves the current sequence alone, as does a
+     * double outside the fixed-point range with SEQ_ERROR_RANGE.
+     *
+     * Uploads are encoded as the chunks arrive. Playback decodes with a
+     * cursor: the next step is one code at most, a step within a run is an
+     * addition, and going back starts over from the first code, which the
+     * player only does at the start of a sequence. Like ab_sequence_store
+     * the next sequence is staged in the second buffer and made current by
+     * swap().
+     *
+     * @tparam T      int, long or double. Also the packed wire type.
+     * @tparam BYTES  size of each of the two code buffers
+     */
+    template <typename T, size_t BYTES>
+    class packed_sequence_store : public upload_target {
+     public:
+        using value_type = T;
+
+        /** Widest single-step code: a raw delta, one bit wider, 6 bits then 7 per byte */
+        static constexpr size_t DELTA_CODE_MAX = 1 + (8 * sizeof(typename packed_raw<T>::type) + 1) / 7;
+
+        /** @param fixed  scale and offset of double values, whole numbers by default; unused for integers */
+        packed_sequence_store(const char* name, fixed_point fixed = fixed_point(1.0))
+            : upload_target(name), fixed_(fixed) {}
+
+        /** Steps of any sequence, whatever its values */
+        size_t capacity() const override { return BYTES / DELTA_CODE_MAX; }
+        /** Steps of any sequence holding each value PACKED_HOLD_STEPS steps */
+        size_t typical_capacity() const override { return BYTES / (DELTA_CODE_MAX + 2) * PACKED_HOLD_STEPS; }
+        size_t size() const override { return size_[active_]; }
+        int element_size() const override { return sizeof(T); }
+
+        size_t used_bytes() const override { return used_[active_]; }
+        size_t buffer_bytes() const override { return BYTES; }
+        size_t reads() const override { return reads_; }
+        size_t decoded() const override { return decoded_; }
+
+        /** Step i, below size(). Steps in order cost at most one code each. */
+        T operator[](size_t i) {
+            reads_++;
+            if (next_ == 0 || i + 1 < next_) rewind();
+            while (next_ <= i) {
+                if (run_ == 0 && !read_code()) break;
+                size_t take = i + 1 - next_;
+                if (take > run_) take = run_;
+                key_ += delta_ * take;
+                run_ -= take;
+                next_ += take;
+            }
+            T value;
+            packed_value(key_, fixed_, value);
+            return value;
+        }
+
+        bool swap() override {
+            if (!ready_) return false;
+            active_ ^= 1;
+            ready_ = false;
+            swaps_++;
+            next_ = 0;
+            return true;
+        }
+
+        /** A verified upload is waiting for swap() */
+        bool ready() const { return ready_; }
+        size_t swaps() const { return swaps_; }
+
+     protected:
+        uint8_t inactive() const { return active_ ^ 1; }
+
+        /// @name encoding, into the inactive buffer
+        /// @{
+        int store(size_t, const uint8_t* packed, size_t count) override {
+            for (size_t i = 0; i < count; i++) {
+                uint64_t key;
+                if (!packed_key(unpack_le<T>(packed + i * sizeof(T)), fixed_, key)) return SEQ_ERROR_RANGE;
+                uint64_t delta = key - last_key_;
+                last_key_      = key;
+                if (pending_ && delta == pending_delta_) {
+                    pending_++;
+                    continue;
+                }
+                if (pending_ && !flush()) return SEQ_ERROR_FULL;
+                pending_delta_ = delta;
+                pending_       = 1;
+            }
+            return 0;
+        }
+
+        void staging() override {
+            ready_            = false;
+            used_[inactive()] = 0;
+            last_key_         = 0;
+            pending_delta_    = 0;
+            pending_          = 0;
+        }
+
+        bool committed(size_t count) override {
+            if (pending_ && !flush()) return false;
+            size_[inactive()] = count;
+            ready_            = true;
+            return true;
+        }
+
+        /** Write the pending run as one code. @return false if it does not fit */
+        bool flush() {
+            uint8_t* buf = codes_[inactive()];
+            size_t used  = used_[inactive()];
+            uint64_t zz  = (pending_delta_ << 1) ^ (0 - (pending_delta_ >> 63));
+            bool run     = pending_ > 1;
+            if (BYTES - used < 1 + varint_size(zz >> 6) + (run ? varint_size(pending_) : 0)) return false;
+            buf[used++] = static_cast<uint8_t>((run ? 1 : 0) | ((zz & 0x3F) << 1) | (zz > 0x3F ? 0x80 : 0));
+            put_varint(buf, used, zz >> 6);
+            if (run) put_varint(buf, used, pending_);
+            used_[inactive()] = used;
+            pending_          = 0;
+            return true;
+        }
+
+        static size_t varint_size(uint64_t v) {
+            size_t n = 0;
+            for (; v; v >>= 7) n++;
+            return n;
+        }
+
+        /** 7 bits per byte, low first. Writes nothing for 0. */
+        static void put_varint(uint8_t* buf, size_t& used, uint64_t v) {
+            while (v) {
+                buf[used++] = static_cast<uint8_t>((v & 0x7F) | (v > 0x7F ? 0x80 : 0));
+                v >>= 7;
+            }
+        }
+        /// @}
+
+        /// @name decoding, from the active buffer
+        /// @{
+        void rewind() {
+            pos_   = 0;
+            next_  = 0;
+            key_   = 0;
+            delta_ = 0;
+            run_   = 0;
+        }
+
+        /** @return false past the last code */
+        bool read_code() {
+            if (pos_ >= used_[active_]) return false;
+            const uint8_t* buf = codes_[active_];
+            uint8_t first      = buf[pos_++];
+            bool run           = first & 1;
+            uint64_t zz        = (first >> 1) & 0x3F;
+            if (first & 0x80) zz |= get_varint(buf) << 6;
+            delta_ = (zz >> 1) ^ (0 - (zz & 1));
+            run_   = run ? static_cast<size_t>(get_varint(buf)) : 1;
+            decoded_++;
+            return true;
+        }
+
+        /** A varint at pos_: a run length, or the rest of a delta */
+        uint64_t get_varint(const uint8_t* buf) {
+            uint64_t v     = 0;
+            unsigned shift = 0;
+            uint8_t b;
+            do {
+                b = buf[pos_++];
+                v |= static_cast<uint64_t>(b & 0x7F) << shift;
+                shift += 7;
+            } while (b & 0x80);
+            return v;
+        }
+        /// @}
+
+        const fixed_point fixed_;
+        uint8_t codes_[2][BYTES];
+        volatile size_t size_[2] = {0, 0};
+        volatile size_t used_[2] = {0, 0};
+        volatile uint8_t active_ = 0;
+        volatile bool ready_     = false;
+        volatile size_t swaps_   = 0;
+
+        // encoder, loop() only
+        uint64_t last_key_      = 0;
+        uint64_t pending_delta_ = 0;
+        size_t pending_         = 0;
+
+        // decoder cursor, the player's interrupt only (or loop() while stopped)
+        size_t pos_     = 0;
+        size_t next_    = 0; ///< steps decoded, key_ is step next_ - 1
+        uint64_t key_   = 0;
+        uint64_t delta_ = 0;
+        size_t run_     = 0; ///< steps left in the current code
+        size_t reads_   = 0;
+        size_t decoded_ = 0;
+    };
+
+}; // namespace
+
+#endif // #ifndef __PACKEDSEQUENCE_H__
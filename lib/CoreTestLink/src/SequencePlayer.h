@@ -0,0 +1,438 @@
+#pragma once
+
+#ifndef __SEQUENCEPLAYER_H__
+    #define __SEQUENCEPLAYER_H__
+
+    #include "Histogram.h"
+    #include "LinkCommon.h"
+    #include <stdio.h>
+    #include <string.h>
+
+namespace ctl {
+
+    /**
+     * Hardware-timed sequence playback RPCs.
+     *
+     * The uploaded sequences are stepped from an interrupt, either a timer at
+     * a fixed period or one step per edge on a trigger pin, so playback does
+     * not depend on loop():
+     *
+     *  - RPC_PLAY_TRACK(target)                   -> track number of an upload target, or <0
+     *  - RPC_PLAY_START(period_us, flags, tracks) -> 0, or <0. period_us 0: external trigger
+     *  - RPC_PLAY_STOP(tracks)                    -> steps played
+     *  - RPC_PLAY_STATUS(reset)                   -> "running steps underruns missed p99_jitter_us max_jitter_us swaps"
+     *
+     * tracks is a mask, bit n for track n, so each property starts and stops
+     * its own track. Tracks started while others play join them on the
+     * current step and must ask for the same period and flags. Playback
+     * stops once every track has been stopped.
+     *
+     * A non-zero reset clears the counters and the jitter histogram after
+     * reading them.
+     */
+    constexpr const char* RPC_PLAY_TRACK  = "?plt";
+    constexpr const char* RPC_PLAY_START  = "!ply";
+    constexpr const char* RPC_PLAY_STOP   = "!plx";
+    constexpr const char* RPC_PLAY_STATUS = "?ply";
+
+    constexpr int PLAY_LOOP = 0x01; ///< start over after the last step, otherwise play once
+
+    constexpr int PLAY_ERROR_EMPTY  = -1; ///< no track has a sequence
+    constexpr int PLAY_ERROR_PERIOD = -2; ///< period below PLAY_MIN_PERIOD_US
+    constexpr int PLAY_ERROR_SOURCE = -3; ///< no timer, or no trigger pin, for the mode asked
+    constexpr int PLAY_ERROR_BUSY   = -4; ///< playing at another period or with other flags
+    constexpr int PLAY_ERROR_TRACK  = -5; ///< no track plays that target
+
+    constexpr uint32_t PLAY_ALL_TRACKS = 0xFFFFFFFFu;
+
+    constexpr long PLAY_MIN_PERIOD_US = 20;
+    constexpr size_t PLAY_TEXT_SIZE   = 64;
+
+    /** One sequenced output. stage() and swap() run in the interrupt, apply() in loop(). */
+    class play_track {
+     public:
+        virtual ~play_track() {}
+        /** Upload target it plays, for RPC_PLAY_TRACK */
+        virtual const char* name() const { return nullptr; }
+        /** Steps in the sequence, 0 if there is none */
+        virtual size_t length() const = 0;
+        /** Latch step i, below length(), for the next apply() */
+        virtual void stage(size_t i) = 0;
+        /** Output the latched step, if there is a new one */
+        virtual void apply() {}
+        /** At a sequence boundary: switch to a reloaded sequence. @return false if there is none */
+        virtual bool swap() { return false; }
+    };
+
+    /**
+     * @brief Plays a sequence store into a property.
+     *
+     * The interrupt only latches the step's value. The property is set in
+     * apply(), from loop(), where the server also reads and writes it.
+     *
+     * @tparam StoreT  e.g. ab_sequence_store<double, 256>
+     * @tparam PropT   property with set(value), e.g. rdl::simple_prop_base
+     */
+    template <class StoreT, class PropT>
+    class store_track : public play_track {
+     public:
+        using value_type = typename StoreT::value_type;
+
+        store_track(StoreT& store, PropT& prop) : store_(store), prop_(prop) {}
+
+        const char* name() const override { return store_.name(); }
+        size_t length() const override { return store_.size(); }
+        void stage(size_t i) override {
+            staged_ = store_[i];
+            fresh_  = true;
+        }
+        void apply() override {
+            value_type value;
+            {
+                interrupt_guard guard; // a double is two stores on a 32 bit MCU
+                if (!fresh_) return;
+                value  = staged_;
+                fresh_ = false;
+            }
+            prop_.set(value);
+        }
+        bool swap() override { return store_.swap(); }
+
+     protected:
+        StoreT& store_;
+        PropT& prop_;
+        volatile value_type staged_ = value_type();
+        volatile bool fresh_        = false;
+    };
+
+    /** Calls the player's interrupt: a hardware timer or a trigger pin */
+    class play_source {
+     public:
+        virtual ~play_source() {}
+        /** Start interrupts, every period_us or per trigger if 0. @return false if not possible */
+        virtual bool begin(uint32_t period_us) = 0;
+        virtual void end()                     = 0;
+    };
+
+    /**
+     * @brief Periodic interrupt from a TimerOne style library.
+     *
+     * @tparam TimerT  TimerOne or TimerThree, anything with initialize(us),
+     *                 attachInterrupt(isr), detachInterrupt() and stop()
+     */
+    template <class TimerT>
+    class timer_source : public play_source {
+     public:
+        timer_source(TimerT& timer, void (*isr)()) : timer_(timer), isr_(isr) {}
+
+        bool begin(uint32_t period_us) override {
+            if (period_us == 0) return false;
+            timer_.initialize(period_us);
+            timer_.attachInterrupt(isr_);
+            return true;
+        }
+        void end() override {
+            timer_.stop();
+            timer_.detachInterrupt();
+        }
+
+     protected:
+        TimerT& timer_;
+        void (*isr_)();
+    };
+
+    #ifdef ARDUINO
+    /** One interrupt per rising edge on a pin */
+    class trigger_source : public play_source {
+     public:
+        trigger_source(uint8_t pin, void (*isr)()) : pin_(pin), isr_(isr) {}
+
+        bool begin(uint32_t period_us) override {
+            if (period_us != 0 || digitalPinToInterrupt(pin_) == NOT_AN_INTERRUPT) return false;
+            pinMode(pin_, INPUT);
+            attachInterrupt(digitalPinToInterrupt(pin_), isr_, RISING);
+            return true;
+        }
+        void end() override { detachInterrupt(digitalPinToInterrupt(pin_)); }
+
+     protected:
+        uint8_t pin_;
+        void (*isr_)();
+    };
+    #endif
+
+    /**
+     * @brief Software timer for host builds.
+     *
+     * Reads time from a clock function, e.g. micros() or a test's virtual
+     * clock. due() says whether the interrupt fires now; call it as often as
+     * the host can. Like a hardware timer whose interrupt was held off,
+     * periods that passed in the meantime fire only once and the player
+     * counts them as missed.
+     */
+    class sim_timer : public play_source {
+     public:
+        sim_timer(uint32_t (*clock)()) : clock_(clock) {}
+
+        bool begin(uint32_t period_us) override {
+            if (period_us == 0) return false;
+            period_  = period_us;
+            next_    = clock_() + period_us;
+            running_ = true;
+            return true;
+        }
+        void end() override { running_ = false; }
+
+        bool running() const { return running_; }
+        /** Time of the next interrupt, only valid while running() */
+        uint32_t next() const { return next_; }
+
+        bool due() {
+            uint32_t now = clock_();
+            if (!running_ || static_cast<int32_t>(now - next_) < 0) return false;
+            while (static_cast<int32_t>(now - next_) >= 0) next_ += period_;
+            return true;
+        }
+
+     protected:
+        uint32_t (*clock_)();
+        uint32_t period_ = 0;
+        uint32_t next_   = 0;
+        bool running_    = false;
+    };
+
+    /**
+     * @brief Steps N tracks together from an interrupt.
+     *
+     * tick() is the interrupt handler body: it stages one step of every
+     * playing track and moves on, then calls the on_step() hook, e.g. to
+     * signal the loop() task that runs apply(). Tracks shorter than the
+     * longest wrap on their own length. In timer mode each tick's lateness
+     * against the schedule is the jitter; a tick more than a period late has
+     * missed steps, which are skipped so the sequence stays on time.
+     *
+     * At the end of a sequence every track may swap in a reloaded sequence,
+     * which then plays from its first step on the next tick, without a gap.
+     * Otherwise a looped sequence starts over and a timed one-shot stops. A
+     * trigger that arrives after the last step of a one-shot sequence, with
+     * nothing reloaded, is an underrun: there is nothing left to output.
+     *
+     * start(), stop(), apply() and text() run in loop(). They change or read
+     * more than one word of the interrupt's state only with interrupts held
+     * off, so the interrupt never sees a half started player and the status
+     * never mixes counts from before and after a reset.
+     *
+     * @tparam N  tracks, at most 32
+     */
+    template <size_t N>
+    class sequence_player {
+        static_assert(N <= 32, "one mask bit per track");
+
+     public:
+        sequence_player(play_track* const (&tracks)[N], play_source* timer, play_source* trigger)
+            : timer_(timer), trigger_(trigger) {
+            for (size_t i = 0; i < N; i++) tracks_[i] = tracks[i];
+        }
+
+        /** Called from the interrupt after each staged step */
+        void on_step(void (*callback)()) { on_step_ = callback; }
+
+        /** Track playing the upload target name. @return track number or PLAY_ERROR_TRACK */
+        int track(const char* name) const {
+            if (!name) return PLAY_ERROR_TRACK;
+            for (size_t i = 0; i < N; i++) {
+                const char* n = tracks_[i]->name();
+                if (n && strcmp(n, name) == 0) return static_cast<int>(i);
+            }
+            return PLAY_ERROR_TRACK;
+        }
+
+        /** Start the masked tracks, or add them to those playing. */
+        int start(long period_us, int flags, uint32_t tracks, uint32_t now_us) {
+            tracks &= all_tracks();
+            if (running_) return join(period_us, flags, tracks);
+            if (period_us < 0 || (period_us > 0 && period_us < PLAY_MIN_PERIOD_US)) return PLAY_ERROR_PERIOD;
+            for (size_t i = 0; i < N; i++) {
+                if (tracks & bit(i)) tracks_[i]->swap();
+            }
+            size_t length = longest(tracks);
+            if (length == 0) return PLAY_ERROR_EMPTY;
+            play_source* source = period_us ? timer_ : trigger_;
+            if (!source) return PLAY_ERROR_SOURCE;
+
+            // not running: no interrupt until source->begin()
+            active_  = tracks;
+            length_  = length;
+            index_   = 0;
+            steps_   = 0;
+            flags_   = flags;
+            period_  = static_cast<uint32_t>(period_us);
+            next_    = now_us + period_;
+            source_  = source;
+            running_ = true;
+            if (!source->begin(period_)) {
+                running_ = false;
+                source_  = nullptr;
+                return PLAY_ERROR_SOURCE;
+            }
+            return 0;
+        }
+
+        /** Stop the masked tracks, the player with the last one. @return steps played since start() */
+        long stop(uint32_t tracks = PLAY_ALL_TRACKS) {
+            play_source* source = nullptr;
+            {
+                interrupt_guard guard;
+                active_ &= ~tracks;
+                if (active_ != 0 && running_) {
+                    length_ = longest(active_);
+                    return static_cast<long>(steps_);
+                }
+                running_ = false;
+                source   = source_;
+                source_  = nullptr;
+            }
+            if (source) source->end();
+            return static_cast<long>(steps_);
+        }
+
+        /** Interrupt handler body, now_us from micros() */
+        void tick(uint32_t now_us) {
+            if (!running_) return;
+            size_t skip = 0;
+            if (period_) {
+                int32_t late = static_cast<int32_t>(now_us - next_);
+                uint32_t jitter = static_cast<uint32_t>(late < 0 ? -late : late);
+                if (late >= static_cast<int32_t>(period_)) {
+                    skip = static_cast<uint32_t>(late) / period_;
+                    missed_ += skip;
+                    jitter -= static_cast<uint32_t>(skip) * period_;
+                }
+                jitter_.record(jitter);
+                next_ += static_cast<uint32_t>(skip + 1) * period_;
+            }
+            size_t index = index_ + skip;
+            if (index >= length_) {
+                size_t over = index - length_; // steps missed past the end
+                if (!next_sequence()) {
+                    if (period_) {
+                        finish();
+                    } else {
+                        underruns_++;
+                    }
+                    return;
+                }
+                index = over % length_;
+            }
+            for (size_t i = 0; i < N; i++) {
+                size_t n = tracks_[i]->length();
+                if ((active_ & bit(i)) && n) tracks_[i]->stage(index % n);
+            }
+            steps_++;
+            index_ = index + 1;
+            if (on_step_) on_step_();
+        }
+
+        /** Output the staged steps, in loop() */
+        void apply() {
+            for (size_t i = 0; i < N; i++) tracks_[i]->apply();
+        }
+
+        bool running() const { return running_; }
+        /** Mask of the tracks playing */
+        uint32_t tracks() const { return running_ ? active_ : 0; }
+        size_t steps() const { return steps_; }
+        size_t underruns() const { return underruns_; }
+        size_t missed() const { return missed_; }
+        /** Reloaded sequences swapped in at a boundary */
+        size_t swaps() const { return swaps_; }
+        const log_histogram& jitter() const { return jitter_; }
+
+        /** RPC_PLAY_STATUS reply. @return characters written, 0 if dest is too small */
+        size_t text(char* dest, size_t dest_size, bool reset) {
+            unsigned long values[7];
+            {
+                interrupt_guard guard;
+                values[0] = running_ ? 1 : 0;
+                values[1] = steps_;
+                values[2] = underruns_;
+                values[3] = missed_;
+                values[4] = jitter_.percentile(0.99);
+                values[5] = jitter_.max();
+                values[6] = swaps_;
+                if (reset) {
+                    underruns_ = missed_ = 0;
+                    jitter_.reset();
+                }
+            }
+            int n = snprintf(dest, dest_size, "%lu %lu %lu %lu %lu %lu %lu", values[0], values[1], values[2],
+                             values[3], values[4], values[5], values[6]);
+            return (n > 0 && static_cast<size_t>(n) < dest_size) ? static_cast<size_t>(n) : 0;
+        }
+
+     protected:
+        static uint32_t bit(size_t i) { return 1u << i; }
+        static uint32_t all_tracks() { return N == 32 ? PLAY_ALL_TRACKS : (1u << (N % 32)) - 1; }
+
+        /** Tracks started while others play: they pick up the current step */
+        int join(long period_us, int flags, uint32_t tracks) {
+            if (static_cast<uint32_t>(period_us) != period_ || flags != flags_) return PLAY_ERROR_BUSY;
+            interrupt_guard guard;
+            for (size_t i = 0; i < N; i++) {
+                if ((tracks & ~active_) & bit(i)) tracks_[i]->swap();
+            }
+            active_ |= tracks;
+            length_ = longest(active_);
+            return 0;
+        }
+
+        size_t longest(uint32_t tracks) const {
+            size_t length = 0;
+            for (size_t i = 0; i < N; i++) {
+                if ((tracks & bit(i)) && tracks_[i]->length() > length) length = tracks_[i]->length();
+            }
+            return length;
+        }
+
+        /** At the end of the sequence. @return false if playback is over */
+        bool next_sequence() {
+            bool swapped = false;
+            for (size_t i = 0; i < N; i++) {
+                if ((active_ & bit(i)) && tracks_[i]->swap()) swapped = true;
+            }
+            if (swapped) {
+                swaps_++;
+                length_ = longest(active_);
+                return length_ > 0;
+            }
+            return (flags_ & PLAY_LOOP) != 0;
+        }
+
+        void finish() {
+            running_ = false;
+            if (source_) source_->end();
+        }
+
+        play_track* tracks_[N];
+        play_source* timer_;
+        play_source* trigger_;
+        play_source* volatile source_ = nullptr;
+        void (*on_step_)()            = nullptr;
+
+        volatile bool running_     = false;
+        volatile uint32_t active_  = 0; ///< mask of the tracks playing
+        volatile size_t length_    = 0;
+        volatile size_t index_     = 0;
+        volatile size_t steps_     = 0;
+        volatile size_t underruns_ = 0;
+        volatile size_t missed_    = 0;
+        volatile size_t swaps_     = 0;
+        volatile int flags_        = 0;
+        volatile uint32_t period_  = 0;
+        volatile uint32_t next_    = 0;
+        log_histogram jitter_;
+    };
+
+}; // namespace
+
+#endif // #ifndef __SEQUENCEPLAYER_H__
@@ -0,0 +1,332 @@
+#pragma once
+
+#ifndef __SEQUENCEUPLOAD_H__
+    #define __SEQUENCEUPLOAD_H__
+
+    #include "LinkChecksum.h"
+    #include "LinkCommon.h"
+    #include <stdio.h>
+    #include <string.h>
+
+namespace ctl {
+
+    /**
+     * Chunked sequence upload RPCs.
+     *
+     * The hub packs sequence values as little-endian binary, base64 encodes
+     * each chunk and sends it as a single string parameter:
+     *
+     *  - RPC_SEQ_CAPACITY(target)              -> elements any sequence fits, or <0
+     *  - RPC_SEQ_BEGIN(target, count)          -> count or <0 on error
+     *  - RPC_SEQ_CHUNK(target, offset, base64) -> next expected offset or <0
+     *  - RPC_SEQ_END(target, crc16)            -> count or <0 on checksum error
+     *  - RPC_SEQ_MEMORY(target)                -> "steps used_bytes buffer_bytes reads decoded typical"
+     *
+     * Every chunk reply doubles as the acknowledgement for that chunk.
+     * RPC_SEQ_MEMORY reports the current sequence: the bytes it takes, the
+     * bytes of one buffer, and for compressed stores the steps read so far
+     * and the codes decoded to serve them. typical is the longest sequence
+     * RPC_SEQ_BEGIN takes; above the capacity only a sequence that
+     * compresses fits, see packed_sequence_store.
+     */
+    constexpr const char* RPC_SEQ_CAPACITY = "^sq";
+    constexpr const char* RPC_SEQ_BEGIN    = "!sqb";
+    constexpr const char* RPC_SEQ_CHUNK    = "!sqc";
+    constexpr const char* RPC_SEQ_END      = "!sqe";
+    constexpr const char* RPC_SEQ_MEMORY   = "?sqm";
+
+    /** Raw bytes per chunk. Multiple of 3 (no base64 padding) and 8 (whole doubles) */
+    constexpr size_t SEQ_CHUNK_BYTES = 240;
+
+    constexpr int SEQ_ERROR_TARGET   = -1; ///< unknown upload target
+    constexpr int SEQ_ERROR_SIZE     = -2; ///< sequence larger than the store
+    constexpr int SEQ_ERROR_OFFSET   = -3; ///< chunk out of order
+    constexpr int SEQ_ERROR_DATA     = -4; ///< chunk not valid base64 or partial element
+    constexpr int SEQ_ERROR_CHECKSUM = -5; ///< crc16 of the stored data does not match
+    constexpr int SEQ_ERROR_FULL     = -6; ///< values do not fit the store once compressed
+    constexpr int SEQ_ERROR_RANGE    = -7; ///< value the store cannot code, e.g. past its fixed-point range
+
+    constexpr size_t SEQ_MEMORY_TEXT_SIZE = 72;
+
+    /// @name base64 (RFC 4648, no line breaks)
+    /// @{
+    inline size_t base64_encoded_size(size_t n) { return 4 * ((n + 2) / 3); }
+
+    /** @return characters written (not null terminated) or 0 if dest is too small */
+    inline size_t base64_encode(char* dest, size_t dest_size, const uint8_t* src, size_t n) {
+        static const char* alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+        if (dest_size < base64_encoded_size(n)) return 0;
+        size_t out = 0;
+        for (size_t i = 0; i < n; i += 3) {
+            uint32_t v = static_cast<uint32_t>(src[i]) << 16;
+            if (i + 1 < n) v |= static_cast<uint32_t>(src[i + 1]) << 8;
+            if (i + 2 < n) v |= src[i + 2];
+            dest[out++] = alphabet[(v >> 18) & 0x3F];
+            dest[out++] = alphabet[(v >> 12) & 0x3F];
+            dest[out++] = (i + 1 < n) ? alphabet[(v >> 6) & 0x3F] : '=';
+            dest[out++] = (i + 2 < n) ? alphabet[v & 0x3F] : '=';
+        }
+        return out;
+    }
+
+    inline int base64_value(char c) {
+        if (c >= 'A' && c <= 'Z') return c - 'A';
+        if (c >= 'a' && c <= 'z') return c - 'a' + 26;
+        if (c >= '0' && c <= '9') return c - '0' + 52;
+        if (c == '+') return 62;
+        if (c == '/') return 63;
+        return -1;
+    }
+
+    /** @return bytes decoded or -1 on bad input or a too small dest */
+    inline int base64_decode(uint8_t* dest, size_t dest_size, const char* src, size_t n) {
+        if (n % 4) return -1;
+        size_t out = 0;
+        for (size_t i = 0; i < n; i += 4) {
+            int pad = (src[i + 3] == '=') + (src[i + 2] == '=');
+            uint32_t v = 0;
+            for (size_t k = 0; k < 4; k++) {
+                int b = (k >= 4 - static_cast<size_t>(pad)) ? 0 : base64_value(src[i + k]);
+                if (b < 0) return -1;
+                v = (v << 6) | static_cast<uint32_t>(b);
+            }
+            size_t nb = 3 - pad;
+            if (out + nb > dest_size) return -1;
+            dest[out++] = static_cast<uint8_t>(v >> 16);
+            if (nb > 1) dest[out++] = static_cast<uint8_t>(v >> 8);
+            if (nb > 2) dest[out++] = static_cast<uint8_t>(v);
+        }
+        return static_cast<int>(out);
+    }
+    /// @}
+
+    /// @name little-endian element packing
+    /// @{
+    inline bool is_little_endian() {
+        const uint16_t probe = 1;
+        return *reinterpret_cast<const uint8_t*>(&probe) == 1;
+    }
+
+    template <typename T>
+    inline void pack_le(uint8_t* dest, T value) {
+        uint8_t raw[sizeof(T)];
+        memcpy(raw, &value, sizeof(T));
+        for (size_t i = 0; i < sizeof(T); i++) {
+            dest[i] = raw[is_little_endian() ? i : sizeof(T) - 1 - i];
+        }
+    }
+
+    template <typename T>
+    inline T unpack_le(const uint8_t* src) {
+        uint8_t raw[sizeof(T)];
+        for (size_t i = 0; i < sizeof(T); i++) {
+            raw[is_little_endian() ? i : sizeof(T) - 1 - i] = src[i];
+        }
+        T value;
+        memcpy(&value, raw, sizeof(T));
+        return value;
+    }
+    /// @}
+
+    /**
+     * @brief Firmware side destination of a chunked upload.
+     *
+     * Uploads are staged straight into the store. The store only reports its
+     * new size after RPC_SEQ_END verified the checksum. Double-buffered
+     * stores stage into their inactive buffer and make it current on swap().
+     */
+    class upload_target {
+     public:
+        upload_target(const char* name) : name_(name) {}
+        virtual ~upload_target() {}
+
+        const char* name() const { return name_; }
+
+        int begin(long count) {
+            if (count < 0 || static_cast<size_t>(count) > typical_capacity()) return SEQ_ERROR_SIZE;
+            expected_ = static_cast<size_t>(count);
+            received_ = 0;
+            crc_      = CRC16_INIT;
+            staging();
+            return static_cast<int>(count);
+        }
+
+        int chunk(long offset, const char* b64) {
+            if (static_cast<size_t>(offset) != received_) return SEQ_ERROR_OFFSET;
+            uint8_t raw[SEQ_CHUNK_BYTES];
+            int nbytes = base64_decode(raw, sizeof(raw), b64, strlen(b64));
+            if (nbytes < 0 || nbytes % element_size() != 0) return SEQ_ERROR_DATA;
+            size_t nelem = static_cast<size_t>(nbytes) / element_size();
+            if (received_ + nelem > expected_) return SEQ_ERROR_SIZE;
+            crc_ = crc16(raw, static_cast<size_t>(nbytes), crc_);
+            int error = store(received_, raw, nelem);
+            if (error < 0) return error;
+            received_ += nelem;
+            return static_cast<int>(received_);
+        }
+
+        int end(long crc) {
+            if (received_ != expected_) return SEQ_ERROR_SIZE;
+            if (static_cast<uint16_t>(crc) != crc_) return SEQ_ERROR_CHECKSUM;
+            if (!committed(received_)) return SEQ_ERROR_FULL;
+            return static_cast<int>(received_);
+        }
+
+        /** Steps any sequence fits */
+        virtual size_t capacity() const  = 0;
+        virtual size_t size() const      = 0;
+        virtual int element_size() const = 0;
+        /** Steps typical sequences fit, the most begin() takes. capacity() unless the store compresses. */
+        virtual size_t typical_capacity() const { return capacity(); }
+
+        /** Make a committed upload current. @return false if there was none to swap in */
+        virtual bool swap() { return false; }
+
+        /** Bytes the current sequence takes */
+        virtual size_t used_bytes() const { return size() * static_cast<size_t>(element_size()); }
+        /** Bytes of one sequence buffer */
+        virtual size_t buffer_bytes() const { return capacity() * static_cast<size_t>(element_size()); }
+        /** Steps read, and codes decoded to serve them. 0 for uncompressed stores. */
+        virtual size_t reads() const { return 0; }
+        virtual size_t decoded() const { return 0; }
+
+        /** RPC_SEQ_MEMORY reply. @return characters written, 0 if dest is too small */
+        size_t memory_text(char* dest, size_t dest_size) const {
+            int n = snprintf(dest, dest_size, "%lu %lu %lu %lu %lu %lu", static_cast<unsigned long>(size()),
+                             static_cast<unsigned long>(used_bytes()),
+                             static_cast<unsigned long>(buffer_bytes()),
+                             static_cast<unsigned long>(reads()), static_cast<unsigned long>(decoded()),
+                             static_cast<unsigned long>(typical_capacity()));
+            return (n > 0 && static_cast<size_t>(n) < dest_size) ? static_cast<size_t>(n) : 0;
+        }
+
+     protected:
+        /** @return 0, or SEQ_ERROR_FULL or SEQ_ERROR_RANGE */
+        virtual int store(size_t index, const uint8_t* packed, size_t count) = 0;
+        /** A new upload starts, the staged data is no longer valid */
+        virtual void staging()                                               = 0;
+        /** @return false if the upload does not fit after all */
+        virtual bool committed(size_t count)                                 = 0;
+
+        const char* name_;
+        size_t expected_ = 0;
+        size_t received_ = 0;
+        uint16_t crc_    = CRC16_INIT;
+    };
+
+    /**
+     * @brief Fixed capacity sequence storage fed by chunked uploads.
+     *
+     * @tparam T  element type. Also the packed wire type.
+     * @tparam N  capacity in elements
+     */
+    template <typename T, size_t N>
+    class sequence_store : public upload_target {
+     public:
+        using value_type = T;
+
+        sequence_store(const char* name) : upload_target(name) {}
+
+        size_t capacity() const override { return N; }
+        size_t size() const override { return size_; }
+        int element_size() const override { return sizeof(T); }
+
+        const T& operator[](size_t i) const { return values_[i]; }
+        const T* data() const { return values_; }
+
+     protected:
+        int store(size_t index, const uint8_t* packed, size_t count) override {
+            for (size_t i = 0; i < count; i++) {
+                values_[index + i] = unpack_le<T>(packed + i * sizeof(T));
+            }
+            return 0;
+        }
+        void staging() override { size_ = 0; }
+        bool committed(size_t count) override {
+            size_ = count;
+            return true;
+        }
+
+        T values_[N];
+        size_t size_ = 0;
+    };
+
+    /**
+     * @brief Sequence storage with A/B buffers, for reloads during playback.
+     *
+     * Reads see the active buffer. Uploads go to the inactive one, so the
+     * sequence playing is never touched. A verified upload waits there
+     * until swap(), which the player calls at a sequence boundary and the
+     * firmware calls right away when nothing is playing.
+     *
+     * The player's interrupt swaps while loop() uploads. Only loop() writes
+     * ready_ false, and only the interrupt flips active_ and only while
+     * ready_ is set, so an upload in progress never lands in the buffer
+     * being played.
+     *
+     * @tparam T  element type. Also the packed wire type.
+     * @tparam N  capacity of each buffer in elements
+     */
+    template <typename T, size_t N>
+    class ab_sequence_store : public upload_target {
+     public:
+        using value_type = T;
+
+        ab_sequence_store(const char* name) : upload_target(name) {}
+
+        size_t capacity() const override { return N; }
+        size_t size() const override { return size_[active_]; }
+        int element_size() const override { return sizeof(T); }
+
+        const T& operator[](size_t i) const { return values_[active_][i]; }
+        const T* data() const { return values_[active_]; }
+
+        bool swap() override {
+            if (!ready_) return false;
+            active_ ^= 1;
+            ready_ = false;
+            swaps_++;
+            return true;
+        }
+
+        /** A verified upload is waiting for swap() */
+        bool ready() const { return ready_; }
+        size_t swaps() const { return swaps_; }
+
+     protected:
+        uint8_t inactive() const { return active_ ^ 1; }
+
+        int store(size_t index, const uint8_t* packed, size_t count) override {
+            T* values = values_[inactive()];
+            for (size_t i = 0; i < count; i++) {
+                values[index + i] = unpack_le<T>(packed + i * sizeof(T));
+            }
+            return 0;
+        }
+        void staging() override { ready_ = false; }
+        bool committed(size_t count) override {
+            size_[inactive()] = count;
+            ready_            = true;
+            return true;
+        }
+
+        T values_[2][N];
+        volatile size_t size_[2]  = {0, 0};
+        volatile uint8_t active_  = 0;
+        volatile bool ready_      = false;
+        volatile size_t swaps_    = 0;
+    };
+
+    /** Look up an upload target by name in a fixed table */
+    template <size_t N>
+    upload_target* find_target(upload_target* const (&targets)[N], const char* name) {
+        if (!name) return nullptr;
+        for (size_t i = 0; i < N; i++) {
+            if (strcmp(targets[i]->name(), name) == 0) return targets[i];
+        }
+        return nullptr;
+    }
+
+}; // namespace
+
+#endif // #ifndef __SEQUENCEUPLOAD_H__
@@ -0,0 +1,73 @@
+#pragma once
+
+#ifndef __SERVERPORTS_H__
+    #define __SERVERPORTS_H__
+
+    #include "LinkCommon.h"
+
+namespace ctl {
+
+    /**
+     * Server port RPC.
+     *
+     * RPC_PORT() -> index of the port the request came in on. Port 0 is the
+     * control port, the one that owns the baud rate. Change notifications go
+     * to the ports that subscribed to them.
+     */
+    constexpr const char* RPC_PORT = "?port";
+
+    /**
+     * @brief Fair service order for several JSON-RPC server ports.
+     *
+     * Each port has its own stream and server, and with it its own parse
+     * buffer; all servers share one dispatch map. poll() gives every port
+     * that has input one service call, so a busy port can not starve the
+     * others, and starts the next pass one past the port it served first,
+     * so no port is always first either.
+     *
+     * Handlers that need to know which port asked, to keep that port's
+     * subscriptions for instance, read current().
+     *
+     * @tparam N  number of ports
+     */
+    template <size_t N>
+    class round_robin {
+     public:
+        static constexpr size_t size() { return N; }
+
+        /**
+         * One pass over the ports.
+         * @param ready    bool(size_t port), the port has input waiting
+         * @param service  void(size_t port), e.g. the port's check_messages()
+         * @return ports serviced
+         */
+        template <class ReadyF, class ServiceF>
+        size_t poll(ReadyF ready, ServiceF service) {
+            size_t first  = next_;
+            size_t served = 0;
+            for (size_t k = 0; k < N; k++) {
+                size_t port = (first + k) % N;
+                if (!ready(port)) continue;
+                if (served++ == 0) next_ = (port + 1) % N;
+                current_ = static_cast<int>(port);
+                service(port);
+                current_ = -1;
+                serviced_[port]++;
+            }
+            return served;
+        }
+
+        /** Port being serviced, -1 outside poll() */
+        int current() const { return current_; }
+        /** Service calls port has had */
+        size_t serviced(size_t port) const { return serviced_[port]; }
+
+     protected:
+        size_t next_        = 0;
+        int current_        = -1;
+        size_t serviced_[N] = {};
+    };
+
+}; // namespace
+
+#endif // #ifndef __SERVERPORTS_H__
@@ -0,0 +1,97 @@
+#pragma once
+
+#ifndef __SLIPFRAME_H__
+    #define __SLIPFRAME_H__
+
+    #include "LinkCommon.h"
+
+namespace ctl {
+
+    /**
+     * @brief RFC 1055 SLIP characters used to delimit JSON-RPC frames on the link.
+     *
+     * These are the binary values used by rdl::json_client and rdl::json_server.
+     * Frames are terminated (and optionally preceded) by SLIP_END.
+     */
+    constexpr uint8_t SLIP_END     = 0300; ///< End of packet character
+    constexpr uint8_t SLIP_ESC     = 0333; ///< Escape character
+    constexpr uint8_t SLIP_ESC_END = 0334; ///< Escaped end character
+    constexpr uint8_t SLIP_ESC_ESC = 0335; ///< Escaped escape character
+
+    /**
+     * First byte of an unsolicited device notification frame. Never the first
+     * byte of a JSON ('{') RPC reply, so a reader can
+     * separate notifications from replies without parsing.
+     */
+    constexpr uint8_t NOTIFY_MARKER = '!';
+
+    /**
+     * @brief Remove SLIP escapes in place.
+     *
+     * The frame must not contain the terminating SLIP_END.
+     *
+     * @return size of the decoded frame
+     */
+    inline size_t slip_decode(uint8_t* buf, size_t size) {
+        size_t out = 0;
+        for (size_t in = 0; in < size; in++) {
+            uint8_t c = buf[in];
+            if (c == SLIP_ESC && in + 1 < size) {
+                c = buf[++in];
+                c = (c == SLIP_ESC_END) ? SLIP_END : (c == SLIP_ESC_ESC) ? SLIP_ESC : c;
+            }
+            buf[out++] = c;
+        }
+        return out;
+    }
+
+    /**
+     * @brief SLIP escape a frame and append the terminating SLIP_END.
+     *
+     * @return size of the encoded frame or 0 if dest is too small
+     */
+    inline size_t slip_encode(uint8_t* dest, size_t dest_size, const uint8_t* src, size_t src_size) {
+        size_t out = 0;
+        for (size_t in = 0; in < src_size; in++) {
+            uint8_t c = src[in];
+            if (c == SLIP_END || c == SLIP_ESC) {
+                if (out + 2 > dest_size) return 0;
+                dest[out++] = SLIP_ESC;
+                dest[out++] = (c == SLIP_END) ? SLIP_ESC_END : SLIP_ESC_ESC;
+            } else {
+                if (out + 1 > dest_size) return 0;
+                dest[out++] = c;
+            }
+        }
+        if (out + 1 > dest_size) return 0;
+        dest[out++] = SLIP_END;
+        return out;
+    }
+
+    /**
+     * @brief SLIP escape a frame directly onto a Print and append SLIP_END.
+     *
+     * @return number of characters transmitted
+     */
+    template <class P>
+    size_t slip_write(P& out, const uint8_t* src, size_t src_size) {
+        size_t ntx = 0;
+        for (size_t in = 0; in < src_size; in++) {
+            uint8_t c = src[in];
+            if (c == SLIP_END) {
+                ntx += out.write(SLIP_ESC);
+                ntx += out.write(SLIP_ESC_END);
+            } else if (c == SLIP_ESC) {
+                ntx += out.write(SLIP_ESC);
+                ntx += out.write(SLIP_ESC_ESC);
+            } else {
+                ntx += out.write(c);
+            }
+        }
+        ntx += out.write(SLIP_END);
+        return ntx;
+    }
+
+}; // namespace
+
+#endif // #ifndef __SLIPFRAME_H__
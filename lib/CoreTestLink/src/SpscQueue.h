@@ -0,0 +1,80 @@
+#pragma once
+
+#ifndef __SPSCQUEUE_H__
+    #define __SPSCQUEUE_H__
+
+    #include "LinkCommon.h"
+    #include <atomic>
+
+namespace ctl {
+
+    /**
+     * @brief Lock-free single-producer single-consumer ring buffer.
+     *
+     * One thread (or ISR) pushes, one thread pops. Indices run freely and are
+     * masked on access, so all N slots are usable.
+     *
+     * @tparam T  element type, copied in and out
+     * @tparam N  capacity, must be a power of two
+     */
+    template <typename T, size_t N>
+    class spsc_queue {
+        static_assert(N > 0 && (N & (N - 1)) == 0, "spsc_queue capacity must be a power of two");
+
+     public:
+        /** @return false if the queue is full. Producer only. */
+        bool push(const T& value) {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (head - tail_.load(std::memory_order_acquire) >= N) return false;
+            buf_[head & (N - 1)] = value;
+            head_.store(head + 1, std::memory_order_release);
+            return true;
+        }
+
+        /**
+         * Push all of src or nothing. Producer only.
+         * @return false if there was not enough room
+         */
+        bool push_all(const T* src, size_t count) {
+            size_t head = head_.load(std::memory_order_relaxed);
+            if (N - (head - tail_.load(std::memory_order_acquire)) < count) return false;
+            for (size_t i = 0; i < count; i++) {
+                buf_[(head + i) & (N - 1)] = src[i];
+            }
+            head_.store(head + count, std::memory_order_release);
+            return true;
+        }
+
+        /** @return false if the queue is empty. Consumer only. */
+        bool pop(T& value) {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (head_.load(std::memory_order_acquire) == tail) return false;
+            value = buf_[tail & (N - 1)];
+            tail_.store(tail + 1, std::memory_order_release);
+            return true;
+        }
+
+        /** Oldest element without removing it. Consumer only. */
+        bool front(T& value) const {
+            size_t tail = tail_.load(std::memory_order_relaxed);
+            if (head_.load(std::memory_order_acquire) == tail) return false;
+            value = buf_[tail & (N - 1)];
+            return true;
+        }
+
+        /** Drop everything currently queued. Consumer only. */
+        void clear() { tail_.store(head_.load(std::memory_order_acquire), std::memory_order_release); }
+
+        size_t size() const { return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire); }
+        bool empty() const { return size() == 0; }
+        static constexpr size_t capacity() { return N; }
+
+     protected:
+        std::atomic<size_t> head_{0}; ///< next slot to write
+        std::atomic<size_t> tail_{0}; ///< next slot to read
+        T buf_[N];
+    };
+
+}; // namespace
+
+#endif // #ifndef __SPSCQUEUE_H__
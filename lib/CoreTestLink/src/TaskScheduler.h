@@ -0,0 +1,229 @@
+#pragma once
+
+#ifndef __TASKSCHEDULER_H__
+    #define __TASKSCHEDULER_H__
+
+    #include "LinkCommon.h"
+    #include <stdio.h>
+
+namespace ctl {
+
+    /**
+     * Task statistics RPC.
+     *
+     * RPC_TASKS(reset) -> "name runs mean_us max_us late_us overruns skipped;..."
+     * for every task, cut at TASKS_TEXT_SIZE. late_us is the longest a task
+     * waited past its release, overruns the runs that finished past their
+     * deadline, skipped the periodic releases dropped because a whole period
+     * went by without a run. A non-zero reset clears what was read.
+     */
+    constexpr const char* RPC_TASKS = "?tasks";
+
+    constexpr size_t TASKS_TEXT_SIZE = 240;
+    constexpr char TASKS_SEPARATOR   = ';';
+
+    constexpr int TASK_ERROR_FULL = -1; ///< no free task slot
+
+    /** The firmware's tick: its periodic tasks' period, and the longest loop() sleeps */
+    constexpr uint32_t TASK_TICK_US = 1000;
+
+    /** Run time accounting of one task, in clock units */
+    struct task_stats {
+        size_t runs        = 0;
+        size_t overruns    = 0; ///< finished past the deadline
+        size_t skipped     = 0; ///< periodic releases dropped
+        uint32_t late_max  = 0; ///< longest start after release
+        uint32_t run_max   = 0;
+        uint64_t run_total = 0;
+    };
+
+    /**
+     * @brief Cooperative scheduler for the firmware's loop() services.
+     *
+     * Periodic tasks are released every period; event tasks when their
+     * ready() test passes or when signal() was called, which is safe from an
+     * interrupt. Each poll() runs every released task once, in the order the
+     * tasks were added, so add the most urgent first. Tasks run to completion:
+     * a long one delays the rest, and the accounting shows by how much.
+     *
+     * A task's deadline counts from its release: the period's start for a
+     * periodic task, the signal or the first poll() that saw it ready for an
+     * event task. A periodic task that falls a whole period or more behind
+     * skips the releases it missed instead of running them back to back.
+     *
+     * The clock is a free running microsecond counter, micros() on the
+     * firmware or a virtual clock in tests; it wraps like micros().
+     *
+     * @tparam N  most tasks
+     */
+    template <size_t N>
+    class task_scheduler {
+     public:
+        task_scheduler(uint32_t (*clock)()) : clock_(clock) {}
+
+        /**
+         * Add a task released every period_us, first on the next poll().
+         * @param deadline_us  from the release, 0 for the period
+         * @return task id or TASK_ERROR_FULL
+         */
+        int periodic(const char* name, void (*run)(), uint32_t period_us, uint32_t deadline_us = 0) {
+            int id = add(name, run, deadline_us ? deadline_us : period_us);
+            if (id < 0) return id;
+            tasks_[id].period = period_us;
+            tasks_[id].due    = clock_();
+            return id;
+        }
+
+        /**
+         * Add a task released when ready() passes or on signal().
+         * @param ready  polled each pass while not released, nullptr for signal() only
+         * @return task id or TASK_ERROR_FULL
+         */
+        int event(const char* name, void (*run)(), bool (*ready)(), uint32_t deadline_us) {
+            int id = add(name, run, deadline_us);
+            if (id < 0) return id;
+            tasks_[id].ready = ready;
+            return id;
+        }
+
+        /** Release an event task. Interrupt safe; signals before it runs count once. */
+        void signal(int id) {
+            task& t = tasks_[id];
+            if (t.signalled) return;
+            t.signal_time = clock_();
+            t.signalled   = true;
+        }
+
+        /** An event task was signalled since poll() last looked: the next pass has work, do not sleep */
+        bool pending() const {
+            for (size_t i = 0; i < count_; i++) {
+                if (tasks_[i].signalled) return true;
+            }
+            return false;
+        }
+
+        /** One pass over the tasks. @return tasks run */
+        size_t poll() {
+            size_t ran = 0;
+            for (size_t i = 0; i < count_; i++) {
+                task& t      = tasks_[i];
+                uint32_t now = clock_();
+                uint32_t release;
+                if (t.period) {
+                    if (static_cast<int32_t>(now - t.due) < 0) continue;
+                    release = t.due;
+                } else {
+                    if (take_signal(t)) {
+                        t.pending = true;
+                    } else if (!t.pending && t.ready && t.ready()) {
+                        t.released = now;
+                        t.pending  = true;
+                    }
+                    if (!t.pending) continue;
+                    release   = t.released;
+                    t.pending = false;
+                }
+                t.run();
+                uint32_t end = clock_();
+                account(t.stats, now - release, end - now, end - release > t.deadline);
+                if (t.period) next_release(t, end);
+                ran++;
+            }
+            return ran;
+        }
+
+        size_t size() const { return count_; }
+        const char* name(int id) const { return tasks_[id].name; }
+        const task_stats& stats(int id) const { return tasks_[id].stats; }
+
+        /**
+         * RPC_TASKS reply text.
+         * @return length written, entries that do not fit are dropped whole
+         */
+        size_t text(char* dest, size_t dest_size, bool reset) {
+            const char separator[] = {TASKS_SEPARATOR, '\0'};
+            size_t out = 0;
+            if (dest_size == 0) return 0;
+            dest[0] = '\0';
+            for (size_t i = 0; i < count_; i++) {
+                const task_stats& s = tasks_[i].stats;
+                int n = snprintf(dest + out, dest_size - out, "%s%s %lu %lu %lu %lu %lu %lu", out ? separator : "",
+                                 tasks_[i].name, static_cast<unsigned long>(s.runs),
+                                 static_cast<unsigned long>(s.runs ? s.run_total / s.runs : 0),
+                                 static_cast<unsigned long>(s.run_max), static_cast<unsigned long>(s.late_max),
+                                 static_cast<unsigned long>(s.overruns), static_cast<unsigned long>(s.skipped));
+                if (n < 0 || static_cast<size_t>(n) >= dest_size - out) {
+                    dest[out] = '\0'; // drop the entry that did not fit
+                    break;
+                }
+                out += static_cast<size_t>(n);
+            }
+            if (reset) {
+                for (size_t i = 0; i < count_; i++) tasks_[i].stats = task_stats();
+            }
+            return out;
+        }
+
+     protected:
+        struct task {
+            const char* name = "";
+            void (*run)()    = nullptr;
+            bool (*ready)()  = nullptr;
+            uint32_t period   = 0; ///< 0 for an event task
+            uint32_t deadline = 0;
+            uint32_t due      = 0; ///< next periodic release
+            uint32_t released = 0; ///< event release, while pending
+            bool pending      = false;
+            volatile uint32_t signal_time = 0;
+            volatile bool signalled       = false;
+            task_stats stats;
+        };
+
+        /**
+         * Consume a signal. Read and cleared with interrupts held off: a
+         * signal() between the test and the clear would otherwise be lost.
+         * A signal while the task runs releases it again.
+         */
+        bool take_signal(task& t) {
+            interrupt_guard guard;
+            if (!t.signalled) return false;
+            if (!t.pending) t.released = t.signal_time;
+            t.signalled = false;
+            return true;
+        }
+
+        int add(const char* name, void (*run)(), uint32_t deadline_us) {
+            if (count_ >= N) return TASK_ERROR_FULL;
+            task& t    = tasks_[count_];
+            t.name     = name;
+            t.run      = run;
+            t.deadline = deadline_us;
+            return static_cast<int>(count_++);
+        }
+
+        static void account(task_stats& s, uint32_t late, uint32_t run, bool overrun) {
+            s.runs++;
+            s.run_total += run;
+            if (run > s.run_max) s.run_max = run;
+            if (late > s.late_max) s.late_max = late;
+            if (overrun) s.overruns++;
+        }
+
+        /** The next period, or the latest one already started if a whole period went by */
+        static void next_release(task& t, uint32_t now) {
+            t.due += t.period;
+            uint32_t behind = now - t.due;
+            if (static_cast<int32_t>(behind) < static_cast<int32_t>(t.period)) return;
+            uint32_t missed = behind / t.period;
+            t.due += missed * t.period;
+            t.stats.skipped += missed;
+        }
+
+        uint32_t (*clock_)();
+        task tasks_[N];
+        size_t count_ = 0;
+    };
+
+}; // namespace
+
+#endif // #ifndef __TASKSCHEDULER_H__
@@ -0,0 +1,227 @@
+#pragma once
+
+#ifndef __TELEMETRY_H__
+    #define __TELEMETRY_H__
+
+    #include "DispatchTime.h"
+    #include "Histogram.h"
+    #include "LinkCommon.h"
+    #include <stdio.h>
+
+    #if defined(ARDUINO) && defined(__arm__)
+extern "C" char* sbrk(int incr);
+    #endif
+    #if defined(__IMXRT1062__)
+// Teensy 4.x linker script: end of the heap in RAM2, end of .bss in DTCM
+extern "C" char _heap_end[];
+extern "C" char _ebss[];
+    #endif
+
+namespace ctl {
+
+    /**
+     * Firmware telemetry RPCs.
+     *
+     *  - RPC_STATS(reset) -> JSON object text
+     *        {"loop":[n,p50,p99,max],"pass":[n,p50,p99,max],"heap":bytes,
+     *         "stack":bytes,"rx":peak_bytes,"ferr":n,"ovh":ppm}
+     *    loop: time between loop() starts, pass: time in the server per
+     *    pass with input waiting, both in microseconds. heap, stack: bytes
+     *    each can still grow, see heap_free() and stack_free(). rx: most
+     *    bytes found waiting in the serial receive buffer, ferr: link frames
+     *    dropped as too large or malformed, ovh: time spent recording
+     *    telemetry per million of loop time.
+     *  - RPC_METHOD_STATS(reset) -> "name count mean_us max_us;..." for the
+     *    methods called since the last reset, cut at METHOD_STATS_TEXT_SIZE.
+     *
+     * A non-zero reset clears what was read.
+     */
+    constexpr const char* RPC_STATS        = "?stats";
+    constexpr const char* RPC_METHOD_STATS = "?mstats";
+
+    constexpr size_t STATS_TEXT_SIZE        = 208; ///< every number at 10 digits
+    constexpr size_t METHOD_STATS_TEXT_SIZE = 400;
+    constexpr char METHOD_STATS_SEPARATOR   = ';';
+
+    /** Bytes the heap can still grow, 0 where unknown */
+    inline size_t heap_free() {
+    #if defined(__IMXRT1062__)
+        // Teensy 4.x: the heap has RAM2 to itself, up to _heap_end. The
+        // stack is in DTCM, so the gap to it means nothing.
+        return static_cast<size_t>(_heap_end - sbrk(0));
+    #elif defined(ARDUINO) && defined(__arm__)
+        // one RAM region, the heap growing up towards the stack
+        char sp;
+        return static_cast<size_t>(&sp - sbrk(0));
+    #else
+        return 0;
+    #endif
+    }
+
+    /** Bytes the stack can still grow from here, 0 where unknown */
+    inline size_t stack_free() {
+    #if defined(__IMXRT1062__)
+        // Teensy 4.x: the stack grows down through DTCM towards the end of .bss
+        char sp;
+        return static_cast<size_t>(&sp - _ebss);
+    #elif defined(ARDUINO) && defined(__arm__)
+        // the same gap as the heap's, whichever grows into it first
+        return heap_free();
+    #else
+        return 0;
+    #endif
+    }
+
+    /** Calls, total and worst time of one dispatch map entry */
+    struct method_stats {
+        uint32_t count = 0;
+        uint64_t total = 0;
+        uint32_t max   = 0;
+    };
+
+    /**
+     * @brief Loop and dispatch counters for the RPC_STATS replies.
+     *
+     * Times are taken in ticks of a free-running counter, the cycle counter
+     * where there is one, and only converted to microseconds when read. A
+     * pass is attributed to the dispatch map entry the server looked up
+     * last, which is the method of the one request a pass handles.
+     *
+     * Recording costs a few counter reads and two histogram updates per
+     * pass; the time spent doing so is measured and reported as "ovh".
+     *
+     * @tparam N  dispatch map capacity
+     */
+    template <size_t N>
+    class firmware_telemetry {
+     public:
+        /** @param ticks  free-running counter, @param ticks_per_us  its rate */
+        firmware_telemetry(uint32_t (*ticks)(), uint32_t ticks_per_us)
+            : ticks_(ticks), per_us_(ticks_per_us ? ticks_per_us : 1) {}
+
+        /** At the top of loop() */
+        void loop_start() {
+            uint32_t now = ticks_();
+            if (started_) {
+                uint32_t period = now - last_loop_;
+                loops_.record(period);
+                loop_ticks_ += period;
+            }
+            started_   = true;
+            last_loop_ = now;
+            overhead_ += ticks_() - now;
+        }
+
+        /** Before the server looks at waiting input */
+        void pass_start(int available) {
+            uint32_t now = ticks_();
+            if (available > 0 && static_cast<uint32_t>(available) > rx_peak_) rx_peak_ = available;
+            pass_start_ = ticks_();
+            overhead_ += pass_start_ - now;
+        }
+
+        /** After the server returns. method: dispatch map index, or <0 if none was looked up */
+        void pass_end(int method) {
+            uint32_t now     = ticks_();
+            uint32_t elapsed = now - pass_start_;
+            passes_.record(elapsed / per_us_);
+            if (method >= 0 && static_cast<size_t>(method) < N) {
+                method_stats& m = methods_[method];
+                m.count++;
+                m.total += elapsed;
+                if (elapsed > m.max) m.max = elapsed;
+            }
+            overhead_ += ticks_() - now;
+        }
+
+        /** Link frames dropped so far, e.g. framed_rx::damaged() */
+        void frame_errors(size_t n) { frame_errors_ = n; }
+
+        /** Server passes in microseconds, also behind RPC_DISPATCH_TIME */
+        dispatch_timer& passes() { return passes_; }
+        const log_histogram& loops() const { return loops_; }
+        const method_stats& method(size_t i) const { return methods_[i]; }
+
+        uint32_t us(uint64_t ticks) const { return static_cast<uint32_t>(ticks / per_us_); }
+
+        /** Telemetry time per million of loop time */
+        uint32_t overhead_ppm() const {
+            return loop_ticks_ ? static_cast<uint32_t>(overhead_ * 1000000 / loop_ticks_) : 0;
+        }
+
+        /** RPC_STATS reply. @return characters written, 0 if dest is too small */
+        size_t text(char* dest, size_t dest_size, bool reset) {
+            const log_histogram& pass = passes_.histogram();
+            int n = snprintf(dest, dest_size,
+                             "{\"loop\":[%lu,%lu,%lu,%lu],\"pass\":[%lu,%lu,%lu,%lu],"
+                             "\"heap\":%lu,\"stack\":%lu,\"rx\":%lu,\"ferr\":%lu,\"ovh\":%lu}",
+                             static_cast<unsigned long>(loops_.count()),
+                             static_cast<unsigned long>(us(loops_.percentile(0.5))),
+                             static_cast<unsigned long>(us(loops_.percentile(0.99))),
+                             static_cast<unsigned long>(us(loops_.max())),
+                             static_cast<unsigned long>(pass.count()),
+                             static_cast<unsigned long>(pass.percentile(0.5)),
+                             static_cast<unsigned long>(pass.percentile(0.99)),
+                             static_cast<unsigned long>(pass.max()),
+                             static_cast<unsigned long>(heap_free()),
+                             static_cast<unsigned long>(stack_free()),
+                             static_cast<unsigned long>(rx_peak_),
+                             static_cast<unsigned long>(frame_errors_),
+                             static_cast<unsigned long>(overhead_ppm()));
+            if (reset) {
+                loops_.reset();
+                passes_.reset();
+                rx_peak_    = 0;
+                loop_ticks_ = overhead_ = 0;
+            }
+            return (n > 0 && static_cast<size_t>(n) < dest_size) ? static_cast<size_t>(n) : 0;
+        }
+
+        /**
+         * RPC_METHOD_STATS reply.
+         * @param name  name of a dispatch map index, e.g. from indexed_map::name()
+         * @return characters written
+         */
+        template <class NameF>
+        size_t method_text(char* dest, size_t dest_size, bool reset, NameF name) {
+            const char separator[] = {METHOD_STATS_SEPARATOR, '\0'};
+            size_t out = 0;
+            if (dest_size == 0) return 0;
+            dest[0] = '\0';
+            for (size_t i = 0; i < N; i++) {
+                const method_stats& m = methods_[i];
+                if (m.count == 0) continue;
+                int n = snprintf(dest + out, dest_size - out, "%s%s %lu %lu %lu", out ? separator : "", name(i),
+                                 static_cast<unsigned long>(m.count),
+                                 static_cast<unsigned long>(us(m.total / m.count)),
+                                 static_cast<unsigned long>(us(m.max)));
+                if (n < 0 || static_cast<size_t>(n) >= dest_size - out) {
+                    dest[out] = '\0'; // drop the entry that did not fit
+                    break;
+                }
+                out += static_cast<size_t>(n);
+            }
+            if (reset) {
+                for (size_t i = 0; i < N; i++) methods_[i] = method_stats();
+            }
+            return out;
+        }
+
+     protected:
+        uint32_t (*ticks_)();
+        uint32_t per_us_;
+        bool started_        = false;
+        uint32_t last_loop_  = 0;
+        uint32_t pass_start_ = 0;
+        uint64_t loop_ticks_ = 0;
+        uint64_t overhead_   = 0;
+        uint32_t rx_peak_    = 0;
+        size_t frame_errors_ = 0;
+        log_histogram loops_;
+        dispatch_timer passes_;
+        method_stats methods_[N];
+    };
+
+}; // namespace
+
+#endif // #ifndef __TELEMETRY_H__